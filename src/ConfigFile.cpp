@@ -0,0 +1,158 @@
+#include "ConfigFile.h"
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+
+// The plain numeric settings. Only the time limits may be inf, which
+// turns them off.
+struct DoubleSetting {
+  const char* name;
+  double MPC_Config::*field;
+  bool unlimited;
+};
+
+static const DoubleSetting double_settings[] = {
+    {"dt", &MPC_Config::dt, false},
+    {"ref_v", &MPC_Config::ref_v, false},
+    {"cte_cost_weight", &MPC_Config::cte_cost_weight, false},
+    {"epsi_cost_weight", &MPC_Config::epsi_cost_weight, false},
+    {"v_cost_weight", &MPC_Config::v_cost_weight, false},
+    {"delta_cost_weight", &MPC_Config::delta_cost_weight, false},
+    {"a_cost_weight", &MPC_Config::a_cost_weight, false},
+    {"delta_change_cost_weight", &MPC_Config::delta_change_cost_weight,
+     false},
+    {"a_change_cost_weight", &MPC_Config::a_change_cost_weight, false},
+    {"deadline", &MPC_Config::deadline, true},
+    {"max_cpu_time", &MPC_Config::max_cpu_time, true},
+    {"tol", &MPC_Config::tol, false},
+};
+
+static string Trim(const string& text) {
+  const char* space = " \t\r";
+  size_t begin = text.find_first_not_of(space);
+  if (begin == string::npos) {
+    return string();
+  }
+  return text.substr(begin, text.find_last_not_of(space) + 1 - begin);
+}
+
+static bool ParseDouble(const string& text, double& value) {
+  char* end;
+  value = strtod(text.c_str(), &end);
+  return end != text.c_str() && *end == '\0';
+}
+
+static bool ParsePositive(const string& text, long& value) {
+  char* end;
+  value = strtol(text.c_str(), &end, 10);
+  return end != text.c_str() && *end == '\0' && value > 0;
+}
+
+// Applies one setting, returns false on a bad value and sets known to
+// whether the key exists
+static bool Set(const string& key, const string& value, MPC_Config& config,
+                bool& known) {
+  known = true;
+  for (const DoubleSetting& setting : double_settings) {
+    if (key == setting.name) {
+      double number;
+      // nan fails every comparison, so it has to be ruled out explicitly
+      if (!ParseDouble(value, number) || std::isnan(number) || number < 0 ||
+          (std::isinf(number) && !setting.unlimited)) {
+        return false;
+      }
+      config.*setting.field = number;
+      return true;
+    }
+  }
+  long number;
+  if (key == "N") {
+    if (!ParsePositive(value, number)) {
+      return false;
+    }
+    config.N = number;
+    return true;
+  } else if (key == "max_iter") {
+    if (!ParsePositive(value, number)) {
+      return false;
+    }
+    config.max_iter = number;
+    return true;
+  } else if (key == "derivatives") {
+    return ParseDerivativeMode(value, config.derivatives);
+  } else if (key == "linear_solver") {
+    return ParseLinearSolver(value, config.linear_solver);
+  }
+  known = false;
+  return false;
+}
+
+bool ApplySetting(const string& key, const string& value, MPC_Config& config,
+                  string& error) {
+  bool known;
+  if (!Set(key, value, config, known)) {
+    error = (known ? "bad value for " : "unknown setting ") + key;
+    return false;
+  }
+  return true;
+}
+
+bool CheckConfig(const MPC_Config& config, string& error) {
+  // Written so that nan fails too
+  if (!(config.dt > 0) || !(config.tol > 0) || !(config.deadline > 0) ||
+      !(config.max_cpu_time > 0)) {
+    error = "dt, tol, deadline and max_cpu_time must be positive";
+    return false;
+  }
+  return true;
+}
+
+bool LoadConfigFile(const string& path, MPC_Config& config, string& error) {
+  ifstream in(path);
+  if (!in) {
+    error = "Can't read " + path;
+    return false;
+  }
+  MPC_Config loaded = config;
+  string line;
+  for (int number = 1; getline(in, line); number++) {
+    line = Trim(line.substr(0, line.find('#')));
+    if (line.empty()) {
+      continue;
+    }
+    string where = path + ":" + to_string(number) + ": ";
+    size_t equals = line.find('=');
+    if (equals == string::npos) {
+      error = where + "expected key = value";
+      return false;
+    }
+    string key = Trim(line.substr(0, equals));
+    string value = Trim(line.substr(equals + 1));
+    if (!ApplySetting(key, value, loaded, error)) {
+      error = where + error;
+      return false;
+    }
+  }
+  if (!CheckConfig(loaded, error)) {
+    error = path + ": " + error;
+    return false;
+  }
+  config = loaded;
+  return true;
+}
+
+bool ParseCount(const string& text, size_t& value) {
+  if (text.empty() || !isdigit(static_cast<unsigned char>(text[0]))) {
+    return false;
+  }
+  char* end;
+  errno = 0;
+  value = strtoul(text.c_str(), &end, 10);
+  return *end == '\0' && errno != ERANGE;
+}
+
+bool ParseNumber(const string& text, double& value) {
+  return ParseDouble(text, value) && std::isfinite(value);
+}
@@ -0,0 +1,41 @@
+#ifndef CONFIG_FILE_H
+#define CONFIG_FILE_H
+
+#include <string>
+#include "MPC_Config.h"
+
+using namespace std;
+
+// Reads MPC_Config settings from a text file, one `key = value` per line.
+// Keys are the MPC_Config field names; derivatives and linear_solver take
+// the names of DerivativeModeName and LinearSolverName. Everything after
+// a # is a comment.
+//
+//   # Longer horizon, tighter tolerance
+//   N = 15
+//   dt = 0.08
+//   cte_cost_weight = 3000
+//   tol = 1e-6
+//   linear_solver = ma57
+//
+// Numbers can't be negative or nan, and only deadline and max_cpu_time
+// can be inf (no limit). Keys that don't appear keep the value config
+// already has. On an unknown key or a bad value config is left alone, and
+// error says what was wrong and where.
+bool LoadConfigFile(const string& path, MPC_Config& config, string& error);
+
+// Applies a single setting the way a line of the file would. On an
+// unknown key or a bad value returns false and says which in error.
+bool ApplySetting(const string& key, const string& value, MPC_Config& config,
+                  string& error);
+
+// Whether the settings that have to be positive are. LoadConfigFile
+// checks this after reading a file.
+bool CheckConfig(const MPC_Config& config, string& error);
+
+// Numeric command line arguments: a whole number, and a finite number.
+// They return false on anything else, where stoul and stod would throw.
+bool ParseCount(const string& text, size_t& value);
+bool ParseNumber(const string& text, double& value);
+
+#endif /* CONFIG_FILE_H */
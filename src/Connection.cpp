@@ -0,0 +1,95 @@
+#include "Connection.h"
+#include <algorithm>
+#include "Logger.h"
+#include "Protocol.h"
+
+Connection::Connection(uv_loop_t* loop, uWS::WebSocket<uWS::SERVER> ws,
+                       SolverWorker& worker)
+    : loop_(loop),
+      ws_(ws),
+      worker_(worker),
+      slot_(worker.Open(this)),
+      pending_head_(0),
+      pending_count_(0),
+      dropped_replies_(0) {
+  uv_timer_init(loop_, &timer_);
+  timer_.data = this;
+}
+
+void Connection::OnMessage(const char* data, size_t length) {
+  // Parse straight into the mailbox, the worker takes it from there
+  switch (ParseMessage(data, length, slot_->frames.back().telemetry)) {
+    case TELEMETRY_MESSAGE:
+      worker_.Post(*slot_);
+      break;
+    case MANUAL_MESSAGE: {
+      // Manual driving
+      static const char msg[] = "42[\"manual\",{}]";
+      ws_.send(msg, sizeof(msg) - 1, uWS::OpCode::TEXT);
+      break;
+    }
+    case OTHER_MESSAGE:
+      break;
+  }
+}
+
+void Connection::OnReply(string& msg) {
+  // Latency
+  // The purpose is to mimic real driving conditions where
+  // the car doesn't actuate the commands instantly.
+  SendLater(msg, uint64_t(Pipeline::latency * 1000));
+}
+
+void Connection::SendLater(string& msg, uint64_t delay_ms) {
+  uint64_t due = uv_now(loop_) + delay_ms;
+  if (pending_count_ == max_pending) {
+    pending_head_ = (pending_head_ + 1) % max_pending;
+    pending_count_--;
+    dropped_replies_++;
+  }
+  if (pending_count_ > 0) {
+    // Keep the queue in due order
+    const Pending& last =
+        pending_[(pending_head_ + pending_count_ - 1) % max_pending];
+    due = max(due, last.due);
+  }
+  Pending& pending = pending_[(pending_head_ + pending_count_) % max_pending];
+  pending.due = due;
+  pending.msg.swap(msg);
+  pending_count_++;
+  if (pending_count_ == 1) {
+    uv_timer_start(&timer_, OnTimer, due - uv_now(loop_), 0);
+  }
+}
+
+void Connection::Flush() {
+  uint64_t now = uv_now(loop_);
+  while (pending_count_ > 0 && pending_[pending_head_].due <= now) {
+    const string& msg = pending_[pending_head_].msg;
+    ws_.send(msg.data(), msg.length(), uWS::OpCode::TEXT);
+    pending_head_ = (pending_head_ + 1) % max_pending;
+    pending_count_--;
+  }
+  if (pending_count_ > 0) {
+    uv_timer_start(&timer_, OnTimer, pending_[pending_head_].due - now, 0);
+  }
+}
+
+void Connection::Close() {
+  worker_.Close(slot_);
+  if (dropped_replies_ > 0) {
+    Log(LOG_WARN, LOG_GENERAL, "Dropped %llu replies, the send queue was full",
+        (unsigned long long)dropped_replies_);
+  }
+  pending_count_ = 0;
+  uv_timer_stop(&timer_);
+  uv_close(reinterpret_cast<uv_handle_t*>(&timer_), OnTimerClosed);
+}
+
+void Connection::OnTimer(uv_timer_t* timer) {
+  static_cast<Connection*>(timer->data)->Flush();
+}
+
+void Connection::OnTimerClosed(uv_handle_t* handle) {
+  delete static_cast<Connection*>(handle->data);
+}
@@ -0,0 +1,77 @@
+#ifndef CONNECTION_H
+#define CONNECTION_H
+
+#include <uv.h>
+#include <uWS/uWS.h>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "SolverWorker.h"
+
+using namespace std;
+
+// Everything the server keeps for one simulator connection, stored in the
+// websocket's user data. Lives on the event loop thread.
+//
+// Telemetry is parsed here and handed to the SolverWorker, which runs the
+// controller on its own thread with a separate MPC per connection, so
+// warm starts never mix up two cars. The steer message comes back through
+// OnReply and goes out once the emulated actuation latency has passed,
+// using a timer so nothing blocks the event loop.
+class Connection {
+ public:
+  Connection(uv_loop_t* loop, uWS::WebSocket<uWS::SERVER> ws,
+             SolverWorker& worker);
+
+  // Handles one websocket message from the simulator
+  void OnMessage(const char* data, size_t length);
+
+  // A steer message from the solver worker. msg is swapped with a
+  // buffer of an already sent message.
+  void OnReply(string& msg);
+
+  // Sends msg once delay_ms have passed, after any message queued
+  // before it. The text is taken by swapping strings with a queue slot,
+  // so the buffers keep their capacity and nothing gets copied or
+  // allocated. If the queue is full the oldest message is dropped.
+  void SendLater(string& msg, uint64_t delay_ms);
+
+  // Drops pending messages and frees the connection once libuv is done
+  // with its timer. The websocket must not be used afterwards.
+  void Close();
+
+ private:
+  // A message waiting for its latency to pass
+  struct Pending {
+    uint64_t due;
+    string msg;
+  };
+
+  // Queue length, a second worth of replies at 64 Hz before the
+  // emulated latency runs out
+  static const size_t max_pending = 64;
+
+  // Only Close may delete a connection
+  ~Connection() {}
+
+  // Sends every message that is due and re-arms the timer for the next
+  void Flush();
+
+  static void OnTimer(uv_timer_t* timer);
+  static void OnTimerClosed(uv_handle_t* handle);
+
+  uv_loop_t* loop_;
+  uWS::WebSocket<uWS::SERVER> ws_;
+  SolverWorker& worker_;
+  shared_ptr<SolverSlot> slot_;
+
+  uv_timer_t timer_;
+
+  // Ring of queued messages, oldest at pending_head_
+  Pending pending_[max_pending];
+  size_t pending_head_;
+  size_t pending_count_;
+  uint64_t dropped_replies_;
+};
+
+#endif /* CONNECTION_H */
@@ -0,0 +1,115 @@
+#ifndef FG_EVAL_H
+#define FG_EVAL_H
+
+#include <cppad/cppad.hpp>
+#include "MPC_Config.h"
+#include "MPC_Model.h"
+#include "Polynomial.h"
+
+using CppAD::AD;
+
+// Scalar is AD<double> for taping. mpc_codegen traces the same code with
+// a symbolic scalar to generate the compiled derivatives, so the math
+// functions are called unqualified and found through the scalar type.
+template <size_t N, class Scalar = AD<double> >
+class FG_eval {
+ public:
+  typedef CPPAD_TESTVECTOR(Scalar) ADvector;
+  typedef MPC_Layout<N> Layout;
+
+  // Fitted polynomial coefficients.
+  // These are AD values so they can be recorded as dynamic parameters,
+  // which lets the same tape be reused for every new set of waypoints.
+  ADvector coeffs;
+  // Cost weights, reference speed and timestep
+  MPC_Config config;
+  FG_eval(const ADvector& coeffs, const MPC_Config& config) {
+    this->coeffs = coeffs;
+    this->config = config;
+  }
+
+  void operator()(ADvector& fg, const ADvector& vars) {
+    // Implementing MPC below
+    // `fg` a vector of the cost constraints, `vars` is a vector of variable values (state & actuators)
+    // The cost is stored is the first element of `fg`.
+    // Any additions to the cost should be added to `fg[0]`.
+    fg[0] = 0;
+
+    // Reference State Cost
+    // Below defines the cost related the reference state and
+    // any anything you think may be beneficial.
+
+    // Cost for CTE, psi error and velocity
+    for (size_t t = 0; t < N; t++) {
+      fg[0] += config.cte_cost_weight * Square(vars[Layout::cte_start + t]);
+      fg[0] += config.epsi_cost_weight * Square(vars[Layout::epsi_start + t]);
+      fg[0] += config.v_cost_weight * Square(vars[Layout::v_start + t] - config.ref_v);
+    }
+
+    // Costs for steering (delta) and acceleration (a)
+    for (size_t t = 0; t < N-1; t++) {
+      fg[0] += config.delta_cost_weight * Square(vars[Layout::delta_start + t]);
+      fg[0] += config.a_cost_weight * Square(vars[Layout::a_start + t]);
+    }
+
+    // Costs related to the change in steering and acceleration (makes the ride smoother)
+    for (size_t t = 0; t < N-2; t++) {
+      fg[0] += config.delta_change_cost_weight * Square(vars[Layout::delta_start + t + 1] - vars[Layout::delta_start + t]);
+      fg[0] += config.a_change_cost_weight * Square(vars[Layout::a_start + t + 1] - vars[Layout::a_start + t]);
+    }
+
+    // Setup Model Constraints
+
+    // Initial constraints
+    // We add 1 to each of the starting indices due to cost being located at index 0 of `fg`.
+    // This bumps up the position of all the other values.
+    fg[1 + Layout::x_start] = vars[Layout::x_start];
+    fg[1 + Layout::y_start] = vars[Layout::y_start];
+    fg[1 + Layout::psi_start] = vars[Layout::psi_start];
+    fg[1 + Layout::v_start] = vars[Layout::v_start];
+    fg[1 + Layout::cte_start] = vars[Layout::cte_start];
+    fg[1 + Layout::epsi_start] = vars[Layout::epsi_start];
+
+    // The rest of the constraints
+    for (size_t t = 1; t < N; t++) {
+      // State at time t + 1
+      Scalar x1 = vars[Layout::x_start + t];
+      Scalar y1 = vars[Layout::y_start + t];
+      Scalar psi1 = vars[Layout::psi_start + t];
+      Scalar v1 = vars[Layout::v_start + t];
+      Scalar cte1 = vars[Layout::cte_start + t];
+      Scalar epsi1 = vars[Layout::epsi_start + t];
+
+      // State at time t
+      Scalar x0 = vars[Layout::x_start + t - 1];
+      Scalar y0 = vars[Layout::y_start + t - 1];
+      Scalar psi0 = vars[Layout::psi_start + t - 1];
+      Scalar v0 = vars[Layout::v_start + t - 1];
+      Scalar cte0 = vars[Layout::cte_start + t - 1];
+      Scalar epsi0 = vars[Layout::epsi_start + t - 1];
+
+      // Actuator constraints at time t only
+      Scalar delta0 = vars[Layout::delta_start + t - 1];
+      Scalar a0 = vars[Layout::a_start + t - 1];
+
+      // Reference y and its slope in one Horner pass
+      Scalar df0;
+      Scalar f0 = polyeval(coeffs, x0, df0);
+      Scalar psi_des0 = atan(df0);
+
+      // Setting up the rest of the model constraints
+      fg[1 + Layout::x_start + t] = x1 - (x0 + v0 * cos(psi0) * config.dt);
+      fg[1 + Layout::y_start + t] = y1 - (y0 + v0 * sin(psi0) * config.dt);
+      fg[1 + Layout::psi_start + t] = psi1 - (psi0 - v0 * delta0 / Lf * config.dt);
+      fg[1 + Layout::v_start + t] = v1 - (v0 + a0 * config.dt);
+      fg[1 + Layout::cte_start + t] = cte1 - ((f0-y0) + (v0 * sin(epsi0) * config.dt));
+      fg[1 + Layout::epsi_start + t] = epsi1 - ((psi0 - psi_des0) - v0 * delta0 / Lf * config.dt);
+    }
+  }
+
+ private:
+  // A product records one operation on the tape, pow records several
+  static Scalar Square(const Scalar& e) { return e * e; }
+};
+
+#endif /* FG_EVAL_H */
@@ -0,0 +1,341 @@
+#include "JsonStream.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+void JsonReader::SkipSpace() {
+  while (p_ < end_ &&
+         (*p_ == ' ' || *p_ == '\t' || *p_ == '\n' || *p_ == '\r')) {
+    p_++;
+  }
+}
+
+bool JsonReader::Consume(char c) {
+  SkipSpace();
+  if (p_ < end_ && *p_ == c) {
+    p_++;
+    return true;
+  }
+  return false;
+}
+
+char JsonReader::Peek() {
+  SkipSpace();
+  return p_ < end_ ? *p_ : '\0';
+}
+
+bool JsonReader::Literal(const char* literal) {
+  size_t n = strlen(literal);
+  if (size_t(end_ - p_) >= n && memcmp(p_, literal, n) == 0) {
+    p_ += n;
+    return true;
+  }
+  return false;
+}
+
+bool JsonReader::String(const char*& s, size_t& n) {
+  if (!Consume('"')) {
+    return false;
+  }
+  s = p_;
+  while (p_ < end_ && *p_ != '"') {
+    if (*p_ == '\\') {
+      p_++;
+    }
+    p_++;
+  }
+  if (p_ >= end_) {
+    return false;
+  }
+  n = p_ - s;
+  p_++;
+  return true;
+}
+
+// Up to 15 significant digits and a power of ten up to 22 both convert
+// to double exactly, so their product or quotient is correctly rounded.
+// That covers what the simulator sends. Anything longer goes through
+// strtod on a copy in a small stack buffer.
+bool JsonReader::Number(double& value) {
+  static const double powers[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                                  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                  1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+                                  1e18, 1e19, 1e20, 1e21, 1e22};
+  SkipSpace();
+  const char* start = p_;
+  bool negative = false;
+  if (p_ < end_ && *p_ == '-') {
+    negative = true;
+    p_++;
+  }
+
+  uint64_t mantissa = 0;
+  int digits = 0;
+  int exponent = 0;
+  bool any = false;
+  while (p_ < end_ && *p_ >= '0' && *p_ <= '9') {
+    if (digits < 19) {
+      mantissa = mantissa * 10 + (*p_ - '0');
+      if (mantissa) {
+        digits++;
+      }
+    } else {
+      exponent++;
+      digits++;
+    }
+    p_++;
+    any = true;
+  }
+  if (p_ < end_ && *p_ == '.') {
+    p_++;
+    while (p_ < end_ && *p_ >= '0' && *p_ <= '9') {
+      if (digits < 19) {
+        mantissa = mantissa * 10 + (*p_ - '0');
+        if (mantissa) {
+          digits++;
+        }
+        exponent--;
+      } else {
+        digits++;
+      }
+      p_++;
+      any = true;
+    }
+  }
+  if (!any) {
+    return false;
+  }
+  if (p_ < end_ && (*p_ == 'e' || *p_ == 'E')) {
+    p_++;
+    bool exp_negative = false;
+    if (p_ < end_ && (*p_ == '+' || *p_ == '-')) {
+      exp_negative = *p_ == '-';
+      p_++;
+    }
+    int e = 0;
+    bool exp_any = false;
+    while (p_ < end_ && *p_ >= '0' && *p_ <= '9') {
+      if (e < 10000) {
+        e = e * 10 + (*p_ - '0');
+      }
+      p_++;
+      exp_any = true;
+    }
+    if (!exp_any) {
+      return false;
+    }
+    exponent += exp_negative ? -e : e;
+  }
+
+  if (digits <= 15 && exponent >= -22 && exponent <= 22) {
+    value = double(mantissa);
+    value = exponent < 0 ? value / powers[-exponent] : value * powers[exponent];
+    if (negative) {
+      value = -value;
+    }
+    return true;
+  }
+
+  char buffer[64];
+  size_t n = p_ - start;
+  if (n >= sizeof(buffer)) {
+    return false;
+  }
+  memcpy(buffer, start, n);
+  buffer[n] = '\0';
+  value = strtod(buffer, nullptr);
+  return true;
+}
+
+bool JsonReader::NumberArray(vector<double>& values) {
+  values.clear();
+  if (!Consume('[')) {
+    return false;
+  }
+  if (Consume(']')) {
+    return true;
+  }
+  do {
+    double value;
+    if (!Number(value)) {
+      return false;
+    }
+    values.push_back(value);
+  } while (Consume(','));
+  return Consume(']');
+}
+
+bool JsonReader::SkipValue() {
+  const char* s;
+  size_t n;
+  switch (Peek()) {
+    case '"':
+      return String(s, n);
+    case '{':
+    case '[': {
+      char close = *p_ == '{' ? '}' : ']';
+      p_++;
+      if (Consume(close)) {
+        return true;
+      }
+      do {
+        if (close == '}' && (!String(s, n) || !Consume(':'))) {
+          return false;
+        }
+        if (!SkipValue()) {
+          return false;
+        }
+      } while (Consume(','));
+      return Consume(close);
+    }
+    case 't':
+      return Literal("true");
+    case 'f':
+      return Literal("false");
+    case 'n':
+      return Literal("null");
+    case '\0':
+      return false;
+    default: {
+      double value;
+      return Number(value);
+    }
+  }
+}
+
+void JsonWriter::Separator() {
+  if (!first_) {
+    out_ += ',';
+  }
+  first_ = false;
+}
+
+void JsonWriter::BeginObject() {
+  Separator();
+  out_ += '{';
+  first_ = true;
+}
+
+void JsonWriter::EndObject() {
+  out_ += '}';
+  first_ = false;
+}
+
+void JsonWriter::BeginArray() {
+  Separator();
+  out_ += '[';
+  first_ = true;
+}
+
+void JsonWriter::EndArray() {
+  out_ += ']';
+  first_ = false;
+}
+
+void JsonWriter::Key(const char* name) {
+  Separator();
+  out_ += '"';
+  out_ += name;
+  out_ += "\":";
+  // The value belongs to the key, no comma before it
+  first_ = true;
+}
+
+void JsonWriter::String(const char* s) {
+  Separator();
+  out_ += '"';
+  out_ += s;
+  out_ += '"';
+}
+
+// Writes value with `decimals` digits after the point into buffer and
+// returns the length, or 0 if value doesn't fit the integer arithmetic.
+// Trailing zeros are dropped, one digit after the point is always kept.
+static int WriteFixed(char* buffer, double value, int decimals) {
+  static const uint64_t powers[] = {1,         10,         100,
+                                    1000,      10000,      100000,
+                                    1000000,   10000000,   100000000,
+                                    1000000000};
+  if (decimals > 9) {
+    decimals = 9;
+  }
+  bool negative = value < 0;
+  double magnitude = negative ? -value : value;
+  double scaled = magnitude * powers[decimals] + 0.5;
+  // Beyond 2^53 the scaled value is no longer an exact integer
+  if (!(scaled < 9007199254740992.0)) {
+    return 0;
+  }
+  uint64_t fixed = uint64_t(scaled);
+  uint64_t whole = fixed / powers[decimals];
+  uint64_t fraction = fixed % powers[decimals];
+
+  // Digits come out backwards, so build the number right to left
+  char digits[32];
+  char* p = digits + sizeof(digits);
+  int frac_digits = decimals;
+  while (frac_digits > 1 && fraction % 10 == 0) {
+    fraction /= 10;
+    frac_digits--;
+  }
+  for (int i = 0; i < frac_digits; i++) {
+    *--p = char('0' + fraction % 10);
+    fraction /= 10;
+  }
+  if (frac_digits == 0) {
+    *--p = '0';
+  }
+  *--p = '.';
+  do {
+    *--p = char('0' + whole % 10);
+    whole /= 10;
+  } while (whole);
+  // Values that round to zero are written without a sign
+  if (negative && fixed != 0) {
+    *--p = '-';
+  }
+
+  int n = int(digits + sizeof(digits) - p);
+  memcpy(buffer, p, n);
+  return n;
+}
+
+void JsonWriter::Number(double value) {
+  Separator();
+  if (!std::isfinite(value)) {
+    out_ += "null";
+    return;
+  }
+  if (decimals_ >= 0) {
+    char buffer[32];
+    int n = WriteFixed(buffer, value, decimals_);
+    if (n > 0) {
+      out_.append(buffer, n);
+      return;
+    }
+  }
+  if (value == 0) {
+    out_ += std::signbit(value) ? "-0.0" : "0.0";
+    return;
+  }
+  char buffer[32];
+  int n = snprintf(buffer, sizeof(buffer), "%.15g", value);
+  out_.append(buffer, n);
+  // Whole numbers get a ".0" so they read back as doubles
+  if (!strpbrk(buffer, ".eE")) {
+    out_ += ".0";
+  }
+}
+
+void JsonWriter::NumberArray(const vector<double>& values) {
+  BeginArray();
+  for (double value : values) {
+    Number(value);
+  }
+  EndArray();
+}
+
+void JsonWriter::Raw(const char* text) {
+  out_ += text;
+}
@@ -0,0 +1,162 @@
+#ifndef JSON_STREAM_H
+#define JSON_STREAM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Streaming JSON for the telemetry hot path.
+//
+// json.hpp (v2.1.1) always builds a full document of basic_json nodes and
+// has no SAX interface, so every frame cost a tree of allocations plus a
+// copy of each field out of it. JsonReader instead walks the text once
+// and stores values straight into typed fields, JsonWriter appends
+// values straight to a buffer. Neither builds anything in between.
+
+// One field of a struct T that JsonReader::ReadObject fills in.
+// Set exactly one of number and numbers.
+template <class T>
+struct JsonField {
+  const char* name;
+  double T::*number;
+  vector<double> T::*numbers;
+};
+
+// Reads JSON text in place. The text doesn't need to be NUL terminated,
+// nothing past end is ever read.
+class JsonReader {
+ public:
+  JsonReader(const char* begin, const char* end) : p_(begin), end_(end) {}
+
+  // Skips whitespace, then consumes c if it is next
+  bool Consume(char c);
+
+  // Skips whitespace and returns the next character without consuming
+  // it, or '\0' at the end
+  char Peek();
+
+  // Reads a string and points s/n at its raw text between the quotes.
+  // Escapes are not decoded.
+  bool String(const char*& s, size_t& n);
+
+  // Reads a number. The result is correctly rounded, the same as
+  // strtod gives for the same text.
+  bool Number(double& value);
+
+  // Reads an array of numbers into values, reusing its memory
+  bool NumberArray(vector<double>& values);
+
+  // Skips any value
+  bool SkipValue();
+
+  // Reads an object into obj. Fields in the schema are stored, all
+  // others are skipped. Returns false if the text isn't a valid object
+  // or a field has the wrong type. Bit i of found is set when
+  // schema[i] was present (at most 64 fields).
+  template <class T>
+  bool ReadObject(T& obj, const JsonField<T>* schema, size_t schema_size,
+                  uint64_t& found);
+
+ private:
+  void SkipSpace();
+  bool Literal(const char* literal);
+
+  // Whether the n characters at s are exactly name
+  static bool Equals(const char* s, size_t n, const char* name);
+
+  const char* p_;
+  const char* end_;
+};
+
+// Appends JSON to a string. Commas between values are inserted
+// automatically; Key is followed by exactly one value. Nothing is
+// allocated once out has the capacity for the text.
+//
+// By default doubles are written like json.hpp writes them (15
+// significant digits with snprintf, ".0" on whole numbers). With
+// decimals >= 0 they are written in fixed notation with that many
+// digits after the point, trailing zeros dropped, by a much faster
+// integer formatter. Values too large for it fall back to the default
+// format. NaN and infinity are written as null either way.
+class JsonWriter {
+ public:
+  // Appends to out, which is not cleared
+  explicit JsonWriter(string& out, int decimals = -1)
+      : out_(out), decimals_(decimals), first_(true) {}
+
+  void BeginObject();
+  void EndObject();
+  void BeginArray();
+  void EndArray();
+
+  void Key(const char* name);
+  // s is written as is, it must not need escaping
+  void String(const char* s);
+  void Number(double value);
+  void NumberArray(const vector<double>& values);
+
+  // Appends text as is, e.g. the Socket.IO framing around a value
+  void Raw(const char* text);
+
+ private:
+  void Separator();
+
+  string& out_;
+  const int decimals_;
+  // Whether the next value is the first in its object or array
+  bool first_;
+};
+
+inline bool JsonReader::Equals(const char* s, size_t n, const char* name) {
+  size_t i = 0;
+  for (; i < n; i++) {
+    // A key with a NUL in it can't run past the end of name
+    if (name[i] == '\0' || name[i] != s[i]) {
+      return false;
+    }
+  }
+  return name[i] == '\0';
+}
+
+template <class T>
+bool JsonReader::ReadObject(T& obj, const JsonField<T>* schema,
+                            size_t schema_size, uint64_t& found) {
+  found = 0;
+  if (!Consume('{')) {
+    return false;
+  }
+  if (Consume('}')) {
+    return true;
+  }
+  do {
+    const char* key;
+    size_t n;
+    if (!String(key, n) || !Consume(':')) {
+      return false;
+    }
+    size_t i = 0;
+    while (i < schema_size && !Equals(key, n, schema[i].name)) {
+      i++;
+    }
+    bool ok;
+    if (i == schema_size) {
+      ok = SkipValue();
+    } else if (schema[i].number) {
+      ok = Number(obj.*schema[i].number);
+    } else {
+      ok = NumberArray(obj.*schema[i].numbers);
+    }
+    if (!ok) {
+      return false;
+    }
+    if (i < schema_size) {
+      found |= uint64_t(1) << i;
+    }
+  } while (Consume(','));
+  return Consume('}');
+}
+
+#endif /* JSON_STREAM_H */
@@ -0,0 +1,56 @@
+#ifndef LATEST_MAILBOX_H
+#define LATEST_MAILBOX_H
+
+#include <atomic>
+
+using namespace std;
+
+// Single slot mailbox between one producer and one consumer thread where
+// only the newest value matters.
+//
+// This is a triple buffer: the producer fills back(), Publish swaps it
+// with the middle buffer, and Take swaps the middle buffer with front().
+// Neither side ever waits for the other, and a value the consumer hasn't
+// taken yet is simply replaced by the next one. The buffers are reused,
+// so values that own memory (vectors, strings) stop allocating once they
+// have grown to size.
+template <class T>
+class LatestMailbox {
+ public:
+  LatestMailbox() : middle_(1), front_(0), back_(2) {}
+
+  // Producer side. Fill back(), then Publish it. Returns true if that
+  // replaced a value the consumer never took.
+  T& back() { return buffers_[back_]; }
+
+  bool Publish() {
+    unsigned previous = middle_.exchange(back_ | fresh, memory_order_acq_rel);
+    back_ = previous & index;
+    return (previous & fresh) != 0;
+  }
+
+  // Consumer side. Returns true and moves the newest value to front() if
+  // one was published since the last Take.
+  bool Take() {
+    if ((middle_.load(memory_order_relaxed) & fresh) == 0) {
+      return false;
+    }
+    unsigned previous = middle_.exchange(front_, memory_order_acq_rel);
+    front_ = previous & index;
+    return true;
+  }
+
+  T& front() { return buffers_[front_]; }
+
+ private:
+  // middle_ holds the index of the middle buffer and whether it is new
+  static const unsigned index = 3;
+  static const unsigned fresh = 4;
+
+  T buffers_[3];
+  atomic<unsigned> middle_;
+  unsigned front_;
+  unsigned back_;
+};
+
+#endif /* LATEST_MAILBOX_H */
@@ -0,0 +1,278 @@
+#include "Logger.h"
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <thread>
+
+static const char* level_names[] = {"debug", "info", "warn", "error", "off"};
+static const char* channel_names[] = {"general", "telemetry", "steer", "cost",
+                                      "stats"};
+
+// Bounded multi-producer single-consumer queue of formatted lines.
+//
+// Each slot carries a sequence number: a producer claims the slot at
+// position pos when its sequence is pos, fills it and publishes it by
+// setting the sequence to pos + 1. The writer frees it again by setting
+// capacity + pos. No locks, and producers only contend on tail_.
+class LogQueue {
+ public:
+  static const size_t capacity = 1024;
+  static const size_t line_size = 2048;
+
+  struct Slot {
+    atomic<size_t> seq;
+    LogLevel level;
+    LogChannel channel;
+    double time;
+    size_t length;
+    char text[line_size];
+  };
+
+  LogQueue() : slots_(new Slot[capacity]), tail_(0), head_(0) {
+    for (size_t i = 0; i < capacity; i++) {
+      slots_[i].seq.store(i, memory_order_relaxed);
+    }
+  }
+
+  // Claims a slot to fill, or returns null if the queue is full
+  Slot* Claim(size_t& pos) {
+    pos = tail_.load(memory_order_relaxed);
+    for (;;) {
+      Slot& slot = slots_[pos % capacity];
+      size_t seq = slot.seq.load(memory_order_acquire);
+      intptr_t diff = intptr_t(seq) - intptr_t(pos);
+      if (diff == 0) {
+        if (tail_.compare_exchange_weak(pos, pos + 1,
+                                        memory_order_relaxed)) {
+          return &slot;
+        }
+      } else if (diff < 0) {
+        return nullptr;
+      } else {
+        pos = tail_.load(memory_order_relaxed);
+      }
+    }
+  }
+
+  void Publish(Slot* slot, size_t pos) {
+    slot->seq.store(pos + 1, memory_order_release);
+  }
+
+  // Writer side, the next line if there is one
+  Slot* Front() {
+    Slot& slot = slots_[head_ % capacity];
+    if (slot.seq.load(memory_order_acquire) != head_ + 1) {
+      return nullptr;
+    }
+    return &slot;
+  }
+
+  void Pop() {
+    slots_[head_ % capacity].seq.store(head_ + capacity,
+                                       memory_order_release);
+    head_++;
+  }
+
+ private:
+  unique_ptr<Slot[]> slots_;
+  atomic<size_t> tail_;
+  size_t head_;
+};
+
+// Sampling and rate limiting state of one channel
+struct ChannelState {
+  atomic<uint64_t> count{0};
+  atomic<int64_t> window{-1};
+  atomic<uint64_t> in_window{0};
+};
+
+class Logger {
+ public:
+  Logger() : configured_(false), running_(false), dropped_(0), out_(stdout) {}
+
+  ~Logger() {
+    if (running_) {
+      running_ = false;
+      writer_.join();
+      if (out_ != stdout) {
+        fclose(out_);
+      }
+    }
+  }
+
+  void Configure(const LogConfig& config) {
+    if (configured_) {
+      return;
+    }
+    config_ = config;
+    if (!config_.path.empty()) {
+      FILE* file = fopen(config_.path.c_str(), "a");
+      if (file) {
+        out_ = file;
+      } else {
+        fprintf(stderr, "Can't open log file %s, logging to stdout\n",
+                config_.path.c_str());
+      }
+    }
+    start_ = chrono::steady_clock::now();
+    running_ = true;
+    writer_ = thread(&Logger::WriterLoop, this);
+    configured_ = true;
+  }
+
+  bool Enabled(LogLevel level) const {
+    return configured_ && level >= config_.level && level != LOG_OFF;
+  }
+
+  // Sampling and rate limit
+  bool Accept(LogChannel channel) {
+    ChannelState& state = channels_[channel];
+    size_t every = config_.sample_every[channel];
+    if (every > 1 && state.count++ % every != 0) {
+      return false;
+    }
+    size_t limit = config_.max_per_second[channel];
+    if (limit > 0) {
+      int64_t second = int64_t(Now());
+      int64_t window = state.window.load(memory_order_relaxed);
+      if (window != second &&
+          state.window.compare_exchange_strong(window, second)) {
+        state.in_window = 0;
+      }
+      if (state.in_window++ >= limit) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Claims a slot for a line, null if the queue is full
+  LogQueue::Slot* Begin(LogLevel level, LogChannel channel, size_t& pos) {
+    LogQueue::Slot* slot = queue_.Claim(pos);
+    if (!slot) {
+      dropped_++;
+      return nullptr;
+    }
+    slot->level = level;
+    slot->channel = channel;
+    slot->time = Now();
+    return slot;
+  }
+
+  void End(LogQueue::Slot* slot, size_t pos) { queue_.Publish(slot, pos); }
+
+ private:
+  double Now() const {
+    return chrono::duration<double>(chrono::steady_clock::now() - start_)
+        .count();
+  }
+
+  void WriterLoop() {
+    for (;;) {
+      bool stopping = !running_;
+      bool wrote = false;
+      while (LogQueue::Slot* slot = queue_.Front()) {
+        fprintf(out_, "[%12.6f] %-5s %-9s ", slot->time,
+                level_names[slot->level], channel_names[slot->channel]);
+        fwrite(slot->text, 1, slot->length, out_);
+        fputc('\n', out_);
+        queue_.Pop();
+        wrote = true;
+      }
+      uint64_t dropped = dropped_.exchange(0);
+      if (dropped > 0) {
+        fprintf(out_, "[%12.6f] warn  general   %llu log lines dropped, the "
+                "queue was full\n", Now(), (unsigned long long)dropped);
+        wrote = true;
+      }
+      if (wrote) {
+        fflush(out_);
+      }
+      if (stopping) {
+        return;
+      }
+      if (!wrote) {
+        this_thread::sleep_for(chrono::milliseconds(5));
+      }
+    }
+  }
+
+  LogConfig config_;
+  atomic<bool> configured_;
+  atomic<bool> running_;
+  atomic<uint64_t> dropped_;
+  ChannelState channels_[LOG_CHANNELS];
+  LogQueue queue_;
+  FILE* out_;
+  chrono::steady_clock::time_point start_;
+  thread writer_;
+};
+
+static Logger& TheLogger() {
+  static Logger logger;
+  return logger;
+}
+
+void ConfigureLog(const LogConfig& config) { TheLogger().Configure(config); }
+
+bool LogEnabled(LogLevel level, LogChannel channel) {
+  return TheLogger().Enabled(level);
+}
+
+void Log(LogLevel level, LogChannel channel, const char* format, ...) {
+  Logger& logger = TheLogger();
+  if (!logger.Enabled(level) || !logger.Accept(channel)) {
+    return;
+  }
+  size_t pos;
+  LogQueue::Slot* slot = logger.Begin(level, channel, pos);
+  if (!slot) {
+    return;
+  }
+  va_list args;
+  va_start(args, format);
+  int n = vsnprintf(slot->text, LogQueue::line_size, format, args);
+  va_end(args);
+  slot->length = n < 0 ? 0 : min(size_t(n), LogQueue::line_size - 1);
+  logger.End(slot, pos);
+}
+
+void LogText(LogLevel level, LogChannel channel, const char* text,
+             size_t length) {
+  Logger& logger = TheLogger();
+  if (!logger.Enabled(level) || !logger.Accept(channel)) {
+    return;
+  }
+  size_t pos;
+  LogQueue::Slot* slot = logger.Begin(level, channel, pos);
+  if (!slot) {
+    return;
+  }
+  slot->length = min(length, LogQueue::line_size);
+  memcpy(slot->text, text, slot->length);
+  logger.End(slot, pos);
+}
+
+bool ParseLogLevel(const string& name, LogLevel& level) {
+  for (int i = LOG_DEBUG; i <= LOG_OFF; i++) {
+    if (name == level_names[i]) {
+      level = LogLevel(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ParseLogChannel(const string& name, LogChannel& channel) {
+  for (int i = 0; i < LOG_CHANNELS; i++) {
+    if (name == channel_names[i]) {
+      channel = LogChannel(i);
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,72 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <cstddef>
+#include <string>
+
+using namespace std;
+
+// Asynchronous leveled logging.
+//
+// Log formats the line straight into a slot of a bounded lock-free queue
+// and returns; a background thread writes the slots out in batches, so
+// callers never wait on the terminal or a pipe. When the queue is full,
+// lines are dropped and the writer reports how many.
+//
+// Per-frame output (raw telemetry, steer replies, costs) goes to its own
+// channel, and every channel can be sampled (only every Nth line) and
+// rate limited (at most N lines a second), so it can stay on at a
+// useful level without slowing the control loop down.
+
+enum LogLevel { LOG_DEBUG, LOG_INFO, LOG_WARN, LOG_ERROR, LOG_OFF };
+
+enum LogChannel {
+  // Connections, startup, problems
+  LOG_GENERAL,
+  // Raw messages from the simulator
+  LOG_TELEMETRY,
+  // Steer replies to the simulator
+  LOG_STEER,
+  // Cost of every solve
+  LOG_COST,
+  // Periodic solver statistics
+  LOG_STATS,
+  LOG_CHANNELS
+};
+
+struct LogConfig {
+  // Lines below this level are dropped before any formatting
+  LogLevel level = LOG_INFO;
+
+  // Where the writer puts the lines, stdout if empty
+  string path;
+
+  // Per channel: log only every Nth line (1 logs all of them), and at
+  // most this many lines a second (0 for no limit)
+  size_t sample_every[LOG_CHANNELS] = {1, 1, 1, 1, 1};
+  size_t max_per_second[LOG_CHANNELS] = {0, 0, 0, 0, 0};
+};
+
+// Applies config and starts the writer thread. Call once at startup,
+// before anything is logged; until then Log writes nothing.
+void ConfigureLog(const LogConfig& config);
+
+// Whether a line at this level would be kept, for callers that do
+// expensive work to build one. Ignores sampling and rate limits.
+bool LogEnabled(LogLevel level, LogChannel channel);
+
+// printf style. The line is cut off after about 2 kB.
+void Log(LogLevel level, LogChannel channel, const char* format, ...)
+    __attribute__((format(printf, 3, 4)));
+
+// Logs length bytes of text as they are
+void LogText(LogLevel level, LogChannel channel, const char* text,
+             size_t length);
+
+// Reads a level or channel name as used on the command line
+// ("debug", "info", ..., "telemetry", "cost", ...). Return false for
+// names they don't know.
+bool ParseLogLevel(const string& name, LogLevel& level);
+bool ParseLogChannel(const string& name, LogChannel& channel);
+
+#endif /* LOGGER_H */
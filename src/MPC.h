@@ -1,20 +1,113 @@
 #ifndef MPC_H
 #define MPC_H
 
+#include <memory>
+#include <string>
 #include <vector>
 #include "Eigen-3.3/Eigen/Core"
+#include "MPC_Config.h"
+#include "SolveStats.h"
 
 using namespace std;
 
+class MPC_HorizonBase;
+class MPC_Table;
+
 class MPC {
  public:
-  MPC();
+  // Solver used by Solve.
+  // IPOPT solves the full nonlinear problem with interior point iterations,
+  // SQP runs one real-time iteration of the structured solver in MPC_SQP.
+  enum Backend { IPOPT, SQP };
+
+  // config.N is the number of timesteps to predict. The solvers are
+  // compiled for N = 10, 15, 20 and 25, anything else throws
+  // std::invalid_argument.
+  explicit MPC(const MPC_Config& config = MPC_Config());
+
+  // Whether the constructor would accept config, without building the
+  // solvers: a supported N and, for compiled derivatives, kernels that
+  // match. Touches no CppAD state, unlike the constructor, so it can run
+  // on a thread other than the one that owns the MPCs. Otherwise returns
+  // false with error set.
+  static bool Supports(const MPC_Config& config, string& error);
 
   virtual ~MPC();
 
   // Solve the model given an initial state and polynomial coefficients.
-  // Return the first actuations.
+  // Return the first actuations. There always are some: when the solver
+  // runs past config.deadline or fails, they come from its best feasible
+  // iterate or a fallback, and stats().source says which.
   vector<double> Solve(Eigen::VectorXd state, Eigen::VectorXd coeffs);
+
+  // Solve K independent problems in parallel, states[k] with coeffs[k].
+  // Returns what Solve would for each of them.
+  //
+  // Problem k is always solved by the same solver instance, on the same
+  // pool worker, so as long as the caller keeps the order stable (e.g.
+  // one slot per vehicle) every slot warm starts from its own previous
+  // solution.
+  vector<vector<double>> SolveBatch(const vector<Eigen::VectorXd>& states,
+                                    const vector<Eigen::VectorXd>& coeffs);
+
+  // Seed each solve with the previous solution shifted by one timestep.
+  // Consecutive telemetry messages are nearly identical, so this cuts the
+  // number of Ipopt iterations a lot. Off by default.
+  void SetWarmStart(bool enable);
+
+  // Select the solver backend, IPOPT by default.
+  void SetBackend(Backend backend) { backend_ = backend; }
+
+  // Answer problems inside the region table covers from it and solve
+  // only the rest, see MPC_Table.h. Returns false and keeps solving
+  // everything if the table was solved for other settings or with the
+  // other backend (see MPC_Table::Matches), so call it after SetBackend.
+  // nullptr goes back to solving everything.
+  bool SetTable(shared_ptr<const MPC_Table> table);
+
+  // Forget the previous solutions, the next Solve starts cold
+  void Reset();
+
+  // Number of timesteps predicted
+  size_t horizon() const { return config_.N; }
+
+  // Cost of the last Solve, and whether the solver converged
+  double cost() const { return stats_.objective; }
+  bool ok() const { return stats_.ok; }
+
+  // Timings, iterations and status of the last Solve
+  const SolveStats& stats() const { return stats_; }
+
+  // Copies the stats of the most recent solves (Solve and every problem
+  // of SolveBatch), oldest first. Safe to call while solving.
+  void RecentStats(vector<SolveStats>& out) const {
+    stats_ring_.Snapshot(out);
+  }
+
+  // Latency percentiles and iteration counts over RecentStats
+  StatsSummary Summary() const;
+
+  // Number of solves recorded so far
+  uint64_t solve_count() const { return stats_ring_.count(); }
+
+ private:
+  // Runs the selected backend on one solver and records its stats
+  bool SolveWith(MPC_HorizonBase& solver, const Eigen::VectorXd& state,
+                 const Eigen::VectorXd& coeffs, SolveStats& stats,
+                 vector<double>& solved);
+
+  const MPC_Config config_;
+  unique_ptr<MPC_HorizonBase> solver_;
+  Backend backend_;
+  bool warm_start_;
+  shared_ptr<const MPC_Table> table_;
+
+  // One solver per SolveBatch slot, created on the slot's worker the
+  // first time a batch that large comes in
+  vector<unique_ptr<MPC_HorizonBase>> batch_solvers_;
+
+  SolveStats stats_;
+  StatsRing<SolveStats, 1024> stats_ring_;
 };
 
 #endif /* MPC_H */
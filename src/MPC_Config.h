@@ -0,0 +1,127 @@
+#ifndef MPC_CONFIG_H
+#define MPC_CONFIG_H
+
+#include <cstddef>
+#include <string>
+
+// How MPC_NLP gets the derivatives Ipopt asks for: sparse AD sweeps over
+// the CppAD tape of FG_eval, the closed forms in MPC_Derivatives.h, or the
+// kernels mpc_codegen generates from FG_eval at build time (MPC_Kernels.h)
+enum DerivativeMode {
+  TAPED_DERIVATIVES,
+  ANALYTIC_DERIVATIVES,
+  COMPILED_DERIVATIVES
+};
+
+inline const char* DerivativeModeName(DerivativeMode mode) {
+  switch (mode) {
+    case ANALYTIC_DERIVATIVES:
+      return "analytic";
+    case COMPILED_DERIVATIVES:
+      return "compiled";
+    default:
+      return "taped";
+  }
+}
+
+// Returns false for an unknown name
+inline bool ParseDerivativeMode(const std::string& name, DerivativeMode& mode) {
+  for (int i = TAPED_DERIVATIVES; i <= COMPILED_DERIVATIVES; i++) {
+    if (name == DerivativeModeName(DerivativeMode(i))) {
+      mode = DerivativeMode(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+// Linear solver for the KKT systems of a solve.
+//
+// Ipopt gets MUMPS, one of the HSL solvers or Pardiso as its
+// linear_solver option; the library has to be built with it.
+// DEFAULT_SOLVER keeps the one Ipopt was built to use, normally MUMPS.
+//
+// The SQP backend condenses the states out of its QPs and factors the
+// dense result, unless RICCATI_SOLVER is chosen. That solves the
+// block-banded stage structure directly with a Riccati recursion.
+// RICCATI_SOLVER only exists in the SQP backend, Ipopt treats it like
+// DEFAULT_SOLVER. Ipopt could take a banded solver as a
+// SparseSymLinearSolverInterface, but only through a custom
+// AlgorithmBuilder, not through the TNLP that MPC_NLP implements.
+enum LinearSolver {
+  DEFAULT_SOLVER,
+  MUMPS_SOLVER,
+  MA27_SOLVER,
+  MA57_SOLVER,
+  MA86_SOLVER,
+  MA97_SOLVER,
+  PARDISO_SOLVER,
+  RICCATI_SOLVER
+};
+
+static const char* const linear_solver_names[] = {
+    "default", "mumps", "ma27", "ma57", "ma86", "ma97", "pardiso", "riccati"};
+
+inline const char* LinearSolverName(LinearSolver solver) {
+  return linear_solver_names[solver];
+}
+
+// Returns false for an unknown name
+inline bool ParseLinearSolver(const std::string& name, LinearSolver& solver) {
+  for (int i = DEFAULT_SOLVER; i <= RICCATI_SOLVER; i++) {
+    if (name == linear_solver_names[i]) {
+      solver = LinearSolver(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+// Solver settings, one copy per MPC instance.
+//
+// Nothing here is shared between instances, so several MPCs with
+// different settings can run on different threads at the same time.
+// The defaults can be overridden from a file, see ConfigFile.h.
+struct MPC_Config {
+  // Number of timesteps and their duration
+  // Currently tuned to predict 1 second worth
+  size_t N = 10;
+  double dt = 0.1;
+
+  // Set desired speed for the cost function (i.e. max speed)
+  double ref_v = 120;
+
+  // Weights for how "important" each cost is - can be tuned
+  double cte_cost_weight = 2000;
+  double epsi_cost_weight = 2000;
+  double v_cost_weight = 1;
+  double delta_cost_weight = 10;
+  double a_cost_weight = 10;
+  double delta_change_cost_weight = 100;
+  double a_change_cost_weight = 10;
+
+  // Wall time a solve may take in seconds. The server sends each reply
+  // Pipeline::latency (0.1 s) after the telemetry came in, so the solve
+  // has to fit well inside that. Ipopt stops at the first iteration past
+  // it and the best feasible iterate or a fallback is used instead, see
+  // ActuationSource. The SQP backend's iterations are bounded anyway.
+  // Waiting for another thread's Ipopt solve doesn't count, see
+  // NeedsIpoptLock. inf turns it off.
+  double deadline = 0.05;
+
+  // Ipopt's own CPU time limit, a backstop for a single iteration
+  // running far past the deadline
+  double max_cpu_time = 0.5;
+
+  // Ipopt's convergence tolerance and iteration cap, its own defaults
+  double tol = 1e-8;
+  int max_iter = 3000;
+
+  // Derivatives for the Ipopt backend
+  DerivativeMode derivatives = TAPED_DERIVATIVES;
+
+  // KKT solver of both backends
+  LinearSolver linear_solver = DEFAULT_SOLVER;
+};
+
+#endif /* MPC_CONFIG_H */
@@ -0,0 +1,296 @@
+#ifndef MPC_DERIVATIVES_H
+#define MPC_DERIVATIVES_H
+
+#include <cmath>
+#include "Eigen-3.3/Eigen/Core"
+#include "MPC_Config.h"
+#include "MPC_Model.h"
+#include "Polynomial.h"
+
+// The problem of FG_eval with hand-derived first and second derivatives.
+//
+// Every constraint only couples one timestep to the next, and the cost is
+// a sum of squares, so the derivatives are a handful of closed form terms
+// per timestep. Evaluating them directly skips the AD sweeps that
+// otherwise dominate an Ipopt iteration.
+//
+// The sparse Jacobian and Hessian are produced through callbacks, one call
+// per structural nonzero in a fixed order that doesn't depend on x. The
+// same functions therefore give the sparsity pattern (call them once and
+// record the positions) and the values.
+template <size_t N>
+class MPC_Derivatives {
+ public:
+  typedef MPC_Layout<N> Layout;
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  explicit MPC_Derivatives(const MPC_Config& config)
+      : config_(config), coeffs_(Coeffs::Zero()) {}
+
+  void SetCoeffs(const Eigen::VectorXd& coeffs) { coeffs_ = coeffs; }
+
+  // fg[0] of FG_eval
+  double Cost(const double* x) const {
+    double cost = 0;
+    for (size_t t = 0; t < N; t++) {
+      double cte = x[Layout::cte_start + t];
+      double epsi = x[Layout::epsi_start + t];
+      double dv = x[Layout::v_start + t] - config_.ref_v;
+      cost += config_.cte_cost_weight * cte * cte;
+      cost += config_.epsi_cost_weight * epsi * epsi;
+      cost += config_.v_cost_weight * dv * dv;
+    }
+    for (size_t t = 0; t < N - 1; t++) {
+      double delta = x[Layout::delta_start + t];
+      double a = x[Layout::a_start + t];
+      cost += config_.delta_cost_weight * delta * delta;
+      cost += config_.a_cost_weight * a * a;
+    }
+    for (size_t t = 0; t < N - 2; t++) {
+      double ddelta = x[Layout::delta_start + t + 1] - x[Layout::delta_start + t];
+      double da = x[Layout::a_start + t + 1] - x[Layout::a_start + t];
+      cost += config_.delta_change_cost_weight * ddelta * ddelta;
+      cost += config_.a_change_cost_weight * da * da;
+    }
+    return cost;
+  }
+
+  void CostGradient(const double* x, double* grad) const {
+    for (size_t i = 0; i < Layout::n_vars; i++) {
+      grad[i] = 0;
+    }
+    for (size_t t = 0; t < N; t++) {
+      grad[Layout::cte_start + t] =
+          2 * config_.cte_cost_weight * x[Layout::cte_start + t];
+      grad[Layout::epsi_start + t] =
+          2 * config_.epsi_cost_weight * x[Layout::epsi_start + t];
+      grad[Layout::v_start + t] =
+          2 * config_.v_cost_weight * (x[Layout::v_start + t] - config_.ref_v);
+    }
+    for (size_t t = 0; t < N - 1; t++) {
+      grad[Layout::delta_start + t] =
+          2 * config_.delta_cost_weight * x[Layout::delta_start + t];
+      grad[Layout::a_start + t] =
+          2 * config_.a_cost_weight * x[Layout::a_start + t];
+    }
+    for (size_t t = 0; t < N - 2; t++) {
+      double ddelta = 2 * config_.delta_change_cost_weight *
+                      (x[Layout::delta_start + t + 1] - x[Layout::delta_start + t]);
+      double da = 2 * config_.a_change_cost_weight *
+                  (x[Layout::a_start + t + 1] - x[Layout::a_start + t]);
+      grad[Layout::delta_start + t] -= ddelta;
+      grad[Layout::delta_start + t + 1] += ddelta;
+      grad[Layout::a_start + t] -= da;
+      grad[Layout::a_start + t + 1] += da;
+    }
+  }
+
+  // fg[1..] of FG_eval
+  void Constraints(const double* x, double* g) const {
+    g[Layout::x_start] = x[Layout::x_start];
+    g[Layout::y_start] = x[Layout::y_start];
+    g[Layout::psi_start] = x[Layout::psi_start];
+    g[Layout::v_start] = x[Layout::v_start];
+    g[Layout::cte_start] = x[Layout::cte_start];
+    g[Layout::epsi_start] = x[Layout::epsi_start];
+
+    const double dt = config_.dt;
+    for (size_t t = 1; t < N; t++) {
+      double x0 = x[Layout::x_start + t - 1];
+      double y0 = x[Layout::y_start + t - 1];
+      double psi0 = x[Layout::psi_start + t - 1];
+      double v0 = x[Layout::v_start + t - 1];
+      double epsi0 = x[Layout::epsi_start + t - 1];
+      double delta0 = x[Layout::delta_start + t - 1];
+      double a0 = x[Layout::a_start + t - 1];
+
+      double df;
+      double f0 = polyeval(coeffs_, x0, df);
+      double psi_des0 = atan(df);
+
+      g[Layout::x_start + t] =
+          x[Layout::x_start + t] - (x0 + v0 * cos(psi0) * dt);
+      g[Layout::y_start + t] =
+          x[Layout::y_start + t] - (y0 + v0 * sin(psi0) * dt);
+      g[Layout::psi_start + t] =
+          x[Layout::psi_start + t] - (psi0 - v0 * delta0 / Lf * dt);
+      g[Layout::v_start + t] = x[Layout::v_start + t] - (v0 + a0 * dt);
+      g[Layout::cte_start + t] =
+          x[Layout::cte_start + t] - ((f0 - y0) + v0 * sin(epsi0) * dt);
+      g[Layout::epsi_start + t] =
+          x[Layout::epsi_start + t] - ((psi0 - psi_des0) - v0 * delta0 / Lf * dt);
+    }
+  }
+
+  // Calls put(row, col, value) for every nonzero of the constraint
+  // Jacobian, rows numbered like Constraints
+  template <class Put>
+  void ConstraintJacobian(const double* x, Put put) const {
+    // Initial state
+    for (size_t i = 0; i < Layout::NX; i++) {
+      put(i * N, i * N, 1.0);
+    }
+
+    const double dt = config_.dt;
+    for (size_t t = 1; t < N; t++) {
+      const size_t X = Layout::x_start + t - 1;
+      const size_t Y = Layout::y_start + t - 1;
+      const size_t P = Layout::psi_start + t - 1;
+      const size_t V = Layout::v_start + t - 1;
+      const size_t E = Layout::epsi_start + t - 1;
+      const size_t D = Layout::delta_start + t - 1;
+      const size_t A = Layout::a_start + t - 1;
+      double x0 = x[X];
+      double psi0 = x[P];
+      double v0 = x[V];
+      double epsi0 = x[E];
+      double delta0 = x[D];
+
+      // Slope and curvature of the reference polynomial
+      double f[3];
+      polyderivs(coeffs_, x0, f, 2);
+      double df = f[1];
+      double d2f = f[2];
+
+      double cos_psi = cos(psi0);
+      double sin_psi = sin(psi0);
+      double cos_epsi = cos(epsi0);
+      double sin_epsi = sin(epsi0);
+
+      // x
+      size_t row = Layout::x_start + t;
+      put(row, X, -1.0);
+      put(row, P, v0 * sin_psi * dt);
+      put(row, V, -cos_psi * dt);
+      put(row, X + 1, 1.0);
+
+      // y
+      row = Layout::y_start + t;
+      put(row, Y, -1.0);
+      put(row, P, -v0 * cos_psi * dt);
+      put(row, V, -sin_psi * dt);
+      put(row, Y + 1, 1.0);
+
+      // psi
+      row = Layout::psi_start + t;
+      put(row, P, -1.0);
+      put(row, V, delta0 / Lf * dt);
+      put(row, P + 1, 1.0);
+      put(row, D, v0 / Lf * dt);
+
+      // v
+      row = Layout::v_start + t;
+      put(row, V, -1.0);
+      put(row, V + 1, 1.0);
+      put(row, A, -dt);
+
+      // cte
+      row = Layout::cte_start + t;
+      put(row, X, -df);
+      put(row, Y, 1.0);
+      put(row, V, -sin_epsi * dt);
+      put(row, Layout::cte_start + t, 1.0);
+      put(row, E, -v0 * cos_epsi * dt);
+
+      // epsi
+      row = Layout::epsi_start + t;
+      put(row, X, d2f / (1 + df * df));
+      put(row, P, -1.0);
+      put(row, V, delta0 / Lf * dt);
+      put(row, E + 1, 1.0);
+      put(row, D, v0 / Lf * dt);
+    }
+  }
+
+  // Calls add(row, col, value) for the terms of
+  // obj_factor * Hessian(cost) + sum_i lambda[i] * Hessian(g_i), lower
+  // triangle only. A position can come up more than once, the terms add.
+  template <class Add>
+  void LagrangianHessian(const double* x, double obj_factor,
+                         const double* lambda, Add add) const {
+    // The cost is quadratic, its Hessian is constant
+    for (size_t t = 0; t < N; t++) {
+      add(Layout::v_start + t, Layout::v_start + t,
+          2 * obj_factor * config_.v_cost_weight);
+      add(Layout::cte_start + t, Layout::cte_start + t,
+          2 * obj_factor * config_.cte_cost_weight);
+      add(Layout::epsi_start + t, Layout::epsi_start + t,
+          2 * obj_factor * config_.epsi_cost_weight);
+    }
+    for (size_t t = 0; t < N - 1; t++) {
+      add(Layout::delta_start + t, Layout::delta_start + t,
+          2 * obj_factor * config_.delta_cost_weight);
+      add(Layout::a_start + t, Layout::a_start + t,
+          2 * obj_factor * config_.a_cost_weight);
+    }
+    for (size_t t = 0; t < N - 2; t++) {
+      const size_t D = Layout::delta_start + t;
+      const size_t A = Layout::a_start + t;
+      double wd = 2 * obj_factor * config_.delta_change_cost_weight;
+      double wa = 2 * obj_factor * config_.a_change_cost_weight;
+      add(D, D, wd);
+      add(D + 1, D + 1, wd);
+      add(D + 1, D, -wd);
+      add(A, A, wa);
+      add(A + 1, A + 1, wa);
+      add(A + 1, A, -wa);
+    }
+
+    // Only the nonlinear terms of the model constraints are left
+    const double dt = config_.dt;
+    for (size_t t = 1; t < N; t++) {
+      const size_t X = Layout::x_start + t - 1;
+      const size_t P = Layout::psi_start + t - 1;
+      const size_t V = Layout::v_start + t - 1;
+      const size_t E = Layout::epsi_start + t - 1;
+      const size_t D = Layout::delta_start + t - 1;
+      double x0 = x[X];
+      double psi0 = x[P];
+      double v0 = x[V];
+      double epsi0 = x[E];
+
+      double l_x = lambda[Layout::x_start + t];
+      double l_y = lambda[Layout::y_start + t];
+      double l_psi = lambda[Layout::psi_start + t];
+      double l_cte = lambda[Layout::cte_start + t];
+      double l_epsi = lambda[Layout::epsi_start + t];
+
+      double f[4];
+      polyderivs(coeffs_, x0, f, 3);
+      double df = f[1];
+      double d2f = f[2];
+      double d3f = f[3];
+      double s = 1 + df * df;
+
+      double cos_psi = cos(psi0);
+      double sin_psi = sin(psi0);
+      double cos_epsi = cos(epsi0);
+      double sin_epsi = sin(epsi0);
+
+      // f(x0) in cte and atan(f'(x0)) in epsi
+      add(X, X, -l_cte * d2f + l_epsi * (d3f / s - 2 * df * d2f * d2f / (s * s)));
+
+      // v0 cos(psi0) in x and v0 sin(psi0) in y
+      add(P, P, (l_x * v0 * cos_psi + l_y * v0 * sin_psi) * dt);
+      add(V, P, (l_x * sin_psi - l_y * cos_psi) * dt);
+
+      // v0 delta0 in psi and epsi
+      add(D, V, (l_psi + l_epsi) / Lf * dt);
+
+      // v0 sin(epsi0) in cte
+      add(E, V, -l_cte * cos_epsi * dt);
+      add(E, E, l_cte * v0 * sin_epsi * dt);
+    }
+  }
+
+ private:
+  // Cost weights, reference speed and timestep
+  const MPC_Config config_;
+
+  // Reference polynomial
+  typedef Eigen::Matrix<double, n_coeffs, 1> Coeffs;
+  Coeffs coeffs_;
+};
+
+#endif /* MPC_DERIVATIVES_H */
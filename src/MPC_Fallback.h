@@ -0,0 +1,173 @@
+#ifndef MPC_FALLBACK_H
+#define MPC_FALLBACK_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "MPC_Config.h"
+#include "MPC_Model.h"
+#include "Polynomial.h"
+#include "SolveStats.h"
+
+using namespace std;
+
+// Actuations for a cycle whose solve gave nothing usable, see
+// ActuationSource.
+//
+// Pure pursuit steers toward a point on the reference line ahead of the
+// car and slows down for the curve there. It feeds back the current
+// state, which the last plan doesn't: that plan front-loads its steering
+// because the model turns harder than the car does, and in mpc_sim
+// following it for a step after every fifth solve already leaves the
+// track where pure pursuit finishes the laps. So the plan, shifted one
+// step per failed solve, is only used when the reference line isn't a
+// number. Every fallback costs a short rollout of the model.
+template <size_t N>
+class MPC_Fallback {
+ public:
+  typedef MPC_Layout<N> Layout;
+
+  explicit MPC_Fallback(const MPC_Config& config)
+      : config_(config), plan_step_(N - 1) {}
+
+  // Remembers the actuations of a plan whose first step was just used
+  template <class Vector>
+  void Keep(const Vector& x) {
+    for (size_t t = 0; t < N - 1; t++) {
+      plan_delta_[t] = x[Layout::delta_start + t];
+      plan_a_[t] = x[Layout::a_start + t];
+    }
+    plan_step_ = 0;
+  }
+
+  // Forgets the plan
+  void Reset() { plan_step_ = N - 1; }
+
+  // Whether every variable of a solution is a number
+  template <class Vector>
+  static bool Finite(const Vector& x) {
+    for (size_t i = 0; i < Layout::n_vars; i++) {
+      if (!std::isfinite(x[i])) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Writes the first actuations and the predicted path, like
+  // MPC_Horizon::Extract, and returns which fallback produced them
+  ActuationSource Actuate(const Eigen::VectorXd& state,
+                          const Eigen::VectorXd& coeffs,
+                          vector<double>& solved) {
+    // The plan moves on with time whichever fallback is used
+    plan_step_ = min(plan_step_ + 1, N - 1);
+    double delta, a;
+    if (PurePursuit(state, coeffs, delta, a)) {
+      Rollout(state, &delta, &a, 1, solved);
+      return PURE_PURSUIT;
+    }
+    if (plan_step_ < N - 1) {
+      Rollout(state, plan_delta_ + plan_step_, plan_a_ + plan_step_,
+              N - 1 - plan_step_, solved);
+      return SHIFTED_PLAN;
+    }
+    delta = 0.0;
+    a = -max_a;
+    Rollout(state, &delta, &a, 1, solved);
+    return STOPPING;
+  }
+
+ private:
+  // Look ahead this many seconds of travel, but at least min_lookahead
+  static constexpr double lookahead_time = 0.3;
+  static constexpr double min_lookahead = 5.0;
+
+  // Throttle per unit of speed below the target speed
+  static constexpr double speed_gain = 0.1;
+
+  // Largest speed squared times curvature of the reference line the
+  // target speed allows
+  static constexpr double max_lateral = 100;
+
+  // False if the state or reference line isn't a number
+  bool PurePursuit(const Eigen::VectorXd& state,
+                   const Eigen::VectorXd& coeffs, double& delta,
+                   double& a) const {
+    const double px = state[0];
+    const double py = state[1];
+    const double psi = state[2];
+    const double v = state[3];
+
+    // The reference line is a function of x in vehicle coordinates, so
+    // the target is taken that far ahead along x
+    double lookahead = max(min_lookahead, fabs(v) * lookahead_time);
+    double dx = lookahead;
+    double dy = polyeval(coeffs, px + dx) - py;
+    double alpha = atan2(dy, dx) - psi;
+
+    // Steering angle of the arc through the target. delta is Lf times the
+    // steering angle, see Pipeline::Run, and turns right when positive.
+    double curvature = 2 * sin(alpha) / sqrt(dx * dx + dy * dy);
+    delta = -Lf * atan(curvature * Lf);
+
+    // Slow down for the bend of the reference line at the target
+    double f[3];
+    polyderivs(coeffs, px + dx, f, 2);
+    double slope = 1 + f[1] * f[1];
+    double bend = fabs(f[2]) / (slope * sqrt(slope));
+    double target_v = min(config_.ref_v, sqrt(max_lateral / max(bend, 1e-6)));
+    a = speed_gain * (target_v - v);
+    if (!std::isfinite(delta) || !std::isfinite(a)) {
+      return false;
+    }
+    delta = max(-max_delta, min(max_delta, delta));
+    a = max(-max_a, min(max_a, a));
+    return true;
+  }
+
+  // Simulates the model from state with count actuations, holding the
+  // last one to the end of the horizon. A state that isn't a number is
+  // replaced by the car standing at the origin, so the predicted path
+  // can still be sent.
+  void Rollout(const Eigen::VectorXd& state, const double* delta,
+               const double* a, size_t count, vector<double>& solved) const {
+    bool finite = state.allFinite();
+    double x = finite ? state[0] : 0.0;
+    double y = finite ? state[1] : 0.0;
+    double psi = finite ? state[2] : 0.0;
+    double v = finite ? state[3] : 0.0;
+    solved.clear();
+    solved.push_back(delta[0]);
+    solved.push_back(a[0]);
+    solved.push_back(x);
+    solved.push_back(y);
+    const double dt = config_.dt;
+    for (size_t t = 1; t < N; t++) {
+      size_t k = min(t - 1, count - 1);
+      double next_psi = psi - v * delta[k] / Lf * dt;
+      x += v * cos(psi) * dt;
+      y += v * sin(psi) * dt;
+      psi = next_psi;
+      v += a[k] * dt;
+      solved.push_back(x);
+      solved.push_back(y);
+    }
+  }
+
+  // Timestep, reference speed
+  const MPC_Config config_;
+
+  // Actuations of the last usable plan, and the step of it the last
+  // actuation came from. N - 1 once it is used up.
+  double plan_delta_[N - 1];
+  double plan_a_[N - 1];
+  size_t plan_step_;
+};
+
+template <size_t N> constexpr double MPC_Fallback<N>::lookahead_time;
+template <size_t N> constexpr double MPC_Fallback<N>::min_lookahead;
+template <size_t N> constexpr double MPC_Fallback<N>::speed_gain;
+template <size_t N> constexpr double MPC_Fallback<N>::max_lateral;
+
+#endif /* MPC_FALLBACK_H */
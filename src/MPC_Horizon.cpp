@@ -0,0 +1,259 @@
+#include "MPC_Horizon.h"
+#include <chrono>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include "ThreadPool.h"
+
+// MUMPS, the linear solver Ipopt is normally built with, keeps global
+// state and isn't safe to call from several threads at once. Everything
+// else in a solve is per instance, so only the Ipopt call is serialized.
+// MA27 keeps its settings in Fortran COMMON blocks and needs the same,
+// MA57, MA86, MA97 and Pardiso only use per instance state.
+static mutex ipopt_mutex;
+
+static bool NeedsIpoptLock(LinearSolver solver) {
+  switch (solver) {
+    case MA57_SOLVER:
+    case MA86_SOLVER:
+    case MA97_SOLVER:
+    case PARDISO_SOLVER:
+      return false;
+    default:
+      return true;
+  }
+}
+
+// Deadlines past this many seconds don't fit a steady_clock duration and
+// count as none
+static bool HasDeadline(double seconds) { return seconds < 1e6; }
+
+template <size_t N>
+MPC_Horizon<N>::MPC_Horizon(const MPC_Config& config)
+    : solved_once_(false),
+      setup_reported_(false),
+      lock_ipopt_(NeedsIpoptLock(config.linear_solver)),
+      has_deadline_(HasDeadline(config.deadline)),
+      deadline_(has_deadline_
+                    ? chrono::duration_cast<chrono::steady_clock::duration>(
+                          chrono::duration<double>(config.deadline))
+                    : chrono::steady_clock::duration::zero()),
+      sqp_(config),
+      fallback_(config) {
+  nlp_ = new MPC_NLP<N>(config);
+  tnlp_ = nlp_;
+
+  app_ = IpoptApplicationFactory();
+
+  //
+  // NOTE: You don't have to worry about these options
+  //
+  // options for IPOPT solver
+  // Uncomment this if you'd like more print information
+  app_->Options()->SetIntegerValue("print_level", 0);
+  app_->Options()->SetStringValue("sb", "yes");
+  app_->Options()->SetNumericValue("max_cpu_time", config.max_cpu_time);
+  app_->Options()->SetNumericValue("tol", config.tol);
+  app_->Options()->SetIntegerValue("max_iter", config.max_iter);
+  if (config.linear_solver != DEFAULT_SOLVER &&
+      config.linear_solver != RICCATI_SOLVER) {
+    app_->Options()->SetStringValue("linear_solver",
+                                    LinearSolverName(config.linear_solver));
+  }
+  app_->Initialize();
+}
+
+template <size_t N>
+MPC_Horizon<N>::~MPC_Horizon() {}
+
+template <size_t N>
+void MPC_Horizon<N>::SetWarmStart(bool enable) {
+  nlp_->SetWarmStart(enable);
+}
+
+template <size_t N>
+void MPC_Horizon<N>::Reset() {
+  nlp_->Reset();
+  sqp_.Reset();
+  fallback_.Reset();
+}
+
+template <size_t N>
+bool MPC_Horizon<N>::SolveIpopt(const Eigen::VectorXd& state,
+                                const Eigen::VectorXd& coeffs,
+                                SolveStats& stats, vector<double>& solved) {
+  // The tape and sparsity patterns are built once, charge them to the
+  // first solve so they show up in the stats
+  if (!setup_reported_) {
+    stats.taping_us = nlp_->taping_us();
+    stats.sparsity_us = nlp_->sparsity_us();
+    setup_reported_ = true;
+  }
+
+  // Push the new state and waypoints into the already recorded problem
+  nlp_->SetProblem(state, coeffs);
+
+  // Only ask Ipopt to warm start when there is a previous solution,
+  // otherwise it would expect multipliers we don't have.
+  // The small pushes keep Ipopt from moving the starting point away
+  // from the bounds, and a small mu_init keeps it close to the solution.
+  if (nlp_->HasWarmStart()) {
+    app_->Options()->SetStringValue("warm_start_init_point", "yes");
+    app_->Options()->SetNumericValue("warm_start_bound_push", 1e-6);
+    app_->Options()->SetNumericValue("warm_start_bound_frac", 1e-6);
+    app_->Options()->SetNumericValue("warm_start_slack_bound_push", 1e-6);
+    app_->Options()->SetNumericValue("warm_start_slack_bound_frac", 1e-6);
+    app_->Options()->SetNumericValue("warm_start_mult_bound_push", 1e-6);
+    app_->Options()->SetNumericValue("mu_init", 1e-6);
+  } else {
+    app_->Options()->SetStringValue("warm_start_init_point", "no");
+    app_->Options()->SetNumericValue("mu_init", 0.1);
+  }
+
+  // solve the problem
+  // After the first call the problem structure is known to Ipopt, so
+  // ReOptimizeTNLP skips re-analysing it.
+  Ipopt::ApplicationReturnStatus status;
+  auto start = chrono::steady_clock::now();
+  {
+    unique_lock<mutex> lock(ipopt_mutex, defer_lock);
+    if (lock_ipopt_) {
+      lock.lock();
+    }
+
+    // The deadline counts from here, so a solve that queued behind others
+    // for the lock (SolveBatch, the offline tools) still gets all of it
+    if (has_deadline_) {
+      nlp_->SetDeadline(chrono::steady_clock::now() + deadline_);
+    }
+    if (solved_once_) {
+      status = app_->ReOptimizeTNLP(tnlp_);
+    } else {
+      status = app_->OptimizeTNLP(tnlp_);
+      solved_once_ = true;
+    }
+  }
+  stats.solve_us = ElapsedMicros(start);
+
+  // Statistics are only available when Ipopt got as far as iterating
+  Ipopt::SmartPtr<Ipopt::SolveStatistics> ipopt_stats = app_->Statistics();
+  if (Ipopt::IsValid(ipopt_stats)) {
+    Ipopt::Number dual_inf, constr_viol, complementarity, kkt_error;
+    ipopt_stats->Infeasibilities(dual_inf, constr_viol, complementarity,
+                                 kkt_error);
+    stats.iterations = ipopt_stats->IterationCount();
+    stats.constraint_violation = constr_viol;
+  }
+  stats.status = status;
+  // A solve stopped at Ipopt's acceptable level converged too, and is
+  // kept to warm start from like one that met tol
+  stats.ok = status == Ipopt::Solve_Succeeded ||
+             status == Ipopt::Solved_To_Acceptable_Level;
+  stats.deadline_hit = nlp_->deadline_hit();
+  stats.objective = nlp_->obj_value();
+
+  start = chrono::steady_clock::now();
+  Actuate(nlp_->solution(), stats.ok || nlp_->best_iterate(), state, coeffs,
+          stats, solved);
+  stats.extraction_us = ElapsedMicros(start);
+  return stats.ok;
+}
+
+template <size_t N>
+bool MPC_Horizon<N>::SolveSQP(const Eigen::VectorXd& state,
+                              const Eigen::VectorXd& coeffs,
+                              SolveStats& stats, vector<double>& solved) {
+  auto start = chrono::steady_clock::now();
+  sqp_.Solve(state, coeffs);
+  stats.solve_us = ElapsedMicros(start);
+
+  // The states come from simulating the model, so the dynamics hold
+  // exactly and the actuations are clipped to their bounds. A plan that
+  // ran out of active set iterations is still feasible, only not optimal.
+  stats.iterations = sqp_.qp_iterations();
+  stats.ok = sqp_.converged();
+  stats.status = stats.ok ? Ipopt::Solve_Succeeded
+                          : Ipopt::Maximum_Iterations_Exceeded;
+  stats.constraint_violation = 0.0;
+  stats.objective = sqp_.obj_value();
+
+  start = chrono::steady_clock::now();
+  Actuate(sqp_.solution(), true, state, coeffs, stats, solved);
+  stats.extraction_us = ElapsedMicros(start);
+  return stats.ok;
+}
+
+template <size_t N>
+template <class Vector>
+void MPC_Horizon<N>::Extract(const Vector& x, vector<double>& solved) {
+  // Return the first actuator values, along with predicted x and y values to plot in the simulator.
+  solved.clear();
+  solved.push_back(x[Layout::delta_start]);
+  solved.push_back(x[Layout::a_start]);
+  for (size_t i = 0; i < N; ++i) {
+    solved.push_back(x[Layout::x_start + i]);
+    solved.push_back(x[Layout::y_start + i]);
+  }
+}
+
+template <size_t N>
+template <class Vector>
+void MPC_Horizon<N>::Actuate(const Vector& x, bool usable,
+                             const Eigen::VectorXd& state,
+                             const Eigen::VectorXd& coeffs, SolveStats& stats,
+                             vector<double>& solved) {
+  if (usable && fallback_.Finite(x)) {
+    Extract(x, solved);
+    fallback_.Keep(x);
+    stats.source = stats.ok ? SOLVER_PLAN : BEST_ITERATE;
+  } else {
+    stats.source = fallback_.Actuate(state, coeffs, solved);
+  }
+}
+
+bool CheckHorizon(const MPC_Config& config, string& error) {
+  if (config.N != 10 && config.N != 15 && config.N != 20 && config.N != 25) {
+    error = "Unsupported MPC horizon N = " + to_string(config.N);
+    return false;
+  }
+  if (config.derivatives == COMPILED_DERIVATIVES) {
+    const MPC_KernelSet* kernels = FindKernels(config.N);
+    if (!kernels || !SameProblem(kernels->config, config)) {
+      error = "No compiled derivatives for N = " + to_string(config.N) +
+              " with these cost weights, rerun mpc_codegen";
+      return false;
+    }
+  }
+  return true;
+}
+
+MPC_HorizonBase* MakeHorizon(const MPC_Config& config) {
+  switch (config.N) {
+    case 10:
+      return new MPC_Horizon<10>(config);
+    case 15:
+      return new MPC_Horizon<15>(config);
+    case 20:
+      return new MPC_Horizon<20>(config);
+    case 25:
+      return new MPC_Horizon<25>(config);
+    default:
+      throw std::invalid_argument("Unsupported MPC horizon N = " +
+                                  std::to_string(config.N));
+  }
+}
+
+static bool InParallel() { return ThreadPool::InParallel(); }
+
+static size_t ThreadNumber() { return ThreadPool::ThreadNumber(); }
+
+void SetupParallelAD(size_t num_workers) {
+  static once_flag once;
+  call_once(once, [num_workers] {
+    // Thread 0 is everything outside the pool
+    size_t num_threads = num_workers + 1;
+    CppAD::thread_alloc::parallel_setup(num_threads, InParallel, ThreadNumber);
+    CppAD::thread_alloc::hold_memory(true);
+    CppAD::parallel_ad<double>();
+  });
+}
@@ -0,0 +1,123 @@
+#ifndef MPC_HORIZON_H
+#define MPC_HORIZON_H
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <coin/IpIpoptApplication.hpp>
+#include "Eigen-3.3/Eigen/Core"
+#include "MPC_Config.h"
+#include "MPC_Fallback.h"
+#include "MPC_NLP.h"
+#include "MPC_SQP.h"
+#include "SolveStats.h"
+
+using namespace std;
+
+// The solvers for one horizon length.
+//
+// Everything below this is sized at compile time for N. MPC only sees the
+// base class, so the horizon can still be picked at startup.
+class MPC_HorizonBase {
+ public:
+  virtual ~MPC_HorizonBase() {}
+
+  virtual size_t horizon() const = 0;
+
+  virtual void SetWarmStart(bool enable) = 0;
+
+  // Forget the previous solutions, so the next solve of either backend
+  // starts cold
+  virtual void Reset() = 0;
+
+  // Solve with Ipopt or with the SQP backend. Both write the first
+  // actuations followed by the predicted x and y values into `solved`,
+  // fill in everything in `stats` except total_us and return whether
+  // the solver converged. `solved` is filled in either way, from a
+  // fallback if the solver gave nothing usable; stats.source says which.
+  virtual bool SolveIpopt(const Eigen::VectorXd& state,
+                          const Eigen::VectorXd& coeffs, SolveStats& stats,
+                          vector<double>& solved) = 0;
+  virtual bool SolveSQP(const Eigen::VectorXd& state,
+                        const Eigen::VectorXd& coeffs, SolveStats& stats,
+                        vector<double>& solved) = 0;
+};
+
+template <size_t N>
+class MPC_Horizon : public MPC_HorizonBase {
+ public:
+  typedef MPC_Layout<N> Layout;
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  explicit MPC_Horizon(const MPC_Config& config);
+
+  virtual ~MPC_Horizon();
+
+  virtual size_t horizon() const { return N; }
+
+  virtual void SetWarmStart(bool enable);
+
+  virtual void Reset();
+
+  virtual bool SolveIpopt(const Eigen::VectorXd& state,
+                          const Eigen::VectorXd& coeffs, SolveStats& stats,
+                          vector<double>& solved);
+  virtual bool SolveSQP(const Eigen::VectorXd& state,
+                        const Eigen::VectorXd& coeffs, SolveStats& stats,
+                        vector<double>& solved);
+
+ private:
+  // Copies the first actuations and the predicted path out of a solution
+  template <class Vector>
+  static void Extract(const Vector& x, vector<double>& solved);
+
+  // Extracts x if the solver gave a usable plan, otherwise asks
+  // fallback_, and sets stats.source
+  template <class Vector>
+  void Actuate(const Vector& x, bool usable, const Eigen::VectorXd& state,
+               const Eigen::VectorXd& coeffs, SolveStats& stats,
+               vector<double>& solved);
+
+  // The problem is taped once and kept alive between solves, so the
+  // AD recording and sparsity patterns are reused by every call.
+  MPC_NLP<N>* nlp_;
+  Ipopt::SmartPtr<Ipopt::TNLP> tnlp_;
+  Ipopt::SmartPtr<Ipopt::IpoptApplication> app_;
+  bool solved_once_;
+
+  // Whether the taping and sparsity times have been reported yet
+  bool setup_reported_;
+
+  // Whether Ipopt's linear solver has to be kept to one thread at a time
+  const bool lock_ipopt_;
+
+  // Wall time budget of an Ipopt solve, MPC_Config::deadline, if it has
+  // one
+  const bool has_deadline_;
+  const chrono::steady_clock::duration deadline_;
+
+  // Condensed QP based backend, warm starts itself from its last plan
+  MPC_SQP<N> sqp_;
+
+  // Actuations when neither backend gave a usable plan
+  MPC_Fallback<N> fallback_;
+};
+
+// Creates the solvers for horizon config.N.
+// Throws std::invalid_argument unless N is 10, 15, 20 or 25.
+MPC_HorizonBase* MakeHorizon(const MPC_Config& config);
+
+// Whether MakeHorizon would accept config: N is one of the horizons above
+// and, for compiled derivatives, kernels were generated for the same
+// problem. Records no tape, so any thread can call it. Otherwise returns
+// false with error set.
+bool CheckHorizon(const MPC_Config& config, string& error);
+
+// Tells CppAD how to find the thread number of a ThreadPool worker so
+// that every thread gets its own AD memory pool. Has to run before the
+// first tape is recorded; only the first call does anything.
+// num_workers is the largest ThreadPool that will solve problems.
+void SetupParallelAD(size_t num_workers);
+
+#endif /* MPC_HORIZON_H */
@@ -0,0 +1,55 @@
+#ifndef MPC_KERNELS_H
+#define MPC_KERNELS_H
+
+#include <cstddef>
+#include "MPC_Config.h"
+
+// Compiled derivatives of the MPC problem for one horizon.
+//
+// The functions are straight-line code that mpc_codegen generates from
+// FG_eval at build time, see codegen.cpp. x is in the MPC_Layout order and
+// c holds the polynomial coefficients. Jacobian rows are numbered like the
+// constraints (without the cost row of FG_eval), and the Hessian of the
+// Lagrangian is given as its lower triangle.
+struct MPC_KernelSet {
+  size_t N;
+
+  // Settings the kernels were generated for. The cost weights, reference
+  // speed and timestep are compiled in.
+  MPC_Config config;
+
+  // Sparsity patterns
+  size_t jac_nnz;
+  const int* jac_rows;
+  const int* jac_cols;
+  size_t hes_nnz;
+  const int* hes_rows;
+  const int* hes_cols;
+
+  double (*cost)(const double* x, const double* c);
+  void (*cost_gradient)(const double* x, const double* c, double* grad);
+  void (*constraints)(const double* x, const double* c, double* g);
+  void (*jacobian)(const double* x, const double* c, double* values);
+  void (*hessian)(const double* x, const double* c, double obj_factor,
+                  const double* lambda, double* values);
+};
+
+// Kernels for horizon N, null if none were generated
+const MPC_KernelSet* FindKernels(size_t N);
+
+// Whether kernels generated for `generated` solve the problem of `config`
+inline bool SameProblem(const MPC_Config& generated,
+                        const MPC_Config& config) {
+  return generated.N == config.N && generated.dt == config.dt &&
+         generated.ref_v == config.ref_v &&
+         generated.cte_cost_weight == config.cte_cost_weight &&
+         generated.epsi_cost_weight == config.epsi_cost_weight &&
+         generated.v_cost_weight == config.v_cost_weight &&
+         generated.delta_cost_weight == config.delta_cost_weight &&
+         generated.a_cost_weight == config.a_cost_weight &&
+         generated.delta_change_cost_weight ==
+             config.delta_change_cost_weight &&
+         generated.a_change_cost_weight == config.a_change_cost_weight;
+}
+
+#endif /* MPC_KERNELS_H */
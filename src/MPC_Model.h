@@ -0,0 +1,69 @@
+#ifndef MPC_MODEL_H
+#define MPC_MODEL_H
+
+#include <cstddef>
+
+// Vehicle model constants and the layout of the solver variables.
+// The tunable parts of the problem are in MPC_Config.h.
+
+// This value assumes the model presented in the classroom is used.
+//
+// It was obtained by measuring the radius formed by running the vehicle in the
+// simulator around in a circle with a constant steering angle and velocity on a
+// flat terrain.
+//
+// Lf was tuned until the the radius formed by the simulating the model
+// presented in the classroom matched the previous radius.
+//
+// This is the length from front to CoG that has a similar radius.
+const double Lf = 2.67;
+
+// Actuator limits, delta is -25 to 25 degrees (values in radians)
+const double max_delta = 0.436332;
+const double max_a = 1.0;
+
+// Number of polynomial coefficients (3rd-order fit)
+const size_t n_coeffs = 4;
+
+// The solver takes all the state variables and actuator
+// variables in a singular vector. Thus, we should to establish
+// when one variable starts and another ends to make our lifes easier.
+//
+// The horizon is a template parameter so all of these are compile time
+// constants. The solvers are instantiated for N = 10, 15, 20 and 25.
+template <size_t N>
+struct MPC_Layout {
+  // State [x, y, psi, v, cte, epsi] and actuator [delta, a] sizes
+  static constexpr size_t NX = 6;
+  static constexpr size_t NU = 2;
+
+  static constexpr size_t x_start = 0;
+  static constexpr size_t y_start = x_start + N;
+  static constexpr size_t psi_start = y_start + N;
+  static constexpr size_t v_start = psi_start + N;
+  static constexpr size_t cte_start = v_start + N;
+  static constexpr size_t epsi_start = cte_start + N;
+  static constexpr size_t delta_start = epsi_start + N;
+  static constexpr size_t a_start = delta_start + N - 1;
+
+  // Setting the number of model variables (includes both states and inputs).
+  // N * state vector size + (N - 1) * 2 actuators (For steering & acceleration)
+  static constexpr size_t n_vars = N * NX + (N - 1) * NU;
+  // Setting the number of constraints
+  static constexpr size_t n_constraints = N * NX;
+};
+
+template <size_t N> constexpr size_t MPC_Layout<N>::NX;
+template <size_t N> constexpr size_t MPC_Layout<N>::NU;
+template <size_t N> constexpr size_t MPC_Layout<N>::x_start;
+template <size_t N> constexpr size_t MPC_Layout<N>::y_start;
+template <size_t N> constexpr size_t MPC_Layout<N>::psi_start;
+template <size_t N> constexpr size_t MPC_Layout<N>::v_start;
+template <size_t N> constexpr size_t MPC_Layout<N>::cte_start;
+template <size_t N> constexpr size_t MPC_Layout<N>::epsi_start;
+template <size_t N> constexpr size_t MPC_Layout<N>::delta_start;
+template <size_t N> constexpr size_t MPC_Layout<N>::a_start;
+template <size_t N> constexpr size_t MPC_Layout<N>::n_vars;
+template <size_t N> constexpr size_t MPC_Layout<N>::n_constraints;
+
+#endif /* MPC_MODEL_H */
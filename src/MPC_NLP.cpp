@@ -0,0 +1,624 @@
+#include "MPC_NLP.h"
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <coin/IpIpoptCalculatedQuantities.hpp>
+#include <coin/IpIpoptData.hpp>
+#include <coin/IpOrigIpoptNLP.hpp>
+#include <coin/IpTNLPAdapter.hpp>
+#include "FG_eval.h"
+#include "Polynomial.h"
+#include "SolveStats.h"
+
+using Ipopt::Index;
+using Ipopt::Number;
+
+// Largest constraint violation of an iterate that still counts as
+// feasible. The model constraints are equalities, so Ipopt's iterates
+// only satisfy them up to roughly this much before it converges.
+static const double feasible_violation = 1e-4;
+
+template <size_t N>
+MPC_NLP<N>::MPC_NLP(const MPC_Config& config)
+    : config_(config),
+      analytic_(config),
+      kernels_(nullptr),
+      taping_us_(0),
+      sparsity_us_(0),
+      state_(Eigen::VectorXd::Zero(6)),
+      x_(Layout::n_vars),
+      fg_(1 + Layout::n_constraints),
+      w_(1 + Layout::n_constraints),
+      x_sol_(Layout::n_vars),
+      obj_value_(0.0),
+      status_(Ipopt::UNASSIGNED),
+      deadline_(chrono::steady_clock::time_point::max()),
+      deadline_hit_(false),
+      have_best_(false),
+      best_iterate_(false),
+      best_obj_(0.0),
+      x_best_(Layout::n_vars),
+      warm_start_(false),
+      have_prev_(false),
+      x_prev_(Layout::n_vars),
+      z_L_prev_(Layout::n_vars),
+      z_U_prev_(Layout::n_vars),
+      lambda_prev_(Layout::n_constraints),
+      x_init_(Layout::n_vars),
+      z_L_init_(Layout::n_vars),
+      z_U_init_(Layout::n_vars),
+      lambda_init_(Layout::n_constraints) {
+  switch (config_.derivatives) {
+    case ANALYTIC_DERIVATIVES:
+      SetupAnalytic();
+      break;
+    case COMPILED_DERIVATIVES:
+      SetupCompiled();
+      break;
+    default:
+      SetupTape();
+      break;
+  }
+}
+
+template <size_t N>
+void MPC_NLP<N>::SetupTape() {
+  auto start = chrono::steady_clock::now();
+  typedef typename FG_eval<N>::ADvector ADvector;
+  const size_t n = Layout::n_vars;
+  const size_t m = 1 + Layout::n_constraints;
+
+  // Record FG_eval once. The operation sequence doesn't depend on the
+  // values used here, so zeros are as good as anything.
+  ADvector avars(n);
+  for (size_t i = 0; i < n; i++) {
+    avars[i] = 0.0;
+  }
+  ADvector acoeffs(n_coeffs);
+  for (size_t i = 0; i < n_coeffs; i++) {
+    acoeffs[i] = 0.0;
+  }
+
+  size_t abort_op_index = 0;
+  bool record_compare = false;
+  CppAD::Independent(avars, abort_op_index, record_compare, acoeffs);
+  ADvector afg(m);
+  FG_eval<N> fg_eval(acoeffs, config_);
+  fg_eval(afg, avars);
+  fg_fun_.Dependent(avars, afg);
+  fg_fun_.optimize();
+  taping_us_ = ElapsedMicros(start);
+  start = chrono::steady_clock::now();
+
+  // Jacobian sparsity of [cost, constraints] w.r.t. vars
+  CppAD::sparse_rc<Svector> identity(n, n, n);
+  for (size_t k = 0; k < n; k++) {
+    identity.set(k, k, k);
+  }
+  fg_fun_.for_jac_sparsity(identity, false, false, false, jac_pattern_);
+
+  // Ipopt only wants the constraint rows, the cost gradient is dense
+  // enough that a single reverse sweep is cheaper.
+  size_t nnz_jac = 0;
+  for (size_t k = 0; k < jac_pattern_.nnz(); k++) {
+    if (jac_pattern_.row()[k] > 0) {
+      nnz_jac++;
+    }
+  }
+  CppAD::sparse_rc<Svector> jac_rows(m, n, nnz_jac);
+  size_t ell = 0;
+  for (size_t k = 0; k < jac_pattern_.nnz(); k++) {
+    if (jac_pattern_.row()[k] > 0) {
+      jac_rows.set(ell++, jac_pattern_.row()[k], jac_pattern_.col()[k]);
+    }
+  }
+  jac_subset_ = CppAD::sparse_rcv<Svector, Dvector>(jac_rows);
+
+  // Hessian sparsity of the weighted sum of all fg components
+  CPPAD_TESTVECTOR(bool) select_domain(n);
+  CPPAD_TESTVECTOR(bool) select_range(m);
+  for (size_t j = 0; j < n; j++) {
+    select_domain[j] = true;
+  }
+  for (size_t i = 0; i < m; i++) {
+    select_range[i] = true;
+  }
+  fg_fun_.for_hes_sparsity(select_domain, select_range, false, hes_pattern_);
+
+  // Ipopt wants the lower triangle only
+  size_t nnz_hes = 0;
+  for (size_t k = 0; k < hes_pattern_.nnz(); k++) {
+    if (hes_pattern_.row()[k] >= hes_pattern_.col()[k]) {
+      nnz_hes++;
+    }
+  }
+  CppAD::sparse_rc<Svector> hes_lower(n, n, nnz_hes);
+  ell = 0;
+  for (size_t k = 0; k < hes_pattern_.nnz(); k++) {
+    if (hes_pattern_.row()[k] >= hes_pattern_.col()[k]) {
+      hes_lower.set(ell++, hes_pattern_.row()[k], hes_pattern_.col()[k]);
+    }
+  }
+  hes_subset_ = CppAD::sparse_rcv<Svector, Dvector>(hes_lower);
+  sparsity_us_ = ElapsedMicros(start);
+}
+
+template <size_t N>
+void MPC_NLP<N>::SetupAnalytic() {
+  auto start = chrono::steady_clock::now();
+  const size_t n = Layout::n_vars;
+
+  // The callbacks come in the same order for any x, so one pass at zero
+  // gives the patterns
+  vector<double> zeros(max(n, size_t(Layout::n_constraints)), 0.0);
+  analytic_.ConstraintJacobian(zeros.data(),
+                               [this](size_t row, size_t col, double) {
+                                 jac_rows_.push_back(row);
+                                 jac_cols_.push_back(col);
+                               });
+
+  // Terms of the Hessian can land on the same entry, give each position
+  // one entry and remember where it is
+  hes_index_.assign(n * n, -1);
+  analytic_.LagrangianHessian(
+      zeros.data(), 0.0, zeros.data(), [this](size_t row, size_t col, double) {
+        int& index = hes_index_[row * Layout::n_vars + col];
+        if (index < 0) {
+          index = hes_rows_.size();
+          hes_rows_.push_back(row);
+          hes_cols_.push_back(col);
+        }
+      });
+  sparsity_us_ = ElapsedMicros(start);
+}
+
+template <size_t N>
+void MPC_NLP<N>::SetupCompiled() {
+  kernels_ = FindKernels(N);
+  if (!kernels_ || !SameProblem(kernels_->config, config_)) {
+    throw std::invalid_argument(
+        "No compiled derivatives for N = " + std::to_string(N) +
+        " with these cost weights, rerun mpc_codegen");
+  }
+  for (size_t i = 0; i < n_coeffs; i++) {
+    coeffs_[i] = 0;
+  }
+}
+
+template <size_t N>
+MPC_NLP<N>::~MPC_NLP() {}
+
+template <size_t N>
+void MPC_NLP<N>::SetProblem(const Eigen::VectorXd& state,
+                            const Eigen::VectorXd& coeffs) {
+  assert(state.size() == 6);
+  assert(coeffs.size() == n_coeffs);
+  state_ = state;
+
+  if (config_.derivatives == ANALYTIC_DERIVATIVES) {
+    analytic_.SetCoeffs(coeffs);
+  } else if (config_.derivatives == COMPILED_DERIVATIVES) {
+    for (size_t i = 0; i < n_coeffs; i++) {
+      coeffs_[i] = coeffs[i];
+    }
+  } else {
+    Dvector p(n_coeffs);
+    for (size_t i = 0; i < n_coeffs; i++) {
+      p[i] = coeffs[i];
+    }
+    fg_fun_.new_dynamic(p);
+  }
+
+  if (HasWarmStart()) {
+    ShiftPrevious(coeffs);
+  }
+
+  deadline_ = chrono::steady_clock::time_point::max();
+  deadline_hit_ = false;
+  have_best_ = false;
+}
+
+// Shift one block of N values (or N - 1 for actuators) forward one step,
+// repeating the last value to fill the end of the horizon.
+template <class Vector>
+static void ShiftBlock(const Vector& from, Vector& to, size_t start,
+                       size_t len) {
+  for (size_t t = 0; t + 1 < len; t++) {
+    to[start + t] = from[start + t + 1];
+  }
+  to[start + len - 1] = from[start + len - 1];
+}
+
+template <size_t N>
+void MPC_NLP<N>::ShiftPrevious(const Eigen::VectorXd& coeffs) {
+  const size_t state_starts[] = {Layout::x_start,   Layout::y_start,
+                                 Layout::psi_start, Layout::v_start,
+                                 Layout::cte_start, Layout::epsi_start};
+
+  // Actuators and all multipliers are simply shifted one step.
+  ShiftBlock(x_prev_, x_init_, Layout::delta_start, N - 1);
+  ShiftBlock(x_prev_, x_init_, Layout::a_start, N - 1);
+  ShiftBlock(z_L_prev_, z_L_init_, Layout::delta_start, N - 1);
+  ShiftBlock(z_L_prev_, z_L_init_, Layout::a_start, N - 1);
+  ShiftBlock(z_U_prev_, z_U_init_, Layout::delta_start, N - 1);
+  ShiftBlock(z_U_prev_, z_U_init_, Layout::a_start, N - 1);
+  for (size_t s = 0; s < 6; s++) {
+    ShiftBlock(z_L_prev_, z_L_init_, state_starts[s], N);
+    ShiftBlock(z_U_prev_, z_U_init_, state_starts[s], N);
+    ShiftBlock(lambda_prev_, lambda_init_, state_starts[s], N);
+  }
+
+  // The states can't be shifted the same way, since main.cpp moves them
+  // into the vehicle's frame every message. Instead roll the model out
+  // from the new initial state with the shifted actuators, which also
+  // makes the starting point satisfy the model constraints.
+  x_init_[Layout::x_start] = state_[0];
+  x_init_[Layout::y_start] = state_[1];
+  x_init_[Layout::psi_start] = state_[2];
+  x_init_[Layout::v_start] = state_[3];
+  x_init_[Layout::cte_start] = state_[4];
+  x_init_[Layout::epsi_start] = state_[5];
+  const double dt = config_.dt;
+  for (size_t t = 1; t < N; t++) {
+    double x0 = x_init_[Layout::x_start + t - 1];
+    double y0 = x_init_[Layout::y_start + t - 1];
+    double psi0 = x_init_[Layout::psi_start + t - 1];
+    double v0 = x_init_[Layout::v_start + t - 1];
+    double epsi0 = x_init_[Layout::epsi_start + t - 1];
+    double delta0 = x_init_[Layout::delta_start + t - 1];
+    double a0 = x_init_[Layout::a_start + t - 1];
+
+    double df0;
+    double f0 = polyeval(coeffs, x0, df0);
+    double psi_des0 = atan(df0);
+
+    x_init_[Layout::x_start + t] = x0 + v0 * cos(psi0) * dt;
+    x_init_[Layout::y_start + t] = y0 + v0 * sin(psi0) * dt;
+    x_init_[Layout::psi_start + t] = psi0 - v0 * delta0 / Lf * dt;
+    x_init_[Layout::v_start + t] = v0 + a0 * dt;
+    x_init_[Layout::cte_start + t] = (f0 - y0) + v0 * sin(epsi0) * dt;
+    x_init_[Layout::epsi_start + t] =
+        (psi0 - psi_des0) - v0 * delta0 / Lf * dt;
+  }
+}
+
+template <size_t N>
+void MPC_NLP<N>::Forward0(const Number* x) {
+  for (size_t i = 0; i < Layout::n_vars; i++) {
+    x_[i] = x[i];
+  }
+  fg_ = fg_fun_.Forward(0, x_);
+}
+
+template <size_t N>
+bool MPC_NLP<N>::get_nlp_info(Index& n, Index& m, Index& nnz_jac_g,
+                              Index& nnz_h_lag, IndexStyleEnum& index_style) {
+  n = Layout::n_vars;
+  m = Layout::n_constraints;
+  if (config_.derivatives == ANALYTIC_DERIVATIVES) {
+    nnz_jac_g = jac_rows_.size();
+    nnz_h_lag = hes_rows_.size();
+  } else if (config_.derivatives == COMPILED_DERIVATIVES) {
+    nnz_jac_g = kernels_->jac_nnz;
+    nnz_h_lag = kernels_->hes_nnz;
+  } else {
+    nnz_jac_g = jac_subset_.nnz();
+    nnz_h_lag = hes_subset_.nnz();
+  }
+  index_style = C_STYLE;
+  return true;
+}
+
+template <size_t N>
+bool MPC_NLP<N>::get_bounds_info(Index n, Number* x_l, Number* x_u, Index m,
+                                 Number* g_l, Number* g_u) {
+  // Sets lower and upper limits for variables.
+  // Set all non-actuators upper and lowerlimits
+  // to the max negative and positive values.
+  for (size_t i = 0; i < Layout::delta_start; i++) {
+    x_l[i] = -1.0e19;
+    x_u[i] = 1.0e19;
+  }
+
+  // The upper and lower limits of delta are set to -25 and 25
+  // degrees (values in radians).
+  for (size_t i = Layout::delta_start; i < Layout::a_start; i++) {
+    x_l[i] = -max_delta;
+    x_u[i] = max_delta;
+  }
+
+  // Acceleration/decceleration upper and lower limits.
+  for (size_t i = Layout::a_start; i < Layout::n_vars; i++) {
+    x_l[i] = -max_a;
+    x_u[i] = max_a;
+  }
+
+  // Lower and upper limits for the constraints
+  // Should be 0 besides initial state.
+  for (size_t i = 0; i < Layout::n_constraints; i++) {
+    g_l[i] = 0;
+    g_u[i] = 0;
+  }
+
+  // Start lower and upper limits at current values
+  g_l[Layout::x_start] = g_u[Layout::x_start] = state_[0];
+  g_l[Layout::y_start] = g_u[Layout::y_start] = state_[1];
+  g_l[Layout::psi_start] = g_u[Layout::psi_start] = state_[2];
+  g_l[Layout::v_start] = g_u[Layout::v_start] = state_[3];
+  g_l[Layout::cte_start] = g_u[Layout::cte_start] = state_[4];
+  g_l[Layout::epsi_start] = g_u[Layout::epsi_start] = state_[5];
+  return true;
+}
+
+template <size_t N>
+bool MPC_NLP<N>::get_starting_point(Index n, bool init_x, Number* x,
+                                    bool init_z, Number* z_L, Number* z_U,
+                                    Index m, bool init_lambda,
+                                    Number* lambda) {
+  if (HasWarmStart()) {
+    // Shifted previous solution, see ShiftPrevious
+    for (Index j = 0; j < n; j++) {
+      if (init_x) x[j] = x_init_[j];
+      if (init_z) z_L[j] = z_L_init_[j];
+      if (init_z) z_U[j] = z_U_init_[j];
+    }
+    if (init_lambda) {
+      for (Index i = 0; i < m; i++) {
+        lambda[i] = lambda_init_[i];
+      }
+    }
+    return true;
+  }
+
+  // Without a previous solution there are no multipliers to give
+  if (init_z || init_lambda) {
+    return false;
+  }
+
+  // Initial value of the independent variables.
+  // SHOULD BE 0 besides initial state.
+  for (Index i = 0; i < n; i++) {
+    x[i] = 0.0;
+  }
+  return true;
+}
+
+template <size_t N>
+bool MPC_NLP<N>::eval_f(Index n, const Number* x, bool new_x,
+                        Number& obj_value) {
+  if (config_.derivatives == ANALYTIC_DERIVATIVES) {
+    obj_value = analytic_.Cost(x);
+    return true;
+  }
+  if (config_.derivatives == COMPILED_DERIVATIVES) {
+    obj_value = kernels_->cost(x, coeffs_);
+    return true;
+  }
+  if (new_x) {
+    Forward0(x);
+  }
+  obj_value = fg_[0];
+  return true;
+}
+
+template <size_t N>
+bool MPC_NLP<N>::eval_grad_f(Index n, const Number* x, bool new_x,
+                             Number* grad_f) {
+  if (config_.derivatives == ANALYTIC_DERIVATIVES) {
+    analytic_.CostGradient(x, grad_f);
+    return true;
+  }
+  if (config_.derivatives == COMPILED_DERIVATIVES) {
+    kernels_->cost_gradient(x, coeffs_, grad_f);
+    return true;
+  }
+  if (new_x) {
+    Forward0(x);
+  }
+  for (size_t i = 0; i < w_.size(); i++) {
+    w_[i] = 0.0;
+  }
+  w_[0] = 1.0;
+  Dvector dw = fg_fun_.Reverse(1, w_);
+  for (Index j = 0; j < n; j++) {
+    grad_f[j] = dw[j];
+  }
+  return true;
+}
+
+template <size_t N>
+bool MPC_NLP<N>::eval_g(Index n, const Number* x, bool new_x, Index m,
+                        Number* g) {
+  if (config_.derivatives == ANALYTIC_DERIVATIVES) {
+    analytic_.Constraints(x, g);
+    return true;
+  }
+  if (config_.derivatives == COMPILED_DERIVATIVES) {
+    kernels_->constraints(x, coeffs_, g);
+    return true;
+  }
+  if (new_x) {
+    Forward0(x);
+  }
+  for (Index i = 0; i < m; i++) {
+    g[i] = fg_[1 + i];
+  }
+  return true;
+}
+
+template <size_t N>
+bool MPC_NLP<N>::eval_jac_g(Index n, const Number* x, bool new_x, Index m,
+                            Index nele_jac, Index* iRow, Index* jCol,
+                            Number* values) {
+  if (config_.derivatives == ANALYTIC_DERIVATIVES) {
+    if (values == NULL) {
+      copy(jac_rows_.begin(), jac_rows_.end(), iRow);
+      copy(jac_cols_.begin(), jac_cols_.end(), jCol);
+    } else {
+      Index k = 0;
+      analytic_.ConstraintJacobian(
+          x, [values, &k](size_t, size_t, double value) {
+            values[k++] = value;
+          });
+    }
+    return true;
+  }
+  if (config_.derivatives == COMPILED_DERIVATIVES) {
+    if (values == NULL) {
+      copy(kernels_->jac_rows, kernels_->jac_rows + nele_jac, iRow);
+      copy(kernels_->jac_cols, kernels_->jac_cols + nele_jac, jCol);
+    } else {
+      kernels_->jacobian(x, coeffs_, values);
+    }
+    return true;
+  }
+  if (values == NULL) {
+    // Row 0 of the tape is the cost, so shift everything up by one
+    for (Index k = 0; k < nele_jac; k++) {
+      iRow[k] = jac_subset_.row()[k] - 1;
+      jCol[k] = jac_subset_.col()[k];
+    }
+    return true;
+  }
+
+  if (new_x) {
+    Forward0(x);
+  }
+  size_t group_max = 1;
+  fg_fun_.sparse_jac_for(group_max, x_, jac_subset_, jac_pattern_, "cppad",
+                         jac_work_);
+  for (Index k = 0; k < nele_jac; k++) {
+    values[k] = jac_subset_.val()[k];
+  }
+  return true;
+}
+
+template <size_t N>
+bool MPC_NLP<N>::eval_h(Index n, const Number* x, bool new_x, Number obj_factor,
+                        Index m, const Number* lambda, bool new_lambda,
+                        Index nele_hess, Index* iRow, Index* jCol,
+                        Number* values) {
+  if (config_.derivatives == ANALYTIC_DERIVATIVES) {
+    if (values == NULL) {
+      copy(hes_rows_.begin(), hes_rows_.end(), iRow);
+      copy(hes_cols_.begin(), hes_cols_.end(), jCol);
+    } else {
+      fill(values, values + nele_hess, 0.0);
+      const int* index = hes_index_.data();
+      analytic_.LagrangianHessian(
+          x, obj_factor, lambda,
+          [values, index](size_t row, size_t col, double value) {
+            values[index[row * Layout::n_vars + col]] += value;
+          });
+    }
+    return true;
+  }
+  if (config_.derivatives == COMPILED_DERIVATIVES) {
+    if (values == NULL) {
+      copy(kernels_->hes_rows, kernels_->hes_rows + nele_hess, iRow);
+      copy(kernels_->hes_cols, kernels_->hes_cols + nele_hess, jCol);
+    } else {
+      kernels_->hessian(x, coeffs_, obj_factor, lambda, values);
+    }
+    return true;
+  }
+  if (values == NULL) {
+    for (Index k = 0; k < nele_hess; k++) {
+      iRow[k] = hes_subset_.row()[k];
+      jCol[k] = hes_subset_.col()[k];
+    }
+    return true;
+  }
+
+  if (new_x) {
+    Forward0(x);
+  }
+  w_[0] = obj_factor;
+  for (Index i = 0; i < m; i++) {
+    w_[1 + i] = lambda[i];
+  }
+  fg_fun_.sparse_hes(x_, w_, hes_subset_, hes_pattern_, "cppad.symmetric",
+                     hes_work_);
+  for (Index k = 0; k < nele_hess; k++) {
+    values[k] = hes_subset_.val()[k];
+  }
+  return true;
+}
+
+template <size_t N>
+void MPC_NLP<N>::finalize_solution(Ipopt::SolverReturn status, Index n,
+                                   const Number* x, const Number* z_L,
+                                   const Number* z_U, Index m, const Number* g,
+                                   const Number* lambda, Number obj_value,
+                                   const Ipopt::IpoptData* ip_data,
+                                   Ipopt::IpoptCalculatedQuantities* ip_cq) {
+  for (Index j = 0; j < n; j++) {
+    x_sol_[j] = x[j];
+  }
+  obj_value_ = obj_value;
+  status_ = status;
+
+  // Where Ipopt stopped may be anywhere, the best feasible iterate at
+  // least drives along the model
+  best_iterate_ = status != Ipopt::SUCCESS &&
+                  status != Ipopt::STOP_AT_ACCEPTABLE_POINT && have_best_;
+  if (best_iterate_) {
+    x_sol_ = x_best_;
+    obj_value_ = best_obj_;
+  }
+
+  // Only keep converged solutions around to warm start from
+  have_prev_ = status == Ipopt::SUCCESS ||
+               status == Ipopt::STOP_AT_ACCEPTABLE_POINT;
+  if (have_prev_) {
+    for (Index j = 0; j < n; j++) {
+      x_prev_[j] = x[j];
+      z_L_prev_[j] = z_L[j];
+      z_U_prev_[j] = z_U[j];
+    }
+    for (Index i = 0; i < m; i++) {
+      lambda_prev_[i] = lambda[i];
+    }
+  }
+}
+
+template <size_t N>
+bool MPC_NLP<N>::intermediate_callback(
+    Ipopt::AlgorithmMode mode, Index iter, Number obj_value, Number inf_pr,
+    Number inf_du, Number mu, Number d_norm, Number regularization_size,
+    Number alpha_du, Number alpha_pr, Index ls_trials,
+    const Ipopt::IpoptData* ip_data, Ipopt::IpoptCalculatedQuantities* ip_cq) {
+  // Restoration phase iterates belong to a different problem. inf_pr may
+  // be scaled, so feasibility is checked on the unscaled constraints.
+  if (mode == Ipopt::RegularMode && (!have_best_ || obj_value < best_obj_) &&
+      ip_cq->unscaled_curr_nlp_constraint_violation(Ipopt::NORM_MAX) <=
+          feasible_violation) {
+    // The iterate is only available in Ipopt's internal ordering, the
+    // TNLP adapter maps it back to ours
+    Ipopt::OrigIpoptNLP* orig_nlp = dynamic_cast<Ipopt::OrigIpoptNLP*>(
+        Ipopt::GetRawPtr(ip_cq->GetIpoptNLP()));
+    Ipopt::TNLPAdapter* adapter =
+        orig_nlp ? dynamic_cast<Ipopt::TNLPAdapter*>(
+                       Ipopt::GetRawPtr(orig_nlp->nlp()))
+                 : nullptr;
+    if (adapter) {
+      adapter->ResortX(*ip_data->curr()->x(), x_best_.data());
+      best_obj_ = obj_value;
+      have_best_ = true;
+    }
+  }
+
+  if (chrono::steady_clock::now() >= deadline_) {
+    deadline_hit_ = true;
+    return false;
+  }
+  return true;
+}
+
+// The horizons MPC can be constructed with
+template class MPC_NLP<10>;
+template class MPC_NLP<15>;
+template class MPC_NLP<20>;
+template class MPC_NLP<25>;
@@ -0,0 +1,209 @@
+#ifndef MPC_NLP_H
+#define MPC_NLP_H
+
+#include <chrono>
+#include <vector>
+#include <cppad/cppad.hpp>
+#include <coin/IpTNLP.hpp>
+#include "Eigen-3.3/Eigen/Core"
+#include "MPC_Config.h"
+#include "MPC_Derivatives.h"
+#include "MPC_Kernels.h"
+#include "MPC_Model.h"
+
+using namespace std;
+
+// The MPC optimization problem in the form Ipopt wants it.
+//
+// CppAD::ipopt::solve re-records FG_eval and recomputes all sparsity
+// patterns each time it is called. Here the tape is recorded once, in the
+// constructor, with the polynomial coefficients as dynamic parameters.
+// The Jacobian/Hessian sparsity patterns and their colorings are kept in
+// the work objects below, so a solve only pays for the derivative sweeps.
+//
+// With config.derivatives == ANALYTIC_DERIVATIVES nothing is taped, all
+// evaluations go to the closed forms of MPC_Derivatives instead, and with
+// COMPILED_DERIVATIVES to the generated kernels of MPC_Kernels.h. The
+// kernels have the cost weights, reference speed and timestep compiled
+// in, so the constructor throws std::invalid_argument if config differs
+// from what they were generated for.
+template <size_t N>
+class MPC_NLP : public Ipopt::TNLP {
+ public:
+  typedef CPPAD_TESTVECTOR(double) Dvector;
+  typedef CPPAD_TESTVECTOR(size_t) Svector;
+  typedef MPC_Layout<N> Layout;
+
+  // analytic_ holds a fixed-size Eigen vector
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  explicit MPC_NLP(const MPC_Config& config);
+
+  virtual ~MPC_NLP();
+
+  // Set the initial state and polynomial coefficients for the next solve.
+  // The state only enters through the constraint bounds, so only the
+  // coefficients have to be pushed into the tape.
+  void SetProblem(const Eigen::VectorXd& state, const Eigen::VectorXd& coeffs);
+
+  // When enabled, SetProblem seeds the next solve from the last solution
+  // shifted forward by one timestep, along with its multipliers.
+  void SetWarmStart(bool enable) { warm_start_ = enable; }
+
+  // Whether the next solve has a warm start point to use.
+  // Only true once a previous solve converged.
+  bool HasWarmStart() const { return warm_start_ && have_prev_; }
+
+  // Forget the last solution, the next solve starts cold
+  void Reset() { have_prev_ = false; }
+
+  // Makes the next solve stop at the first iteration that ends after
+  // deadline. Call after SetProblem.
+  void SetDeadline(chrono::steady_clock::time_point deadline) {
+    deadline_ = deadline;
+  }
+
+  // Results of the last solve. When Ipopt stopped without converging,
+  // the solution is the feasible iterate with the lowest cost it went
+  // through, if there was one; best_iterate() says so.
+  const Dvector& solution() const { return x_sol_; }
+  double obj_value() const { return obj_value_; }
+  Ipopt::SolverReturn status() const { return status_; }
+  bool deadline_hit() const { return deadline_hit_; }
+  bool best_iterate() const { return best_iterate_; }
+
+  // Time the constructor spent recording the tape and computing the
+  // sparsity patterns, in microseconds. No taping for analytic
+  // derivatives.
+  double taping_us() const { return taping_us_; }
+  double sparsity_us() const { return sparsity_us_; }
+
+  // Ipopt::TNLP interface
+  virtual bool get_nlp_info(Ipopt::Index& n, Ipopt::Index& m,
+                            Ipopt::Index& nnz_jac_g, Ipopt::Index& nnz_h_lag,
+                            IndexStyleEnum& index_style);
+
+  virtual bool get_bounds_info(Ipopt::Index n, Ipopt::Number* x_l,
+                               Ipopt::Number* x_u, Ipopt::Index m,
+                               Ipopt::Number* g_l, Ipopt::Number* g_u);
+
+  virtual bool get_starting_point(Ipopt::Index n, bool init_x,
+                                  Ipopt::Number* x, bool init_z,
+                                  Ipopt::Number* z_L, Ipopt::Number* z_U,
+                                  Ipopt::Index m, bool init_lambda,
+                                  Ipopt::Number* lambda);
+
+  virtual bool eval_f(Ipopt::Index n, const Ipopt::Number* x, bool new_x,
+                      Ipopt::Number& obj_value);
+
+  virtual bool eval_grad_f(Ipopt::Index n, const Ipopt::Number* x, bool new_x,
+                           Ipopt::Number* grad_f);
+
+  virtual bool eval_g(Ipopt::Index n, const Ipopt::Number* x, bool new_x,
+                      Ipopt::Index m, Ipopt::Number* g);
+
+  virtual bool eval_jac_g(Ipopt::Index n, const Ipopt::Number* x, bool new_x,
+                          Ipopt::Index m, Ipopt::Index nele_jac,
+                          Ipopt::Index* iRow, Ipopt::Index* jCol,
+                          Ipopt::Number* values);
+
+  virtual bool eval_h(Ipopt::Index n, const Ipopt::Number* x, bool new_x,
+                      Ipopt::Number obj_factor, Ipopt::Index m,
+                      const Ipopt::Number* lambda, bool new_lambda,
+                      Ipopt::Index nele_hess, Ipopt::Index* iRow,
+                      Ipopt::Index* jCol, Ipopt::Number* values);
+
+  virtual void finalize_solution(Ipopt::SolverReturn status, Ipopt::Index n,
+                                 const Ipopt::Number* x,
+                                 const Ipopt::Number* z_L,
+                                 const Ipopt::Number* z_U, Ipopt::Index m,
+                                 const Ipopt::Number* g,
+                                 const Ipopt::Number* lambda,
+                                 Ipopt::Number obj_value,
+                                 const Ipopt::IpoptData* ip_data,
+                                 Ipopt::IpoptCalculatedQuantities* ip_cq);
+
+  // Keeps the best feasible iterate and enforces the deadline
+  virtual bool intermediate_callback(
+      Ipopt::AlgorithmMode mode, Ipopt::Index iter, Ipopt::Number obj_value,
+      Ipopt::Number inf_pr, Ipopt::Number inf_du, Ipopt::Number mu,
+      Ipopt::Number d_norm, Ipopt::Number regularization_size,
+      Ipopt::Number alpha_du, Ipopt::Number alpha_pr, Ipopt::Index ls_trials,
+      const Ipopt::IpoptData* ip_data,
+      Ipopt::IpoptCalculatedQuantities* ip_cq);
+
+ private:
+  // Records the tape and its sparsity patterns
+  void SetupTape();
+
+  // Records the sparsity patterns of the analytic derivatives
+  void SetupAnalytic();
+
+  // Looks up the compiled kernels for N and config
+  void SetupCompiled();
+
+  // Zero order forward sweep at x, caches fg = [cost, constraints]
+  void Forward0(const Ipopt::Number* x);
+
+  // Builds the warm start point from the previous solution
+  void ShiftPrevious(const Eigen::VectorXd& coeffs);
+
+  // Settings the tape was recorded with
+  const MPC_Config config_;
+
+  // Taped FG_eval: vars -> [cost, constraints], coeffs are dynamic parameters
+  CppAD::ADFun<double> fg_fun_;
+
+  // Jacobian of the constraints (rows 1.. of fg_fun_)
+  CppAD::sparse_rc<Svector> jac_pattern_;
+  CppAD::sparse_rcv<Svector, Dvector> jac_subset_;
+  CppAD::sparse_jac_work jac_work_;
+
+  // Lower triangle of the Hessian of the Lagrangian
+  CppAD::sparse_rc<Svector> hes_pattern_;
+  CppAD::sparse_rcv<Svector, Dvector> hes_subset_;
+  CppAD::sparse_hes_work hes_work_;
+
+  // Closed form derivatives, and where their terms go in Ipopt's sparse
+  // Jacobian and Hessian. hes_index_ maps row * n_vars + col to an entry.
+  MPC_Derivatives<N> analytic_;
+  vector<Ipopt::Index> jac_rows_, jac_cols_;
+  vector<Ipopt::Index> hes_rows_, hes_cols_;
+  vector<int> hes_index_;
+
+  // Compiled kernels, and the coefficients to call them with
+  const MPC_KernelSet* kernels_;
+  double coeffs_[n_coeffs];
+
+  // Setup cost, see taping_us()
+  double taping_us_;
+  double sparsity_us_;
+
+  // Current problem data
+  Eigen::VectorXd state_;
+  Dvector x_;
+  Dvector fg_;
+  Dvector w_;
+
+  // Results of the last solve
+  Dvector x_sol_;
+  double obj_value_;
+  Ipopt::SolverReturn status_;
+
+  // Deadline of the current solve and the best feasible iterate so far
+  chrono::steady_clock::time_point deadline_;
+  bool deadline_hit_;
+  bool have_best_;
+  bool best_iterate_;
+  double best_obj_;
+  Dvector x_best_;
+
+  // Warm start data. The *_prev_ vectors hold the last converged primal
+  // and dual solution, the *_init_ vectors the shifted starting point.
+  bool warm_start_;
+  bool have_prev_;
+  Dvector x_prev_, z_L_prev_, z_U_prev_, lambda_prev_;
+  Dvector x_init_, z_L_init_, z_U_init_, lambda_init_;
+};
+
+#endif /* MPC_NLP_H */
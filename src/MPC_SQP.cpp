@@ -0,0 +1,496 @@
+#include "MPC_SQP.h"
+#include <cmath>
+#include "Eigen-3.3/Eigen/LU"
+#include "Polynomial.h"
+
+// Without a previous plan to start from a single iteration is a poor
+// approximation, so a cold start iterates a few more times.
+static const int cold_start_iterations = 5;
+
+// Tolerance for deciding an actuation sits on its bound
+static const double bound_tol = 1e-12;
+
+template <size_t N>
+MPC_SQP<N>::MPC_SQP(const MPC_Config& config)
+    : config_(config),
+      u_(InputVector::Zero()),
+      xs_(Eigen::Matrix<double, Layout::NX, N>::Zero()),
+      R_(InputMatrix::Zero()),
+      G_(Eigen::Matrix<double, Layout::NX * N, NU>::Zero()),
+      riccati_(config.linear_solver == RICCATI_SOLVER),
+      riccati_dirty_(N - 2),
+      vars_(VarsVector::Zero()),
+      obj_value_(0.0),
+      qp_iterations_(0),
+      converged_(false),
+      have_prev_(false) {
+  // The actuator costs don't depend on the linearization point,
+  // so their quadratic form is built once.
+  for (size_t t = 0; t < N - 1; t++) {
+    R_(2 * t, 2 * t) += config_.delta_cost_weight;
+    R_(2 * t + 1, 2 * t + 1) += config_.a_cost_weight;
+  }
+  for (size_t t = 0; t < N - 2; t++) {
+    const double w[2] = {config_.delta_change_cost_weight,
+                         config_.a_change_cost_weight};
+    for (int j = 0; j < 2; j++) {
+      int i0 = 2 * t + j;
+      int i1 = 2 * (t + 1) + j;
+      R_(i0, i0) += w[j];
+      R_(i1, i1) += w[j];
+      R_(i0, i1) -= w[j];
+      R_(i1, i0) -= w[j];
+    }
+  }
+}
+
+template <size_t N>
+MPC_SQP<N>::~MPC_SQP() {}
+
+template <size_t N>
+void MPC_SQP<N>::Solve(const Eigen::VectorXd& state,
+                       const Eigen::VectorXd& coeffs) {
+  int iterations = 1;
+  if (have_prev_) {
+    // Shift the previous plan forward one step, repeating the last actuation
+    for (size_t t = 0; t < N - 2; t++) {
+      u_.template segment<2>(2 * t) = u_.template segment<2>(2 * t + 2);
+    }
+  } else {
+    u_.setZero();
+    iterations = cold_start_iterations;
+  }
+
+  qp_iterations_ = 0;
+  converged_ = true;
+  for (int i = 0; i < iterations; i++) {
+    Rollout(state, coeffs);
+    Linearize(coeffs);
+    converged_ &= SolveQP();
+    u_ += du_;
+
+    // Keep rounding from pushing actuations past their limits
+    for (size_t t = 0; t < N - 1; t++) {
+      u_[2 * t] = std::min(std::max(u_[2 * t], -max_delta), max_delta);
+      u_[2 * t + 1] = std::min(std::max(u_[2 * t + 1], -max_a), max_a);
+    }
+  }
+
+  // The predicted states come from the nonlinear model, not the QP
+  Rollout(state, coeffs);
+  obj_value_ = Cost();
+  have_prev_ = true;
+
+  for (size_t t = 0; t < N; t++) {
+    vars_[Layout::x_start + t] = xs_(0, t);
+    vars_[Layout::y_start + t] = xs_(1, t);
+    vars_[Layout::psi_start + t] = xs_(2, t);
+    vars_[Layout::v_start + t] = xs_(3, t);
+    vars_[Layout::cte_start + t] = xs_(4, t);
+    vars_[Layout::epsi_start + t] = xs_(5, t);
+  }
+  for (size_t t = 0; t < N - 1; t++) {
+    vars_[Layout::delta_start + t] = u_[2 * t];
+    vars_[Layout::a_start + t] = u_[2 * t + 1];
+  }
+}
+
+template <size_t N>
+void MPC_SQP<N>::Rollout(const Eigen::VectorXd& state,
+                         const Eigen::VectorXd& coeffs) {
+  const double dt = config_.dt;
+  xs_.col(0) = state;
+  for (size_t t = 0; t < N - 1; t++) {
+    double x0 = xs_(0, t);
+    double y0 = xs_(1, t);
+    double psi0 = xs_(2, t);
+    double v0 = xs_(3, t);
+    double epsi0 = xs_(5, t);
+    double delta0 = u_[2 * t];
+    double a0 = u_[2 * t + 1];
+
+    double df0;
+    double f0 = polyeval(coeffs, x0, df0);
+    double psi_des0 = atan(df0);
+
+    xs_(0, t + 1) = x0 + v0 * cos(psi0) * dt;
+    xs_(1, t + 1) = y0 + v0 * sin(psi0) * dt;
+    xs_(2, t + 1) = psi0 - v0 * delta0 / Lf * dt;
+    xs_(3, t + 1) = v0 + a0 * dt;
+    xs_(4, t + 1) = (f0 - y0) + v0 * sin(epsi0) * dt;
+    xs_(5, t + 1) = (psi0 - psi_des0) - v0 * delta0 / Lf * dt;
+  }
+}
+
+template <size_t N>
+void MPC_SQP<N>::Linearize(const Eigen::VectorXd& coeffs) {
+  const double dt = config_.dt;
+  for (size_t t = 0; t < N - 1; t++) {
+    double x0 = xs_(0, t);
+    double psi0 = xs_(2, t);
+    double v0 = xs_(3, t);
+    double epsi0 = xs_(5, t);
+    double delta0 = u_[2 * t];
+
+    // Slope and curvature of the reference polynomial at x0
+    double f[3];
+    polyderivs(coeffs, x0, f, 2);
+    double df0 = f[1];
+    double ddf0 = f[2];
+
+    // Partial derivatives of the update equations in FG_eval
+    // w.r.t. [x, y, psi, v, cte, epsi] and [delta, a]
+    StateMatrix& A = A_[t];
+    A.setZero();
+    A(0, 0) = 1.0;
+    A(0, 2) = -v0 * sin(psi0) * dt;
+    A(0, 3) = cos(psi0) * dt;
+    A(1, 1) = 1.0;
+    A(1, 2) = v0 * cos(psi0) * dt;
+    A(1, 3) = sin(psi0) * dt;
+    A(2, 2) = 1.0;
+    A(2, 3) = -delta0 / Lf * dt;
+    A(3, 3) = 1.0;
+    A(4, 0) = df0;
+    A(4, 1) = -1.0;
+    A(4, 3) = sin(epsi0) * dt;
+    A(4, 5) = v0 * cos(epsi0) * dt;
+    A(5, 0) = -ddf0 / (1 + df0 * df0);
+    A(5, 2) = 1.0;
+    A(5, 3) = -delta0 / Lf * dt;
+
+    StateInputMatrix& B = B_[t];
+    B.setZero();
+    B(2, 0) = -v0 / Lf * dt;
+    B(3, 1) = dt;
+    B(5, 0) = -v0 / Lf * dt;
+  }
+
+  for (size_t t = 0; t < N - 1; t++) {
+    lb_[2 * t] = -max_delta - u_[2 * t];
+    ub_[2 * t] = max_delta - u_[2 * t];
+    lb_[2 * t + 1] = -max_a - u_[2 * t + 1];
+    ub_[2 * t + 1] = max_a - u_[2 * t + 1];
+  }
+
+  // The Riccati solver works on the stages directly
+  if (riccati_) {
+    for (size_t t = 0; t < N; t++) {
+      StageCost(t, stage_L_[t], stage_l_[t]);
+    }
+    P_[N - 1] = stage_L_[N - 1].template topLeftCorner<NS, NS>();
+    p_stage_[N - 1] = stage_l_[N - 1].template head<NS>();
+    return;
+  }
+
+  // Stage sensitivities: G_{t+1} = A_t G_t + B_t, with G_0 = 0 since the
+  // initial state is fixed.
+  G_.setZero();
+  for (size_t t = 0; t < N - 1; t++) {
+    G_.template middleRows<6>(6 * (t + 1)).noalias() =
+        A_[t] * G_.template middleRows<6>(6 * t);
+    G_.template block<6, 2>(6 * (t + 1), 2 * t) += B_[t];
+  }
+
+  // Quadratic model of the cost in du. The cost is already quadratic in
+  // the states and actuators, so this is exact up to the linearization.
+  H_ = 2 * R_;
+  g_.noalias() = 2 * R_ * u_;
+  const int rows[3] = {4, 5, 3};
+  const double weights[3] = {config_.cte_cost_weight,
+                             config_.epsi_cost_weight, config_.v_cost_weight};
+  const double refs[3] = {0.0, 0.0, config_.ref_v};
+  for (size_t t = 1; t < N; t++) {
+    for (int j = 0; j < 3; j++) {
+      auto Gr = G_.row(6 * t + rows[j]);
+      H_.noalias() += 2 * weights[j] * Gr.transpose() * Gr;
+      g_.noalias() += 2 * weights[j] * (xs_(rows[j], t) - refs[j]) *
+                      Gr.transpose();
+    }
+  }
+}
+
+template <size_t N>
+bool MPC_SQP<N>::SolveQP() {
+  // Primal active-set method. du = 0 is feasible since the current
+  // actuations are within their limits, and any actuation already at a
+  // limit starts out in the active set.
+  du_.setZero();
+  for (int i = 0; i < NU; i++) {
+    if (lb_[i] >= -bound_tol) {
+      active_[i] = -1;
+    } else if (ub_[i] <= bound_tol) {
+      active_[i] = 1;
+    } else {
+      active_[i] = 0;
+    }
+  }
+  ActiveSetChanged(N - 2);
+
+  const int max_iterations = 3 * NU;
+  for (int iter = 0; iter < max_iterations; iter++) {
+    qp_iterations_++;
+
+    // Minimize over the free actuations with the active ones held at their
+    // bounds
+    for (int i = 0; i < NU; i++) {
+      if (active_[i] != 0) {
+        du_[i] = active_[i] < 0 ? lb_[i] : ub_[i];
+      }
+    }
+    if (riccati_) {
+      RiccatiMinimize();
+    } else {
+      MinimizeFree();
+    }
+
+    // Step towards that minimum until the first bound gets in the way
+    double alpha = 1.0;
+    int blocking = -1;
+    int side = 0;
+    for (int i = 0; i < NU; i++) {
+      if (active_[i] != 0) {
+        continue;
+      }
+      double d = p_[i] - du_[i];
+      if (p_[i] < lb_[i] && d < 0) {
+        double a = (lb_[i] - du_[i]) / d;
+        if (a < alpha) {
+          alpha = a;
+          blocking = i;
+          side = -1;
+        }
+      } else if (p_[i] > ub_[i] && d > 0) {
+        double a = (ub_[i] - du_[i]) / d;
+        if (a < alpha) {
+          alpha = a;
+          blocking = i;
+          side = 1;
+        }
+      }
+    }
+    du_ += alpha * (p_ - du_);
+    if (blocking >= 0) {
+      active_[blocking] = side;
+      ActiveSetChanged(blocking / 2);
+      continue;
+    }
+
+    // At the minimum of the current working set. The bound multipliers are
+    // the gradient components of the active actuations, with the sign
+    // flipped for upper bounds. Free the one with the most negative.
+    if (riccati_) {
+      RiccatiGradient();
+    } else {
+      QPGradient();
+    }
+    int worst = -1;
+    double worst_multiplier = -1e-9;
+    for (int i = 0; i < NU; i++) {
+      if (active_[i] == 0) {
+        continue;
+      }
+      double multiplier = active_[i] < 0 ? rhs_[i] : -rhs_[i];
+      if (multiplier < worst_multiplier) {
+        worst_multiplier = multiplier;
+        worst = i;
+      }
+    }
+    if (worst < 0) {
+      return true;
+    }
+    active_[worst] = 0;
+    ActiveSetChanged(worst / 2);
+  }
+  return false;
+}
+
+template <size_t N>
+void MPC_SQP<N>::MinimizeFree() {
+  // The fixed rows/columns are replaced by the identity so the system
+  // keeps its size and stays positive definite.
+  K_ = H_;
+  rhs_ = -g_;
+  for (int i = 0; i < NU; i++) {
+    if (active_[i] != 0) {
+      rhs_.noalias() -= H_.col(i) * du_[i];
+    }
+  }
+  for (int i = 0; i < NU; i++) {
+    if (active_[i] != 0) {
+      K_.row(i).setZero();
+      K_.col(i).setZero();
+      K_(i, i) = 1.0;
+      rhs_[i] = du_[i];
+    }
+  }
+  ldlt_.compute(K_);
+  p_ = ldlt_.solve(rhs_);
+}
+
+template <size_t N>
+void MPC_SQP<N>::QPGradient() {
+  rhs_.noalias() = H_ * du_;
+  rhs_ += g_;
+}
+
+template <size_t N>
+void MPC_SQP<N>::StageCost(size_t t, StageCostMatrix& L,
+                           StageCostVector& l) const {
+  // Stage state s = [dx (0..5), du_{t-1} (6, 7)], then du_t (8, 9).
+  // Every term w (r + d)^2 of the cost, with r its value in the rollout
+  // and d its deviation, adds 2 w to L and 2 w r to l.
+  const int U = NS;
+  L.setZero();
+  l.setZero();
+
+  // cte, epsi and speed from timestep 1 on
+  if (t > 0) {
+    const int rows[3] = {4, 5, 3};
+    const double weights[3] = {config_.cte_cost_weight,
+                               config_.epsi_cost_weight,
+                               config_.v_cost_weight};
+    const double refs[3] = {0.0, 0.0, config_.ref_v};
+    for (int j = 0; j < 3; j++) {
+      L(rows[j], rows[j]) += 2 * weights[j];
+      l[rows[j]] += 2 * weights[j] * (xs_(rows[j], t) - refs[j]);
+    }
+  }
+  if (t == N - 1) {
+    return;
+  }
+
+  // Actuations and their change since the previous timestep
+  const double weights[2] = {config_.delta_cost_weight, config_.a_cost_weight};
+  const double change_weights[2] = {config_.delta_change_cost_weight,
+                                    config_.a_change_cost_weight};
+  for (int c = 0; c < 2; c++) {
+    L(U + c, U + c) += 2 * weights[c];
+    l[U + c] += 2 * weights[c] * u_[2 * t + c];
+    if (t > 0) {
+      const int P = NX + c;
+      double w = 2 * change_weights[c];
+      double change = u_[2 * t + c] - u_[2 * (t - 1) + c];
+      L(U + c, U + c) += w;
+      L(P, P) += w;
+      L(U + c, P) -= w;
+      L(P, U + c) -= w;
+      l[U + c] += w * change;
+      l[P] -= w * change;
+    }
+  }
+}
+
+template <size_t N>
+void MPC_SQP<N>::RiccatiMinimize() {
+  typedef Eigen::Matrix<double, 2, 2> Matrix2;
+  typedef Eigen::Matrix<double, 2, 1> Vector2;
+
+  // Backward from the latest timestep whose feedback changed, the cost to
+  // go of the ones after it still holds
+  for (size_t t = riccati_dirty_ + 1; t-- > 0;) {
+    const StageCostMatrix& L = stage_L_[t];
+    const StageCostVector& l = stage_l_[t];
+    const StageMatrix& P = P_[t + 1];
+    const StageVector& p = p_stage_[t + 1];
+    const StateMatrix& A = A_[t];
+    const StateInputMatrix& B = B_[t];
+
+    // Stage s_{t+1} = F s_t + E du_t with F = [A 0; 0 0] and E = [B; I].
+    // Q = L + [F E]' P [F E], written out for the zero blocks of F.
+    auto Pxx = P.template topLeftCorner<NX, NX>();
+    auto Pux = P.template bottomLeftCorner<2, NX>();
+    Eigen::Matrix<double, 2, NX> EtP = B.transpose() * Pxx + Pux;
+    StageMatrix Qss = L.template topLeftCorner<NS, NS>();
+    Qss.template topLeftCorner<NX, NX>().noalias() +=
+        A.transpose() * Pxx * A;
+    Eigen::Matrix<double, 2, NS>& Qus = Qus_[t];
+    Qus = L.template bottomLeftCorner<2, NS>();
+    Qus.template leftCols<NX>().noalias() += EtP * A;
+    Matrix2& Quu = Quu_[t];
+    Quu = L.template bottomRightCorner<2, 2>();
+    Quu.noalias() += EtP * B + B.transpose() * Pux.transpose();
+    Quu += P.template bottomRightCorner<2, 2>();
+    StageVector qs = l.template head<NS>();
+    qs.template head<NX>().noalias() +=
+        A.transpose() * p.template head<NX>();
+    Vector2& qu = qu_[t];
+    qu = l.template tail<2>();
+    qu.noalias() += B.transpose() * p.template head<NX>();
+    qu += p.template tail<2>();
+
+    // Feedback du_t = K s_t + k minimizing over the free actuations. An
+    // active one is fixed at its value in du_, like in MinimizeFree.
+    Matrix2 S = Quu;
+    Eigen::Matrix<double, 2, NS> K = -Qus;
+    Vector2 k = -qu;
+    for (int c = 0; c < 2; c++) {
+      if (active_[2 * t + c] != 0) {
+        k -= Quu.col(c) * du_[2 * t + c];
+      }
+    }
+    for (int c = 0; c < 2; c++) {
+      if (active_[2 * t + c] != 0) {
+        S.row(c).setZero();
+        S.col(c).setZero();
+        S(c, c) = 1.0;
+        K.row(c).setZero();
+        k[c] = du_[2 * t + c];
+      }
+    }
+    Matrix2 S_inv = S.inverse();
+    K_stage_[t].noalias() = S_inv * K;
+    k_stage_[t].noalias() = S_inv * k;
+
+    // Cost to go from timestep t under that feedback. The free rows of K
+    // and k zero the gradient in du_t and the fixed rows of K are zero,
+    // which leaves these terms of Q.
+    P_[t] = Qss;
+    P_[t].noalias() += Qus.transpose() * K_stage_[t];
+    p_stage_[t] = qs;
+    p_stage_[t].noalias() += Qus.transpose() * k_stage_[t];
+  }
+  riccati_dirty_ = 0;
+
+  // Forward through the stages from the fixed initial state
+  StageVector s = StageVector::Zero();
+  for (size_t t = 0; t < N - 1; t++) {
+    stages_.col(t) = s;
+    Vector2 du = K_stage_[t] * s + k_stage_[t];
+    p_.template segment<2>(2 * t) = du;
+    s.template head<NX>() = A_[t] * s.template head<NX>() + B_[t] * du;
+    s.template tail<2>() = du;
+  }
+}
+
+template <size_t N>
+void MPC_SQP<N>::RiccatiGradient() {
+  // du_ is the forward pass of the last RiccatiMinimize. The free
+  // actuations after timestep t are optimal for its stage state, so they
+  // don't change the gradient in du_t to first order, and the fixed ones
+  // don't move at all. The gradient in du_t is then the one of its Q.
+  for (size_t t = 0; t < N - 1; t++) {
+    rhs_.template segment<2>(2 * t) =
+        Quu_[t] * du_.template segment<2>(2 * t) + Qus_[t] * stages_.col(t) +
+        qu_[t];
+  }
+}
+
+template <size_t N>
+double MPC_SQP<N>::Cost() const {
+  double cost = 0.0;
+  for (size_t t = 0; t < N; t++) {
+    cost += config_.cte_cost_weight * xs_(4, t) * xs_(4, t);
+    cost += config_.epsi_cost_weight * xs_(5, t) * xs_(5, t);
+    cost += config_.v_cost_weight * (xs_(3, t) - config_.ref_v) *
+            (xs_(3, t) - config_.ref_v);
+  }
+  cost += u_.dot(R_ * u_);
+  return cost;
+}
+
+// The horizons MPC can be constructed with
+template class MPC_SQP<10>;
+template class MPC_SQP<15>;
+template class MPC_SQP<20>;
+template class MPC_SQP<25>;
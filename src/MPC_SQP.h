@@ -0,0 +1,181 @@
+#ifndef MPC_SQP_H
+#define MPC_SQP_H
+
+#include <algorithm>
+#include "Eigen-3.3/Eigen/Core"
+#include "Eigen-3.3/Eigen/Cholesky"
+#include "MPC_Config.h"
+#include "MPC_Model.h"
+
+// Real-time iteration SQP for the same problem FG_eval describes.
+//
+// The kinematic model is linearized analytically about the previous plan
+// (shifted by one timestep), the states are condensed out of the QP using
+// the stage sensitivities, and the remaining box constrained QP over the
+// actuators is solved with a small dense active-set method. There is no AD
+// and no general sparse factorization involved, so the cost of a solve is
+// small and close to constant.
+//
+// With config.linear_solver == RICCATI_SOLVER nothing is condensed. The
+// QP keeps its stage structure, a block-banded KKT system, and each
+// active-set step is a backward Riccati recursion and a forward pass, so
+// the work grows linearly with N instead of with NU^3.
+//
+// All storage is fixed-size for the horizon N, so a solve never touches
+// the heap and the per-stage loops have compile time bounds.
+template <size_t N>
+class MPC_SQP {
+ public:
+  typedef MPC_Layout<N> Layout;
+
+  // Number of actuations, two per step
+  static constexpr int NU = Layout::NU * (N - 1);
+
+  typedef Eigen::Matrix<double, Layout::n_vars, 1> VarsVector;
+  typedef Eigen::Matrix<double, NU, 1> InputVector;
+  typedef Eigen::Matrix<double, NU, NU> InputMatrix;
+
+  // Stage state of the Riccati recursion, the state deviation followed
+  // by the previous actuation deviation. The change costs couple
+  // consecutive actuations, carrying the previous one makes every cost
+  // term local to a stage.
+  static constexpr int NX = Layout::NX;
+  static constexpr int NS = Layout::NX + Layout::NU;
+  typedef Eigen::Matrix<double, NX, NX> StateMatrix;
+  typedef Eigen::Matrix<double, NX, Layout::NU> StateInputMatrix;
+  typedef Eigen::Matrix<double, NS, 1> StageVector;
+  typedef Eigen::Matrix<double, NS, NS> StageMatrix;
+  // Stage state and actuation deviation together
+  typedef Eigen::Matrix<double, NS + Layout::NU, 1> StageCostVector;
+  typedef Eigen::Matrix<double, NS + Layout::NU, NS + Layout::NU>
+      StageCostMatrix;
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  explicit MPC_SQP(const MPC_Config& config);
+
+  virtual ~MPC_SQP();
+
+  // Run one SQP iteration (more on a cold start) from the given initial
+  // state and polynomial coefficients.
+  void Solve(const Eigen::VectorXd& state, const Eigen::VectorXd& coeffs);
+
+  // Solution in the same layout as the Ipopt variables (see MPC_Model.h)
+  const VarsVector& solution() const { return vars_; }
+  double obj_value() const { return obj_value_; }
+
+  // Active set iterations used by the QPs of the last solve
+  int qp_iterations() const { return qp_iterations_; }
+
+  // Whether every QP of the last solve reached its optimum
+  bool converged() const { return converged_; }
+
+  // Forget the previous plan, the next solve starts from zero actuations
+  void Reset() { have_prev_ = false; }
+
+ private:
+  // Simulates the model from state with the actuations in u_
+  void Rollout(const Eigen::VectorXd& state, const Eigen::VectorXd& coeffs);
+
+  // Linearizes the model about the current rollout (A_, B_, lb_, ub_)
+  // and, unless solving with Riccati, builds the condensed QP (H_, g_)
+  void Linearize(const Eigen::VectorXd& coeffs);
+
+  // Solves the box constrained QP for du_, returns false if it ran out
+  // of iterations before finding the optimum
+  bool SolveQP();
+
+  // Minimizes the QP over the free actuations, holding the active ones
+  // at the values in du_, into p_
+  void MinimizeFree();
+
+  // Gradient of the QP at du_ into rhs_
+  void QPGradient();
+
+  // Riccati versions of the two above. RiccatiGradient only holds at the
+  // minimum over the free actuations, which is the only place SolveQP
+  // asks for the gradient.
+  void RiccatiMinimize();
+  void RiccatiGradient();
+
+  // The actuations of timestep t moved in or out of the active set
+  void ActiveSetChanged(size_t t) {
+    riccati_dirty_ = std::max(riccati_dirty_, t);
+  }
+
+  // Quadratic model 0.5 v' L v + l' v of the cost terms of stage t,
+  // v = [stage state; actuation deviation]
+  void StageCost(size_t t, StageCostMatrix& L, StageCostVector& l) const;
+
+  // Nonlinear cost of the current rollout, same as fg[0] in FG_eval
+  double Cost() const;
+
+  // Cost weights, reference speed and timestep
+  const MPC_Config config_;
+
+  // Actuations [delta_0, a_0, delta_1, a_1, ...] and the states they
+  // produce, one column per timestep
+  InputVector u_;
+  Eigen::Matrix<double, Layout::NX, N> xs_;
+
+  // Actuator part of the cost, u' R u
+  InputMatrix R_;
+
+  // Model linearized about the rollout, dx_{t+1} = A_t dx_t + B_t du_t
+  StateMatrix A_[N - 1];
+  StateInputMatrix B_[N - 1];
+
+  // Sensitivities of the states to the actuations, rows 6k..6k+5
+  // belong to timestep k
+  Eigen::Matrix<double, Layout::NX * N, NU> G_;
+
+  // Condensed QP: min 0.5 du' H du + g' du  s.t.  lb <= du <= ub
+  InputMatrix H_;
+  InputVector g_;
+  InputVector lb_;
+  InputVector ub_;
+  InputVector du_;
+
+  // Active set: -1 at lower bound, 1 at upper bound, 0 free
+  Eigen::Matrix<int, NU, 1> active_;
+
+  // Scratch space for the active set iterations
+  InputMatrix K_;
+  InputVector rhs_;
+  InputVector p_;
+  Eigen::LDLT<InputMatrix> ldlt_;
+
+  // Riccati solver, used when riccati_ is set. Per timestep t:
+  //   stage_L_, stage_l_  cost model of the stage, see StageCost
+  //   Q*_                 cost to go as a function of s_t and du_t
+  //   P_, p_stage_        cost to go 0.5 s' P s + p' s under the feedback
+  //   K_stage_, k_stage_  feedback du_t = K s_t + k
+  //   stages_             s_t of the last forward pass
+  // Changing the active set of timestep t only invalidates the backward
+  // pass from t down, riccati_dirty_ is the latest timestep to redo.
+  const bool riccati_;
+  StageCostMatrix stage_L_[N];
+  StageCostVector stage_l_[N];
+  Eigen::Matrix<double, Layout::NU, Layout::NU> Quu_[N - 1];
+  Eigen::Matrix<double, Layout::NU, NS> Qus_[N - 1];
+  Eigen::Matrix<double, Layout::NU, 1> qu_[N - 1];
+  StageMatrix P_[N];
+  StageVector p_stage_[N];
+  Eigen::Matrix<double, Layout::NU, NS> K_stage_[N - 1];
+  Eigen::Matrix<double, Layout::NU, 1> k_stage_[N - 1];
+  Eigen::Matrix<double, NS, N> stages_;
+  size_t riccati_dirty_;
+
+  // Result in Ipopt layout
+  VarsVector vars_;
+  double obj_value_;
+  int qp_iterations_;
+  bool converged_;
+  bool have_prev_;
+};
+
+template <size_t N> constexpr int MPC_SQP<N>::NU;
+template <size_t N> constexpr int MPC_SQP<N>::NX;
+template <size_t N> constexpr int MPC_SQP<N>::NS;
+
+#endif /* MPC_SQP_H */
@@ -0,0 +1,351 @@
+#include "MPC_Table.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include "Eigen-3.3/Eigen/Cholesky"
+#include "MPC_Kernels.h"
+#include "MPC_Model.h"
+
+static const char table_magic[8] = {'M', 'P', 'C', 'T', 'A', 'B', 'L', 'E'};
+static const uint32_t table_version = 2;
+
+// Ridge on the slopes of the fit in Lookup, relative to the total weight
+static const double ridge = 1e-3;
+
+// Doubles MPC::Solve returns for a horizon of N
+static size_t SolvedSize(size_t N) { return 2 + 2 * N; }
+
+MPC_Table::MPC_Table()
+    : data_(nullptr),
+      size_(0),
+      header_(nullptr),
+      entries_(nullptr),
+      stride_(0),
+      solved_size_(0) {}
+
+MPC_Table::~MPC_Table() {
+  if (data_) {
+    munmap(const_cast<char*>(data_), size_);
+  }
+}
+
+bool MPC_Table::Open(const string& path, string& error) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    error = "Failed to open " + path;
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(MPC_TableHeader)) {
+    close(fd);
+    error = path + " is not an MPC table";
+    return false;
+  }
+  void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    error = "Failed to map " + path;
+    return false;
+  }
+  data_ = static_cast<const char*>(data);
+  size_ = st.st_size;
+  header_ = reinterpret_cast<const MPC_TableHeader*>(data_);
+  if (memcmp(header_->magic, table_magic, sizeof(table_magic)) != 0 ||
+      header_->version != table_version ||
+      header_->header_size != sizeof(MPC_TableHeader) ||
+      header_->key_size != table_key_size || header_->config.N < 1) {
+    error = path + " is not an MPC table of this version";
+    return false;
+  }
+
+  solved_size_ = SolvedSize(header_->config.N);
+  stride_ = sizeof(MPC_TableEntry) + solved_size_ * sizeof(double);
+  if (header_->entries != (size_ - sizeof(MPC_TableHeader)) / stride_ ||
+      (size_ - sizeof(MPC_TableHeader)) % stride_ != 0) {
+    error = path + " is cut off";
+    return false;
+  }
+  if (!(header_->radius >= 0) || !(header_->tolerance > 0)) {
+    error = path + " has a bad radius or tolerance";
+    return false;
+  }
+  for (size_t d = 0; d < table_key_size; d++) {
+    if (!(header_->scale[d] > 0)) {
+      error = path + " has a bad scale";
+      return false;
+    }
+    inverse_scale_[d] = 1.0 / header_->scale[d];
+  }
+  entries_ = data_ + sizeof(MPC_TableHeader);
+  return true;
+}
+
+bool MPC_Table::Matches(const MPC_Config& config, int32_t backend) const {
+  return SameProblem(header_->config, config) && header_->backend == backend;
+}
+
+bool MPC_Table::MakeKey(const Eigen::VectorXd& state,
+                        const Eigen::VectorXd& coeffs, double* key) {
+  if (state.size() != 6 || coeffs.size() != 4) {
+    return false;
+  }
+  for (size_t i = 0; i < 6; i++) {
+    key[i] = state[i];
+  }
+  for (size_t i = 0; i < 4; i++) {
+    key[6 + i] = coeffs[i];
+  }
+  return true;
+}
+
+bool MPC_Table::Lookup(const Eigen::VectorXd& state,
+                       const Eigen::VectorXd& coeffs, vector<double>& solved,
+                       double& cost) const {
+  double key[table_key_size];
+  if (!MakeKey(state, coeffs, key)) {
+    return false;
+  }
+  Neighbour nearest[table_neighbours];
+  size_t found = 0;
+  Nearest(0, header_->entries, key, nearest, found);
+
+  // A key that isn't a number is never inside the radius
+  double closest = INFINITY;
+  for (size_t k = 0; k < found; k++) {
+    closest = min(closest, nearest[k].distance);
+  }
+  if (!(closest <= header_->radius * header_->radius)) {
+    return false;
+  }
+
+  // Fit solution ~ b0 + b' x by least squares over the neighbours, x the
+  // scaled offset of a record from the key, so the answer at the key is
+  // b0. Weights fall from 1 at the key to 0 at the farthest neighbour,
+  // and a small ridge on b keeps the fit sane when the neighbours don't
+  // spread out in every dimension (x of the state is v times the
+  // latency, y is always 0).
+  typedef Eigen::Matrix<double, table_key_size + 1, 1> Row;
+  typedef Eigen::Matrix<double, table_key_size + 1, table_key_size + 1>
+      Normal;
+  Row rows[table_neighbours];
+  double weights[table_neighbours];
+  double bandwidth = sqrt(nearest[0].distance) * (1 + 1e-9) + 1e-12;
+  double total_weight = 0;
+  Normal normal = Normal::Zero();
+  for (size_t k = 0; k < found; k++) {
+    const MPC_TableEntry& entry = *nearest[k].entry;
+    rows[k][0] = 1;
+    for (size_t d = 0; d < table_key_size; d++) {
+      rows[k][d + 1] = (entry.key[d] - key[d]) * inverse_scale_[d];
+    }
+    double u = sqrt(nearest[k].distance) / bandwidth;
+    double falloff = 1 - u * u * u;
+    weights[k] = falloff * falloff * falloff;
+    total_weight += weights[k];
+    normal.noalias() += weights[k] * rows[k] * rows[k].transpose();
+  }
+  for (size_t d = 1; d <= table_key_size; d++) {
+    normal(d, d) += ridge * total_weight;
+  }
+
+  // The fit to the first steering and throttle, in units of their
+  // limits, has to pass close to every neighbour that counts. Near a
+  // kink of the solution it can't, and b0 is no better than a guess.
+  typedef Eigen::Matrix<double, table_key_size + 1, 2> Fit;
+  Eigen::LDLT<Normal> factor(normal);
+  Fit moments = Fit::Zero();
+  for (size_t k = 0; k < found; k++) {
+    const double* values =
+        reinterpret_cast<const double*>(nearest[k].entry + 1);
+    moments.col(0) += weights[k] * values[0] / max_delta * rows[k];
+    moments.col(1) += weights[k] * values[1] / max_a * rows[k];
+  }
+  Fit fit = factor.solve(moments);
+  double residual[2] = {0, 0};
+  for (size_t k = 0; k < found; k++) {
+    const double* values =
+        reinterpret_cast<const double*>(nearest[k].entry + 1);
+    double steer = values[0] / max_delta - rows[k].dot(fit.col(0));
+    double throttle = values[1] / max_a - rows[k].dot(fit.col(1));
+    residual[0] += weights[k] * steer * steer;
+    residual[1] += weights[k] * throttle * throttle;
+  }
+  double limit = header_->tolerance * header_->tolerance * total_weight;
+  if (!(residual[0] <= limit && residual[1] <= limit)) {
+    return false;
+  }
+
+  // b0 is a weighted sum of the neighbours' solutions, with the weights
+  // of the first row of the inverse normal equations
+  Row first = factor.solve(Row::Unit(0));
+  solved.assign(solved_size_, 0.0);
+  cost = 0;
+  for (size_t k = 0; k < found; k++) {
+    double weight = weights[k] * rows[k].dot(first);
+    const double* values =
+        reinterpret_cast<const double*>(nearest[k].entry + 1);
+    for (size_t i = 0; i < solved_size_; i++) {
+      solved[i] += weight * values[i];
+    }
+    cost += weight * nearest[k].entry->cost;
+  }
+  if (!std::isfinite(solved[0]) || !std::isfinite(solved[1])) {
+    return false;
+  }
+  solved[0] = max(-max_delta, min(max_delta, solved[0]));
+  solved[1] = max(-max_a, min(max_a, solved[1]));
+  return true;
+}
+
+double MPC_Table::Distance(const MPC_TableEntry& entry,
+                           const double* key) const {
+  double distance = 0;
+  for (size_t d = 0; d < table_key_size; d++) {
+    double offset = (key[d] - entry.key[d]) * inverse_scale_[d];
+    distance += offset * offset;
+  }
+  return distance;
+}
+
+void MPC_Table::Nearest(size_t begin, size_t end, const double* key,
+                        Neighbour* nearest, size_t& found) const {
+  while (begin < end) {
+    size_t middle = begin + (end - begin) / 2;
+    const MPC_TableEntry& entry = Entry(middle);
+    Neighbour candidate = {&entry, Distance(entry, key)};
+    if (found < table_neighbours) {
+      nearest[found++] = candidate;
+      push_heap(nearest, nearest + found);
+    } else if (candidate.distance < nearest[0].distance) {
+      pop_heap(nearest, nearest + found);
+      nearest[found - 1] = candidate;
+      push_heap(nearest, nearest + found);
+    }
+
+    // Search the side of the split the key is on first, the other one
+    // only if it can still hold something closer
+    double offset =
+        (key[entry.split] - entry.key[entry.split]) *
+        inverse_scale_[entry.split];
+    if (offset < 0) {
+      Nearest(begin, middle, key, nearest, found);
+      begin = middle + 1;
+    } else {
+      Nearest(middle + 1, end, key, nearest, found);
+      end = middle;
+    }
+    double farthest =
+        found < table_neighbours ? INFINITY : nearest[0].distance;
+    if (!(offset * offset < farthest)) {
+      return;
+    }
+  }
+}
+
+// Puts the median of samples [begin, end) along their widest scaled
+// dimension in the middle, the smaller ones before it and the larger
+// ones after it, and does the same for both halves
+static void Arrange(const vector<MPC_TableSample>& samples,
+                    const double* scale, size_t begin, size_t end,
+                    vector<size_t>& order, vector<uint32_t>& splits) {
+  if (begin >= end) {
+    return;
+  }
+  uint32_t split = 0;
+  double widest = -1;
+  for (uint32_t d = 0; d < table_key_size; d++) {
+    double low = INFINITY;
+    double high = -INFINITY;
+    for (size_t i = begin; i < end; i++) {
+      double value = samples[order[i]].key[d];
+      low = min(low, value);
+      high = max(high, value);
+    }
+    if ((high - low) / scale[d] > widest) {
+      widest = (high - low) / scale[d];
+      split = d;
+    }
+  }
+
+  size_t middle = begin + (end - begin) / 2;
+  nth_element(order.begin() + begin, order.begin() + middle,
+              order.begin() + end, [&](size_t a, size_t b) {
+                return samples[a].key[split] < samples[b].key[split];
+              });
+  splits[middle] = split;
+  Arrange(samples, scale, begin, middle, order, splits);
+  Arrange(samples, scale, middle + 1, end, order, splits);
+}
+
+bool WriteTable(const string& path, const MPC_Config& config,
+                int32_t backend, double radius, double tolerance,
+                vector<MPC_TableSample>& samples, string& error) {
+  const size_t solved_size = SolvedSize(config.N);
+  for (const MPC_TableSample& sample : samples) {
+    if (sample.solved.size() != solved_size) {
+      error = "A sample doesn't have the solution size of N = " +
+              to_string(config.N);
+      return false;
+    }
+  }
+
+  // Value initialized, so the padding is zero too
+  MPC_TableHeader header = MPC_TableHeader();
+  memcpy(header.magic, table_magic, sizeof(header.magic));
+  header.version = table_version;
+  header.header_size = sizeof(header);
+  header.config = config;
+  header.backend = backend;
+  header.key_size = table_key_size;
+  header.entries = samples.size();
+  header.radius = radius;
+  header.tolerance = tolerance;
+
+  // Standard deviation of each dimension. One that doesn't vary (the
+  // y of the predicted state is always 0) gets 1, so a query that
+  // differs there still counts as far.
+  for (size_t d = 0; d < table_key_size; d++) {
+    double sum = 0;
+    double squares = 0;
+    for (const MPC_TableSample& sample : samples) {
+      sum += sample.key[d];
+      squares += sample.key[d] * sample.key[d];
+    }
+    double n = max<size_t>(samples.size(), 1);
+    double variance = squares / n - (sum / n) * (sum / n);
+    header.scale[d] = variance > 1e-12 ? sqrt(variance) : 1.0;
+  }
+
+  vector<size_t> order(samples.size());
+  for (size_t i = 0; i < order.size(); i++) {
+    order[i] = i;
+  }
+  vector<uint32_t> splits(samples.size());
+  Arrange(samples, header.scale, 0, samples.size(), order, splits);
+
+  FILE* file = fopen(path.c_str(), "wb");
+  if (!file) {
+    error = "Failed to create " + path;
+    return false;
+  }
+  fwrite(&header, sizeof(header), 1, file);
+  for (size_t i = 0; i < order.size(); i++) {
+    const MPC_TableSample& sample = samples[order[i]];
+    MPC_TableEntry entry = MPC_TableEntry();
+    entry.split = splits[i];
+    memcpy(entry.key, sample.key, sizeof(entry.key));
+    entry.cost = sample.cost;
+    fwrite(&entry, sizeof(entry), 1, file);
+    fwrite(sample.solved.data(), sizeof(double), solved_size, file);
+  }
+  if (ferror(file) | fclose(file)) {
+    error = "Failed to write " + path;
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,159 @@
+#ifndef MPC_TABLE_H
+#define MPC_TABLE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "MPC_Config.h"
+
+using namespace std;
+
+// Explicit MPC: solutions computed offline (see table.cpp) for a cloud of
+// problems around the usual operating envelope, interpolated instead of
+// solving.
+//
+// A key is everything MPC::Solve gets, the six states followed by the
+// four polynomial coefficients. Distances between keys are measured
+// after dividing each dimension by the header's scale, the spread of
+// that dimension over the table. A problem farther than radius from every
+// record is outside the covered region and goes to the online solver.
+// Inside it the answer is an affine function of the key fitted to the
+// nearest table_neighbours records by weighted least squares. The
+// solution of an MPC is piecewise smooth in its problem, so that is
+// far closer than the nearest record on its own. Where the neighbours
+// straddle a kink (an actuator hitting its limit, a bend coming into
+// view) no affine function fits them, so a lookup whose fit misses the
+// neighbours' first actuations by more than the header's tolerance goes
+// to the online solver too.
+//
+// A table is an MPC_TableHeader followed by `entries` records, each an
+// MPC_TableEntry and the 2 + 2 * N doubles MPC::Solve returns for its
+// problem. The records form an implicit k-d tree: the middle record is
+// the root, splitting on its split dimension, the records before it are
+// its left subtree and the ones after it the right one, and so on down.
+// So nothing is built on loading, the file is only mapped, and a lookup
+// visits O(log n) records. Everything is in host byte order.
+
+// Doubles in a key
+static const size_t table_key_size = 10;
+
+// Records an answer is interpolated from
+static const size_t table_neighbours = 32;
+
+struct MPC_TableHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t header_size;
+
+  // Settings the problems were solved with, and MPC::Backend
+  MPC_Config config;
+  int32_t backend;
+  uint32_t key_size;
+  uint64_t entries;
+
+  // Spread of each key dimension, and the largest scaled distance to a
+  // record the table answers
+  double scale[table_key_size];
+  double radius;
+
+  // Largest weighted RMS residual of the fit to the neighbours' first
+  // steering and throttle, as a fraction of the actuator limits
+  double tolerance;
+};
+
+struct MPC_TableEntry {
+  // Key dimension this record splits its subtree on
+  uint32_t split;
+  uint32_t reserved;
+
+  double key[table_key_size];
+
+  // Cost of the solution that follows
+  double cost;
+};
+
+// A solved problem, as the generator hands it to WriteTable
+struct MPC_TableSample {
+  double key[table_key_size];
+  double cost;
+
+  // What MPC::Solve returned
+  vector<double> solved;
+};
+
+// A table mapped into memory. Read only once opened, so one table can
+// serve every MPC instance on any number of threads.
+class MPC_Table {
+ public:
+  MPC_Table();
+
+  virtual ~MPC_Table();
+
+  // Maps the file and checks its header and size. Returns false with
+  // error set if it isn't a table.
+  bool Open(const string& path, string& error);
+
+  const MPC_TableHeader& header() const { return *header_; }
+  size_t size() const { return header_->entries; }
+
+  // Whether the table was solved for the same problem as config (same
+  // horizon, timestep, reference speed and weights, see SameProblem) and
+  // with the same MPC::Backend. The backends converge to different
+  // solutions, so a table only stands in for the one it was solved with.
+  bool Matches(const MPC_Config& config, int32_t backend) const;
+
+  // Interpolates what MPC::Solve would return for a problem, and its
+  // cost. Returns false if the problem is outside the covered region,
+  // the fit is off by more than the tolerance, or the problem doesn't
+  // have the sizes of a key.
+  bool Lookup(const Eigen::VectorXd& state, const Eigen::VectorXd& coeffs,
+              vector<double>& solved, double& cost) const;
+
+  // Key of a problem, false if state or coeffs have the wrong size
+  static bool MakeKey(const Eigen::VectorXd& state,
+                      const Eigen::VectorXd& coeffs, double* key);
+
+ private:
+  const MPC_TableEntry& Entry(size_t i) const {
+    return *reinterpret_cast<const MPC_TableEntry*>(entries_ + i * stride_);
+  }
+
+  // A record and its squared scaled distance from the key looked up
+  struct Neighbour {
+    const MPC_TableEntry* entry;
+    double distance;
+    bool operator<(const Neighbour& other) const {
+      return distance < other.distance;
+    }
+  };
+
+  // Squared scaled distance between a record and a key
+  double Distance(const MPC_TableEntry& entry, const double* key) const;
+
+  // Searches records [begin, end) for ones closer than the farthest of
+  // the `found` nearest so far, a max-heap of up to table_neighbours
+  void Nearest(size_t begin, size_t end, const double* key,
+               Neighbour* nearest, size_t& found) const;
+
+  const char* data_;
+  size_t size_;
+  const MPC_TableHeader* header_;
+  const char* entries_;
+
+  // Bytes per record, and doubles MPC::Solve returns
+  size_t stride_;
+  size_t solved_size_;
+
+  double inverse_scale_[table_key_size];
+};
+
+// Arranges samples into a k-d tree and writes them as a table solved
+// with config and backend, answering within radius where the fit is
+// within tolerance. Returns false with error set if a sample has the
+// wrong size or the file can't be written.
+bool WriteTable(const string& path, const MPC_Config& config,
+                int32_t backend, double radius, double tolerance,
+                vector<MPC_TableSample>& samples, string& error);
+
+#endif /* MPC_TABLE_H */
@@ -0,0 +1,129 @@
+#include "Pipeline.h"
+#include <chrono>
+#include "MPC_Model.h"
+#include "SolveStats.h"
+
+constexpr double Pipeline::latency;
+
+Pipeline::Pipeline(MPC& mpc) : mpc_(mpc), state_(6) {}
+
+void Pipeline::Run(const Telemetry& telemetry, Actuation& actuation,
+                   PipelineTimes* times) {
+  const vector<double>& ptsx = telemetry.ptsx;
+  const vector<double>& ptsy = telemetry.ptsy;
+  const double px = telemetry.x;
+  const double py = telemetry.y;
+  const double psi = telemetry.psi;
+  const double v = telemetry.speed;
+  const double delta = telemetry.steering_angle;
+  const double a = telemetry.throttle;
+
+  auto start = chrono::steady_clock::now();
+
+  // Need Eigen vectors for polyfit
+  ptsx_car_.resize(ptsx.size());
+  ptsy_car_.resize(ptsy.size());
+
+  // Transform the points to the vehicle's orientation
+  for (size_t i = 0; i < ptsx.size(); i++) {
+    double x = ptsx[i] - px;
+    double y = ptsy[i] - py;
+    ptsx_car_[i] = x * cos(-psi) - y * sin(-psi);
+    ptsy_car_[i] = x * sin(-psi) + y * cos(-psi);
+  }
+  if (times) {
+    times->transform_us = ElapsedMicros(start);
+    start = chrono::steady_clock::now();
+  }
+
+  /*
+  * Calculate steering angle and throttle using MPC.
+  * Both are in between [-1, 1].
+  * Simulator has 100ms latency, so will predict state at that point in time.
+  * This will help the car react to where it is actually at by the point of actuation.
+  */
+
+  // Fits a 3rd-order polynomial to the above x and y coordinates
+  // The fixed-size fitter only fails on degenerate waypoints, where the
+  // QR based polyfit copes better
+  PolyFitter<3>::Coeffs fitted;
+  size_t num_waypoints = min(ptsx_car_.size(), ptsy_car_.size());
+  if (fitter_.Fit(ptsx_car_.data(), ptsy_car_.data(), num_waypoints, fitted)) {
+    coeffs_ = fitted;
+  } else {
+    coeffs_ = polyfit(ptsx_car_, ptsy_car_, 3);
+  }
+  if (times) {
+    times->fit_us = ElapsedMicros(start);
+    start = chrono::steady_clock::now();
+  }
+
+  // Calculates the cross track error
+  // Because points were transformed to vehicle coordinates, x & y equal 0 below.
+  // 'y' would otherwise be subtracted from the polyeval value
+  double cte = polyeval(coeffs_, 0);
+
+  // Calculate the orientation error
+  // Derivative of the polyfit goes in atan() below
+  // Because x = 0 in the vehicle coordinates, the higher orders are zero
+  // Leaves only coeffs[1]
+  double epsi = -atan(coeffs_[1]);
+
+  // Latency for predicting time at actuation
+  const double dt = latency;
+
+  // Predict state after latency
+  // x, y and psi are all zero after transformation above
+  double pred_px = 0.0 + v * dt; // Since psi is zero, cos(0) = 1, can leave out
+  const double pred_py = 0.0; // Since sin(0) = 0, y stays as 0 (y + v * 0 * dt)
+  double pred_psi = 0.0 + v * -delta / Lf * dt;
+  double pred_v = v + a * dt;
+  double pred_cte = cte + v * sin(epsi) * dt;
+  double pred_epsi = epsi + v * -delta / Lf * dt;
+
+  // Feed in the predicted state values
+  state_ << pred_px, pred_py, pred_psi, pred_v, pred_cte, pred_epsi;
+  if (times) {
+    times->predict_us = ElapsedMicros(start);
+    start = chrono::steady_clock::now();
+  }
+
+  // Solve for new actuations (and to show predicted x and y in the future)
+  auto vars = mpc_.Solve(state_, coeffs_);
+  if (times) {
+    times->solve_us = ElapsedMicros(start);
+    start = chrono::steady_clock::now();
+  }
+
+  // Calculate steering and throttle
+  // Steering must be divided by deg2rad(25) to normalize within [-1, 1].
+  // Multiplying by Lf takes into account vehicle's turning ability
+  actuation.steer_value = vars[0] / (deg2rad(25) * Lf);
+  actuation.throttle_value = vars[1];
+  actuation.source = mpc_.stats().source;
+
+  // Display the MPC predicted trajectory
+  actuation.mpc_x.assign(1, state_[0]);
+  actuation.mpc_y.assign(1, state_[1]);
+
+  // add (x,y) points to list here, points are in reference to the vehicle's coordinate system
+  // the points in the simulator are connected by a Green line
+  for (size_t i = 2; i < vars.size(); i += 2) {
+    actuation.mpc_x.push_back(vars[i]);
+    actuation.mpc_y.push_back(vars[i + 1]);
+  }
+
+  // Display the waypoints/reference line
+  // add (x,y) points to list here, points are in reference to the vehicle's coordinate system
+  // the points in the simulator are connected by a Yellow line
+  // The vectors keep their capacity between frames, so this doesn't allocate
+  const double poly_inc = 2.5;
+  const size_t num_points = 24;
+  actuation.next_x.resize(num_points);
+  actuation.next_y.resize(num_points);
+  polysample(coeffs_, poly_inc, poly_inc, actuation.next_x.data(),
+             actuation.next_y.data(), num_points);
+  if (times) {
+    times->output_us = ElapsedMicros(start);
+  }
+}
@@ -0,0 +1,96 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <cmath>
+#include <string>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "MPC.h"
+#include "Polynomial.h"
+#include "SolveStats.h"
+
+using namespace std;
+
+// For converting back and forth between radians and degrees.
+constexpr double pi() { return M_PI; }
+inline double deg2rad(double x) { return x * pi() / 180; }
+inline double rad2deg(double x) { return x * 180 / pi(); }
+
+// The telemetry fields the controller uses, see DATA.md
+struct Telemetry {
+  vector<double> ptsx;
+  vector<double> ptsy;
+  double x = 0;
+  double y = 0;
+  double psi = 0;
+  double speed = 0;
+  double steering_angle = 0;
+  double throttle = 0;
+};
+
+// What gets sent back to the simulator
+struct Actuation {
+  // Both in [-1, 1]
+  double steer_value = 0;
+  double throttle_value = 0;
+
+  // What produced them. Not sent to the simulator or recorded.
+  ActuationSource source = SOLVER_PLAN;
+
+  // MPC predicted trajectory (green line) and the fitted reference
+  // line (yellow line), in vehicle coordinates
+  vector<double> mpc_x;
+  vector<double> mpc_y;
+  vector<double> next_x;
+  vector<double> next_y;
+};
+
+// Wall time of each stage of Pipeline::Run, in microseconds
+struct PipelineTimes {
+  double transform_us = 0;
+  double fit_us = 0;
+  double predict_us = 0;
+  double solve_us = 0;
+  double output_us = 0;
+};
+
+// Everything between a telemetry message and the actuation sent back:
+// transform the waypoints to vehicle coordinates, fit the reference
+// polynomial, predict the state after the actuation latency and solve.
+//
+// Shared by the websocket server in main.cpp and the offline tools, so
+// whatever they measure is what the simulator gets.
+class Pipeline {
+ public:
+  // Actuation latency of the simulator in seconds
+  static constexpr double latency = 0.1;
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  explicit Pipeline(MPC& mpc);
+
+  // Runs all stages on one message. When times is given, it receives
+  // the wall time of each stage.
+  void Run(const Telemetry& telemetry, Actuation& actuation,
+           PipelineTimes* times = nullptr);
+
+  // Intermediate results of the last Run
+  const Eigen::VectorXd& coeffs() const { return coeffs_; }
+  const Eigen::VectorXd& state() const { return state_; }
+
+ private:
+  MPC& mpc_;
+
+  // Waypoints in vehicle coordinates
+  Eigen::VectorXd ptsx_car_;
+  Eigen::VectorXd ptsy_car_;
+
+  // Fits the reference polynomial
+  PolyFitter<3> fitter_;
+
+  // Reference polynomial and predicted state fed to the solver
+  Eigen::VectorXd coeffs_;
+  Eigen::VectorXd state_;
+};
+
+#endif /* PIPELINE_H */
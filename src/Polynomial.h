@@ -0,0 +1,289 @@
+#ifndef POLYNOMIAL_H
+#define POLYNOMIAL_H
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+#include "Eigen-3.3/Eigen/Cholesky"
+#include "Eigen-3.3/Eigen/Core"
+#include "Eigen-3.3/Eigen/QR"
+
+// Polynomials are given by their coefficients, lowest order first:
+// coeffs[0] + coeffs[1] * x + coeffs[2] * x^2 + ...
+//
+// The evaluation functions use Horner's scheme and work on anything with
+// size() and operator[] (Eigen vectors, CPPAD_TESTVECTOR), in the scalar
+// type of the coefficients. The same code runs on doubles, records a
+// short chain of multiply-adds instead of pow operations when taping with
+// AD<double>, and is traced by mpc_codegen.
+
+// Scalar type of a coefficient vector
+template <class Coeffs>
+struct PolyScalar {
+  typedef typename std::decay<decltype(
+      std::declval<const Coeffs&>()[0])>::type type;
+};
+
+// Evaluate a polynomial.
+template <class Coeffs>
+inline typename PolyScalar<Coeffs>::type polyeval(
+    const Coeffs& coeffs, const typename PolyScalar<Coeffs>::type& x) {
+  typedef typename PolyScalar<Coeffs>::type Scalar;
+  size_t n = coeffs.size();
+  Scalar result = coeffs[n - 1];
+  for (size_t i = n - 1; i-- > 0;) {
+    result = result * x + coeffs[i];
+  }
+  return result;
+}
+
+// Value and first derivative in one pass
+template <class Coeffs>
+inline typename PolyScalar<Coeffs>::type polyeval(
+    const Coeffs& coeffs, const typename PolyScalar<Coeffs>::type& x,
+    typename PolyScalar<Coeffs>::type& slope) {
+  typedef typename PolyScalar<Coeffs>::type Scalar;
+  size_t n = coeffs.size();
+  Scalar result = coeffs[n - 1];
+  slope = Scalar(0);
+  for (size_t i = n - 1; i-- > 0;) {
+    slope = slope * x + result;
+    result = result * x + coeffs[i];
+  }
+  return result;
+}
+
+// Value and the first `order` derivatives, d[k] receives the kth
+// derivative at x (d[0] the value)
+template <class Coeffs>
+inline void polyderivs(const Coeffs& coeffs,
+                       const typename PolyScalar<Coeffs>::type& x,
+                       typename PolyScalar<Coeffs>::type* d, size_t order) {
+  typedef typename PolyScalar<Coeffs>::type Scalar;
+  size_t n = coeffs.size();
+  d[0] = coeffs[n - 1];
+  for (size_t k = 1; k <= order; k++) {
+    d[k] = Scalar(0);
+  }
+  // Repeated synthetic division, d[k] ends up as f^(k)(x) / k!
+  for (size_t i = n - 1; i-- > 0;) {
+    for (size_t k = order < n - 1 - i ? order : n - 1 - i; k >= 1; k--) {
+      d[k] = d[k] * x + d[k - 1];
+    }
+    d[0] = d[0] * x + coeffs[i];
+  }
+  double factorial = 1;
+  for (size_t k = 2; k <= order; k++) {
+    factorial *= k;
+    d[k] = d[k] * factorial;
+  }
+}
+
+// Evaluate a polynomial at count points, ys[i] = p(xs[i]).
+// Each Horner step is an Eigen array expression over a block of points,
+// so it is vectorized with SSE2, or AVX2 and FMA when built for the host
+// CPU (MPC_NATIVE_ARCH). The blocks stay in L1 for long batches.
+inline void polyeval(const Eigen::VectorXd& coeffs, const double* xs,
+                     double* ys, size_t count) {
+  const size_t block = 512;
+  const Eigen::Index n = coeffs.size();
+  for (size_t start = 0; start < count; start += block) {
+    Eigen::Index size = Eigen::Index(std::min(block, count - start));
+    Eigen::Map<const Eigen::ArrayXd> x(xs + start, size);
+    Eigen::Map<Eigen::ArrayXd> y(ys + start, size);
+    y.setConstant(coeffs[n - 1]);
+    for (Eigen::Index i = n - 1; i-- > 0;) {
+      y = y * x + coeffs[i];
+    }
+  }
+}
+
+// Sample a polynomial at count evenly spaced points starting at x0,
+// xs[i] = x0 + step * i and ys[i] = p(xs[i])
+inline void polysample(const Eigen::VectorXd& coeffs, double x0, double step,
+                       double* xs, double* ys, size_t count) {
+  Eigen::Map<Eigen::ArrayXd> x(xs, Eigen::Index(count));
+  x = x0 + step * Eigen::ArrayXd::LinSpaced(Eigen::Index(count), 0,
+                                            double(count) - 1);
+  polyeval(coeffs, xs, ys, count);
+}
+
+// Fit a polynomial.
+// Adapted from
+// https://github.com/JuliaMath/Polynomials.jl/blob/master/src/Polynomials.jl#L676-L716
+inline Eigen::VectorXd polyfit(const Eigen::VectorXd& xvals,
+                               const Eigen::VectorXd& yvals, int order) {
+  assert(xvals.size() == yvals.size());
+  assert(order >= 1 && order <= xvals.size() - 1);
+  Eigen::MatrixXd A(xvals.size(), order + 1);
+
+  for (int i = 0; i < xvals.size(); i++) {
+    A(i, 0) = 1.0;
+  }
+
+  for (int j = 0; j < xvals.size(); j++) {
+    for (int i = 0; i < order; i++) {
+      A(j, i + 1) = A(j, i) * xvals(j);
+    }
+  }
+
+  auto Q = A.householderQr();
+  auto result = Q.solve(yvals);
+  return result;
+}
+
+// Least squares fit of a polynomial of fixed order through a handful of
+// points, without heap allocations.
+//
+// Solves the normal equations, V^T W V c = V^T W y, with a fixed-size
+// LDLT factorization. x is scaled to [-1, 1] first so squaring the
+// condition number of the Vandermonde matrix V stays harmless.
+//
+// Fit reuses the factorization when it is called again with the same x
+// values and weights, then only V^T W y is recomputed. Add and Remove
+// update the normal equations one point at a time, e.g. for a sliding
+// window of points, and Solve factors them when asked for coefficients.
+template <int Order>
+class PolyFitter {
+ public:
+  static const int n_coeffs = Order + 1;
+  typedef Eigen::Matrix<double, n_coeffs, 1> Coeffs;
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  PolyFitter() { Reset(1.0); }
+
+  // Fits count points, weighted by ws when given. Returns false when the
+  // points don't determine the polynomial, e.g. too few distinct x.
+  bool Fit(const double* xs, const double* ys, size_t count, Coeffs& coeffs,
+           const double* ws = nullptr) {
+    if (count < size_t(n_coeffs)) {
+      return false;
+    }
+    if (!SameLayout(xs, ws, count)) {
+      double scale = 0;
+      for (size_t i = 0; i < count; i++) {
+        scale = std::max(scale, std::fabs(xs[i]));
+      }
+      Reset(scale > 0 ? scale : 1.0);
+      for (size_t i = 0; i < count; i++) {
+        Update(xs[i], 0.0, ws ? ws[i] : 1.0);
+      }
+      Remember(xs, ws, count);
+    }
+    b_.setZero();
+    Coeffs v;
+    for (size_t i = 0; i < count; i++) {
+      Powers(xs[i], v);
+      b_ += ((ws ? ws[i] : 1.0) * ys[i]) * v;
+    }
+    return Solve(coeffs);
+  }
+
+  // Starts incremental fitting over. Points should lie within about
+  // [-scale, scale].
+  void Reset(double scale) {
+    scale_ = scale;
+    M_.setZero();
+    b_.setZero();
+    factored_ = false;
+    cached_count_ = 0;
+  }
+
+  void Add(double x, double y, double w = 1.0) { Update(x, y, w); }
+
+  // Takes back a point added before
+  void Remove(double x, double y, double w = 1.0) { Update(x, y, -w); }
+
+  // Coefficients fitting the points added so far
+  bool Solve(Coeffs& coeffs) {
+    if (!factored_) {
+      ldlt_.compute(M_);
+      factored_ = true;
+    }
+    const Coeffs& d = ldlt_.vectorD();
+    if (ldlt_.info() != Eigen::Success ||
+        !(d.minCoeff() > max_condition * d.maxCoeff())) {
+      return false;
+    }
+    // Solved for x / scale_, so coefficient k is off by scale_^k
+    Coeffs scaled = ldlt_.solve(b_);
+    double power = 1.0;
+    for (int k = 0; k < n_coeffs; k++) {
+      coeffs[k] = scaled[k] / power;
+      power *= scale_;
+    }
+    return true;
+  }
+
+ private:
+  typedef Eigen::Matrix<double, n_coeffs, n_coeffs> Matrix;
+
+  // Smallest pivot relative to the largest before the fit counts as
+  // singular
+  static constexpr double max_condition = 1e-12;
+
+  // Layouts of up to this many points are remembered
+  static const size_t max_cached = 32;
+
+  // 1, x, x^2, ... of the scaled x
+  void Powers(double x, Coeffs& v) const {
+    double t = x / scale_;
+    v[0] = 1.0;
+    for (int k = 1; k < n_coeffs; k++) {
+      v[k] = v[k - 1] * t;
+    }
+  }
+
+  void Update(double x, double y, double w) {
+    Coeffs v;
+    Powers(x, v);
+    M_.noalias() += w * v * v.transpose();
+    b_ += (w * y) * v;
+    factored_ = false;
+    cached_count_ = 0;
+  }
+
+  bool SameLayout(const double* xs, const double* ws, size_t count) const {
+    if (count != cached_count_ || !factored_) {
+      return false;
+    }
+    for (size_t i = 0; i < count; i++) {
+      if (xs[i] != cached_x_[i] || (ws ? ws[i] : 1.0) != cached_w_[i]) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void Remember(const double* xs, const double* ws, size_t count) {
+    if (count > max_cached) {
+      return;
+    }
+    for (size_t i = 0; i < count; i++) {
+      cached_x_[i] = xs[i];
+      cached_w_[i] = ws ? ws[i] : 1.0;
+    }
+    cached_count_ = count;
+  }
+
+  // Normal equations in the scaled x
+  double scale_;
+  Matrix M_;
+  Coeffs b_;
+  Eigen::LDLT<Matrix> ldlt_;
+  bool factored_;
+
+  // x values and weights M_ was built from, none when cached_count_ is 0
+  double cached_x_[max_cached];
+  double cached_w_[max_cached];
+  size_t cached_count_;
+};
+
+template <int Order>
+constexpr double PolyFitter<Order>::max_condition;
+
+#endif /* POLYNOMIAL_H */
@@ -0,0 +1,84 @@
+#include "Protocol.h"
+#include <cstring>
+#include "JsonStream.h"
+
+// Telemetry fields the controller needs, see DATA.md
+static const JsonField<Telemetry> telemetry_schema[] = {
+    {"ptsx", nullptr, &Telemetry::ptsx},
+    {"ptsy", nullptr, &Telemetry::ptsy},
+    {"x", &Telemetry::x, nullptr},
+    {"y", &Telemetry::y, nullptr},
+    {"psi", &Telemetry::psi, nullptr},
+    {"speed", &Telemetry::speed, nullptr},
+    {"steering_angle", &Telemetry::steering_angle, nullptr},
+    {"throttle", &Telemetry::throttle, nullptr}};
+
+static const size_t telemetry_fields =
+    sizeof(telemetry_schema) / sizeof(telemetry_schema[0]);
+
+static bool ReadTelemetry(JsonReader& reader, Telemetry& telemetry) {
+  uint64_t found;
+  return reader.ReadObject(telemetry, telemetry_schema, telemetry_fields,
+                           found) &&
+         found == (uint64_t(1) << telemetry_fields) - 1;
+}
+
+MessageKind ParseMessage(const char* data, size_t length,
+                         Telemetry& telemetry) {
+  // "42" at the start of the message means there's a websocket message event.
+  // The 4 signifies a websocket message
+  // The 2 signifies a websocket event
+  if (length <= 2 || data[0] != '4' || data[1] != '2') {
+    return OTHER_MESSAGE;
+  }
+  JsonReader reader(data + 2, data + length);
+
+  // ["event", data]
+  const char* event;
+  size_t n;
+  if (!reader.Consume('[') || !reader.String(event, n) ||
+      !reader.Consume(',')) {
+    return MANUAL_MESSAGE;
+  }
+  if (reader.Peek() != '{') {
+    // null data while driving manually
+    return MANUAL_MESSAGE;
+  }
+  if (n != 9 || memcmp(event, "telemetry", n) != 0) {
+    return OTHER_MESSAGE;
+  }
+  if (!ReadTelemetry(reader, telemetry) || !reader.Consume(']')) {
+    return MANUAL_MESSAGE;
+  }
+  return TELEMETRY_MESSAGE;
+}
+
+bool ParseTelemetryObject(const char* data, size_t length,
+                          Telemetry& telemetry) {
+  JsonReader reader(data, data + length);
+  return ReadTelemetry(reader, telemetry);
+}
+
+void WriteSteerMessage(const Actuation& actuation, string& out) {
+  // Same keys in the same (sorted) order json.hpp wrote them
+  out.clear();
+  JsonWriter writer(out, steer_decimals);
+  writer.Raw("42");
+  writer.BeginArray();
+  writer.String("steer");
+  writer.BeginObject();
+  writer.Key("mpc_x");
+  writer.NumberArray(actuation.mpc_x);
+  writer.Key("mpc_y");
+  writer.NumberArray(actuation.mpc_y);
+  writer.Key("next_x");
+  writer.NumberArray(actuation.next_x);
+  writer.Key("next_y");
+  writer.NumberArray(actuation.next_y);
+  writer.Key("steering_angle");
+  writer.Number(actuation.steer_value);
+  writer.Key("throttle");
+  writer.Number(actuation.throttle_value);
+  writer.EndObject();
+  writer.EndArray();
+}
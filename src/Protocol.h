@@ -0,0 +1,46 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <cstddef>
+#include <string>
+#include "Pipeline.h"
+
+using namespace std;
+
+// The Socket.IO messages exchanged with the simulator, read and written
+// with JsonStream so no JSON document is ever built.
+
+// What a websocket message from the simulator turned out to be
+enum MessageKind {
+  // 42["telemetry",{...}] with every field the controller needs
+  TELEMETRY_MESSAGE,
+  // A Socket.IO event without data (manual driving mode), or one that
+  // couldn't be read. The simulator expects a "manual" reply to these.
+  MANUAL_MESSAGE,
+  // Anything else: other Socket.IO packet types and other events
+  OTHER_MESSAGE
+};
+
+// Reads a websocket message in place, without copying it.
+//
+// Only ptsx, ptsy, x, y, psi, speed, steering_angle and throttle are
+// picked out, every other field is skipped. The waypoint vectors are
+// cleared and refilled, so once they have grown to the number of
+// waypoints the simulator sends, parsing doesn't allocate.
+MessageKind ParseMessage(const char* data, size_t length,
+                         Telemetry& telemetry);
+
+// Same for a bare telemetry object, as documented in DATA.md.
+// Returns false unless every field was there.
+bool ParseTelemetryObject(const char* data, size_t length,
+                          Telemetry& telemetry);
+
+// Digits after the point in the steer reply, a micrometer for the
+// trajectories and a millionth of the actuator range
+const int steer_decimals = 6;
+
+// Writes the 42["steer",{...}] reply for an actuation to out, replacing
+// what was there. Reusing out avoids allocating once it has grown.
+void WriteSteerMessage(const Actuation& actuation, string& out);
+
+#endif /* PROTOCOL_H */
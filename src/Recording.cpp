@@ -0,0 +1,259 @@
+#include "Recording.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstring>
+
+static const char recording_magic[8] = {'M', 'P', 'C', 'R', 'E', 'C', 0, 0};
+// 2: MPC_Config gained linear_solver
+// 3: MPC_Config gained tol and max_iter, config records
+// 4: MPC_Config gained deadline
+static const uint32_t recording_version = 4;
+
+// Buffer size that makes the writer wake up before its periodic flush
+static const size_t flush_size = 1 << 20;
+
+Recorder::Recorder() : file_(nullptr), stop_(false) {}
+
+Recorder::~Recorder() {
+  if (!file_) {
+    return;
+  }
+  {
+    lock_guard<mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_one();
+  writer_.join();
+  fclose(file_);
+}
+
+bool Recorder::Open(const string& path, const MPC_Config& config,
+                    MPC::Backend backend, bool warm_start) {
+  file_ = fopen(path.c_str(), "wb");
+  if (!file_) {
+    return false;
+  }
+  // Value initialized, so the padding is zero too
+  RecordingHeader header = RecordingHeader();
+  memcpy(header.magic, recording_magic, sizeof(header.magic));
+  header.version = recording_version;
+  header.header_size = sizeof(header);
+  header.config = config;
+  header.backend = backend;
+  header.warm_start = warm_start;
+  fwrite(&header, sizeof(header), 1, file_);
+  fflush(file_);
+
+  buffer_.reserve(flush_size);
+  spare_.reserve(flush_size);
+  start_ = chrono::steady_clock::now();
+  writer_ = thread(&Recorder::WriterLoop, this);
+  return true;
+}
+
+void Recorder::WriteTelemetry(uint32_t connection, uint64_t frame,
+                              const Telemetry& telemetry) {
+  TelemetryRecord record;
+  record.x = telemetry.x;
+  record.y = telemetry.y;
+  record.psi = telemetry.psi;
+  record.speed = telemetry.speed;
+  record.steering_angle = telemetry.steering_angle;
+  record.throttle = telemetry.throttle;
+  record.points = min(telemetry.ptsx.size(), telemetry.ptsy.size());
+  record.reserved = 0;
+  size_t points_size = record.points * sizeof(double);
+
+  lock_guard<mutex> lock(mutex_);
+  BeginRecord(TELEMETRY_RECORD, connection, frame,
+              sizeof(record) + 2 * points_size);
+  Put(&record, sizeof(record));
+  Put(telemetry.ptsx.data(), points_size);
+  Put(telemetry.ptsy.data(), points_size);
+  EndRecord();
+}
+
+void Recorder::WriteActuation(uint32_t connection, uint64_t frame,
+                              const Actuation& actuation) {
+  ActuationRecord record;
+  record.steer_value = actuation.steer_value;
+  record.throttle_value = actuation.throttle_value;
+  record.mpc_points = min(actuation.mpc_x.size(), actuation.mpc_y.size());
+  record.next_points = min(actuation.next_x.size(), actuation.next_y.size());
+  size_t mpc_size = record.mpc_points * sizeof(double);
+  size_t next_size = record.next_points * sizeof(double);
+
+  lock_guard<mutex> lock(mutex_);
+  BeginRecord(ACTUATION_RECORD, connection, frame,
+              sizeof(record) + 2 * mpc_size + 2 * next_size);
+  Put(&record, sizeof(record));
+  Put(actuation.mpc_x.data(), mpc_size);
+  Put(actuation.mpc_y.data(), mpc_size);
+  Put(actuation.next_x.data(), next_size);
+  Put(actuation.next_y.data(), next_size);
+  EndRecord();
+}
+
+void Recorder::WriteConfig(uint32_t connection, uint64_t frame,
+                           const MPC_Config& config) {
+  static_assert(sizeof(MPC_Config) % sizeof(double) == 0,
+                "records have to stay 8 byte aligned");
+  lock_guard<mutex> lock(mutex_);
+  BeginRecord(CONFIG_RECORD, connection, frame, sizeof(config));
+  Put(&config, sizeof(config));
+  EndRecord();
+}
+
+void Recorder::BeginRecord(RecordType type, uint32_t connection,
+                           uint64_t frame, size_t length) {
+  RecordHeader header;
+  header.type = type;
+  header.length = length;
+  header.connection = connection;
+  header.reserved = 0;
+  header.frame = frame;
+  header.time = chrono::duration<double>(chrono::steady_clock::now() -
+                                         start_).count();
+  Put(&header, sizeof(header));
+}
+
+void Recorder::Put(const void* data, size_t size) {
+  const char* bytes = static_cast<const char*>(data);
+  buffer_.insert(buffer_.end(), bytes, bytes + size);
+}
+
+void Recorder::EndRecord() {
+  if (buffer_.size() >= flush_size) {
+    cv_.notify_one();
+  }
+}
+
+void Recorder::WriterLoop() {
+  unique_lock<mutex> lock(mutex_);
+  for (;;) {
+    cv_.wait_for(lock, chrono::seconds(1),
+                 [this] { return stop_ || buffer_.size() >= flush_size; });
+    bool stopping = stop_;
+    buffer_.swap(spare_);
+
+    // Write without holding the lock, so recording never waits on disk
+    lock.unlock();
+    if (!spare_.empty()) {
+      fwrite(spare_.data(), 1, spare_.size(), file_);
+      fflush(file_);
+      spare_.clear();
+    }
+    lock.lock();
+    if (stopping && buffer_.empty()) {
+      return;
+    }
+  }
+}
+
+Recording::Recording()
+    : data_(nullptr), size_(0), offset_(0), header_(nullptr) {}
+
+Recording::~Recording() {
+  if (data_) {
+    munmap(const_cast<char*>(data_), size_);
+  }
+}
+
+bool Recording::Open(const string& path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(RecordingHeader)) {
+    close(fd);
+    return false;
+  }
+  void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    return false;
+  }
+  data_ = static_cast<const char*>(data);
+  size_ = st.st_size;
+  header_ = reinterpret_cast<const RecordingHeader*>(data_);
+  if (memcmp(header_->magic, recording_magic, sizeof(recording_magic)) != 0 ||
+      header_->version != recording_version ||
+      header_->header_size != sizeof(RecordingHeader)) {
+    return false;
+  }
+  offset_ = header_->header_size;
+  return true;
+}
+
+bool Recording::Next(const RecordHeader*& record) {
+  if (size_ - offset_ < sizeof(RecordHeader)) {
+    return false;
+  }
+  const RecordHeader* next =
+      reinterpret_cast<const RecordHeader*>(data_ + offset_);
+  size_t end = offset_ + sizeof(RecordHeader) + next->length;
+  if (next->length % sizeof(double) != 0 || end > size_) {
+    return false;
+  }
+  record = next;
+  offset_ = end;
+  return true;
+}
+
+bool Recording::Read(const RecordHeader& record, Telemetry& telemetry) {
+  if (record.type != TELEMETRY_RECORD ||
+      record.length < sizeof(TelemetryRecord)) {
+    return false;
+  }
+  const TelemetryRecord& t =
+      *reinterpret_cast<const TelemetryRecord*>(&record + 1);
+  if (record.length != sizeof(t) + 2 * size_t(t.points) * sizeof(double)) {
+    return false;
+  }
+  telemetry.x = t.x;
+  telemetry.y = t.y;
+  telemetry.psi = t.psi;
+  telemetry.speed = t.speed;
+  telemetry.steering_angle = t.steering_angle;
+  telemetry.throttle = t.throttle;
+  const double* points = reinterpret_cast<const double*>(&t + 1);
+  telemetry.ptsx.assign(points, points + t.points);
+  telemetry.ptsy.assign(points + t.points, points + 2 * t.points);
+  return true;
+}
+
+bool Recording::Read(const RecordHeader& record, Actuation& actuation) {
+  if (record.type != ACTUATION_RECORD ||
+      record.length < sizeof(ActuationRecord)) {
+    return false;
+  }
+  const ActuationRecord& a =
+      *reinterpret_cast<const ActuationRecord*>(&record + 1);
+  if (record.length !=
+      sizeof(a) +
+          2 * (size_t(a.mpc_points) + a.next_points) * sizeof(double)) {
+    return false;
+  }
+  actuation.steer_value = a.steer_value;
+  actuation.throttle_value = a.throttle_value;
+  const double* points = reinterpret_cast<const double*>(&a + 1);
+  actuation.mpc_x.assign(points, points + a.mpc_points);
+  points += a.mpc_points;
+  actuation.mpc_y.assign(points, points + a.mpc_points);
+  points += a.mpc_points;
+  actuation.next_x.assign(points, points + a.next_points);
+  points += a.next_points;
+  actuation.next_y.assign(points, points + a.next_points);
+  return true;
+}
+
+bool Recording::Read(const RecordHeader& record, MPC_Config& config) {
+  if (record.type != CONFIG_RECORD || record.length != sizeof(MPC_Config)) {
+    return false;
+  }
+  config = *reinterpret_cast<const MPC_Config*>(&record + 1);
+  return true;
+}
@@ -0,0 +1,169 @@
+#ifndef RECORDING_H
+#define RECORDING_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "MPC.h"
+#include "MPC_Config.h"
+#include "Pipeline.h"
+
+using namespace std;
+
+// Binary log of the telemetry the server received and the actuations it
+// sent back.
+//
+// A recording is a RecordingHeader followed by records, each a
+// RecordHeader and `length` bytes of payload. Everything is stored in
+// host byte order and every record is a multiple of 8 bytes, so a mapped
+// file can be read in place. A file cut off by a crash just ends at the
+// last complete record.
+//
+// Telemetry payload:  TelemetryRecord, ptsx[points], ptsy[points]
+// Actuation payload:  ActuationRecord, mpc_x[mpc_points], mpc_y[mpc_points],
+//                     next_x[next_points], next_y[next_points]
+// Config payload:     MPC_Config
+//
+// A config record says the connection's solver was rebuilt with new
+// settings (a reload) before it solved the given frame; it applies from
+// that frame's actuation on.
+//
+// The doubles are the ones the controller saw, so replaying the
+// telemetry through a Pipeline with the recorded settings gives the
+// recorded actuations bit for bit.
+
+enum RecordType {
+  TELEMETRY_RECORD = 1,
+  ACTUATION_RECORD = 2,
+  CONFIG_RECORD = 3
+};
+
+struct RecordingHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t header_size;
+
+  // Settings of the controller that wrote the recording
+  MPC_Config config;
+  int32_t backend;
+  int32_t warm_start;
+};
+
+struct RecordHeader {
+  uint32_t type;
+  uint32_t length;
+
+  // Connection the record belongs to, counted from 0 per recording
+  uint32_t connection;
+  uint32_t reserved;
+
+  // Telemetry message number within the connection. An actuation has
+  // the number of the message it answers.
+  uint64_t frame;
+
+  // Seconds since the recording started
+  double time;
+};
+
+struct TelemetryRecord {
+  double x;
+  double y;
+  double psi;
+  double speed;
+  double steering_angle;
+  double throttle;
+  uint32_t points;
+  uint32_t reserved;
+};
+
+struct ActuationRecord {
+  double steer_value;
+  double throttle_value;
+  uint32_t mpc_points;
+  uint32_t next_points;
+};
+
+// Appends records to a recording.
+//
+// Write* only copies the record into a memory buffer under a short lock;
+// a background thread writes the buffer out once it fills up and at
+// least once a second. Safe to call from several threads.
+class Recorder {
+ public:
+  Recorder();
+
+  virtual ~Recorder();
+
+  // Creates the file and writes the header. Returns false if the file
+  // can't be created.
+  bool Open(const string& path, const MPC_Config& config,
+            MPC::Backend backend, bool warm_start);
+
+  void WriteTelemetry(uint32_t connection, uint64_t frame,
+                      const Telemetry& telemetry);
+  void WriteActuation(uint32_t connection, uint64_t frame,
+                      const Actuation& actuation);
+  void WriteConfig(uint32_t connection, uint64_t frame,
+                   const MPC_Config& config);
+
+ private:
+  // Appends a record header for a payload of length bytes, lock held
+  void BeginRecord(RecordType type, uint32_t connection, uint64_t frame,
+                   size_t length);
+
+  // Appends raw bytes, lock held
+  void Put(const void* data, size_t size);
+
+  // Hands a full buffer to the writer, lock held
+  void EndRecord();
+
+  void WriterLoop();
+
+  FILE* file_;
+  chrono::steady_clock::time_point start_;
+
+  // Records not written yet. The writer swaps it with spare_, so both
+  // keep their capacity and appending rarely allocates.
+  mutex mutex_;
+  condition_variable cv_;
+  vector<char> buffer_;
+  vector<char> spare_;
+  bool stop_;
+
+  thread writer_;
+};
+
+// A recording mapped into memory, read front to back
+class Recording {
+ public:
+  Recording();
+
+  virtual ~Recording();
+
+  // Maps the file and checks its header
+  bool Open(const string& path);
+
+  const RecordingHeader& header() const { return *header_; }
+
+  // Moves to the next record, false at the end of the file
+  bool Next(const RecordHeader*& record);
+
+  // Decode a record, false if it isn't of the matching type or its
+  // length doesn't add up
+  static bool Read(const RecordHeader& record, Telemetry& telemetry);
+  static bool Read(const RecordHeader& record, Actuation& actuation);
+  static bool Read(const RecordHeader& record, MPC_Config& config);
+
+ private:
+  const char* data_;
+  size_t size_;
+  size_t offset_;
+  const RecordingHeader* header_;
+};
+
+#endif /* RECORDING_H */
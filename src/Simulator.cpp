@@ -0,0 +1,165 @@
+#include "Simulator.h"
+#include <chrono>
+#include <cmath>
+#include "MPC_Model.h"
+#include "SolveStats.h"
+
+static const double mph_to_mps = 0.44704;
+
+Simulator::Simulator(const Track& track, const SimConfig& config, MPC& mpc)
+    : track_(track), config_(config), pipeline_(mpc) {
+  Reset();
+}
+
+void Simulator::Reset() {
+  x_ = track_.xs()[0];
+  y_ = track_.ys()[0];
+  psi_ = track_.Heading(0);
+  vx_ = vy_ = yaw_rate_ = 0.0;
+  steer_ = throttle_ = 0.0;
+  pending_.clear();
+  last_steer_ = NAN;
+  time_ = 0.0;
+  segment_ = 0;
+  double cte;
+  track_.Project(x_, y_, segment_, s_, cte);
+}
+
+void Simulator::Sense(Telemetry& telemetry) const {
+  track_.Waypoints(segment_, 6, telemetry.ptsx, telemetry.ptsy);
+  telemetry.x = x_;
+  telemetry.y = y_;
+  telemetry.psi = psi_;
+  telemetry.speed = hypot(vx_, vy_) / mph_to_mps;
+  telemetry.steering_angle = steer_ * deg2rad(config_.max_steer_deg);
+  telemetry.throttle = throttle_;
+}
+
+void Simulator::Step(double dt) {
+  // Right is positive for the simulator, left for the equations below
+  double delta = -steer_ * deg2rad(config_.max_steer_deg);
+  double accel = throttle_ >= 0 ? throttle_ * config_.max_accel
+                                : throttle_ * config_.max_brake;
+  accel -= config_.drag * vx_ * fabs(vx_);
+
+  if (!config_.dynamic || vx_ < config_.min_dynamic_speed) {
+    // Kinematic bicycle, same equations as the MPC model
+    x_ += vx_ * cos(psi_) * dt;
+    y_ += vx_ * sin(psi_) * dt;
+    yaw_rate_ = vx_ * delta / Lf;
+    psi_ += yaw_rate_ * dt;
+    vx_ = fmax(0.0, vx_ + accel * dt);
+    vy_ = 0.0;
+    return;
+  }
+
+  // Dynamic bicycle with linear tires
+  double alpha_f = delta - atan2(vy_ + config_.lf * yaw_rate_, vx_);
+  double alpha_r = -atan2(vy_ - config_.lr * yaw_rate_, vx_);
+  double force_f = config_.cornering_front * alpha_f;
+  double force_r = config_.cornering_rear * alpha_r;
+
+  double vy_dot =
+      (force_f * cos(delta) + force_r) / config_.mass - vx_ * yaw_rate_;
+  double yaw_dot =
+      (config_.lf * force_f * cos(delta) - config_.lr * force_r) /
+      config_.yaw_inertia;
+  double vx_dot = accel + vy_ * yaw_rate_;
+
+  x_ += (vx_ * cos(psi_) - vy_ * sin(psi_)) * dt;
+  y_ += (vx_ * sin(psi_) + vy_ * cos(psi_)) * dt;
+  psi_ += yaw_rate_ * dt;
+  vx_ = fmax(0.0, vx_ + vx_dot * dt);
+  vy_ += vy_dot * dt;
+  yaw_rate_ += yaw_dot * dt;
+}
+
+LapResult Simulator::RunLap() {
+  LapResult lap;
+  const double start_time = time_;
+  const double lap_end = s_ + track_.length();
+  double progress = s_;
+  double next_message = time_;
+  double cte_sum = 0;
+  double cte_squares = 0;
+  double speed_sum = 0;
+  size_t samples = 0;
+
+  while (progress < lap_end) {
+    if (time_ - start_time > config_.max_lap_time) {
+      break;
+    }
+
+    // Telemetry goes out once per control period, the answer takes
+    // effect after the latency
+    if (time_ >= next_message) {
+      Sense(telemetry_);
+      auto start = chrono::steady_clock::now();
+      pipeline_.Run(telemetry_, actuation_, &times_);
+      double compute_us = ElapsedMicros(start);
+      controller_us_.push_back(compute_us);
+      solve_us_.push_back(times_.solve_us);
+      if (observer_) {
+        observer_(pipeline_);
+      }
+      if (IsFallback(actuation_.source)) {
+        lap.fallbacks++;
+      }
+
+      double delay = config_.latency;
+      if (config_.add_compute_time) {
+        delay += compute_us * 1e-6;
+      }
+      Command command = {time_ + delay,
+                         fmax(-1.0, fmin(1.0, actuation_.steer_value)),
+                         fmax(-1.0, fmin(1.0, actuation_.throttle_value))};
+      pending_.push_back(command);
+      // fmax skips the NaN of the first command, which starts from rest
+      lap.max_steer_rate =
+          fmax(lap.max_steer_rate, fabs(command.steer - last_steer_) *
+                                       config_.max_steer_deg /
+                                       config_.control_period);
+      last_steer_ = command.steer;
+      next_message += config_.control_period;
+      lap.messages++;
+    }
+    while (!pending_.empty() && pending_.front().time <= time_) {
+      steer_ = pending_.front().steer;
+      throttle_ = pending_.front().throttle;
+      pending_.pop_front();
+    }
+
+    Step(config_.physics_dt);
+    time_ += config_.physics_dt;
+
+    // Track progress, unwrapping the distance at the finish line
+    double s, cte;
+    track_.Project(x_, y_, segment_, s, cte);
+    double ds = s - s_;
+    if (ds < -0.5 * track_.length()) {
+      ds += track_.length();
+    } else if (ds > 0.5 * track_.length()) {
+      ds -= track_.length();
+    }
+    progress += ds;
+    s_ = s;
+
+    double speed_mph = hypot(vx_, vy_) / mph_to_mps;
+    lap.max_cte = fmax(lap.max_cte, fabs(cte));
+    lap.max_speed_mph = fmax(lap.max_speed_mph, speed_mph);
+    cte_sum += fabs(cte);
+    cte_squares += cte * cte;
+    speed_sum += speed_mph;
+    samples++;
+    if (fabs(cte) > config_.max_cte) {
+      break;
+    }
+  }
+
+  lap.completed = progress >= lap_end;
+  lap.lap_time = time_ - start_time;
+  lap.mean_cte = samples ? cte_sum / samples : 0.0;
+  lap.rms_cte = samples ? sqrt(cte_squares / samples) : 0.0;
+  lap.mean_speed_mph = samples ? speed_sum / samples : 0.0;
+  return lap;
+}
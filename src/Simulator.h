@@ -0,0 +1,146 @@
+#ifndef SIMULATOR_H
+#define SIMULATOR_H
+
+#include <deque>
+#include <functional>
+#include <vector>
+#include "MPC.h"
+#include "Pipeline.h"
+#include "Track.h"
+
+using namespace std;
+
+// Vehicle and loop parameters of the headless simulator
+struct SimConfig {
+  // Use the dynamic bicycle model (linear tires) instead of the
+  // kinematic one. Below min_dynamic_speed the kinematic model is used
+  // either way, the tire model is singular at standstill.
+  bool dynamic = false;
+  double min_dynamic_speed = 5.0;
+
+  // Geometry, mass and tire stiffness for the dynamic model
+  double lf = 1.2;
+  double lr = 1.6;
+  double mass = 1500.0;
+  double yaw_inertia = 2500.0;
+  double cornering_front = 80000.0;
+  double cornering_rear = 80000.0;
+
+  // Throttle 1 accelerates at max_accel, -1 brakes at max_brake (m/s^2),
+  // aerodynamic drag decelerates by drag * v^2
+  double max_accel = 5.0;
+  double max_brake = 8.0;
+  double drag = 0.0015;
+
+  // Steering 1 is 25 degrees to the right, like in the Unity simulator
+  double max_steer_deg = 25.0;
+
+  // Physics timestep, time between telemetry messages and delay until a
+  // command takes effect, all in seconds
+  double physics_dt = 0.005;
+  double control_period = 0.1;
+  double latency = 0.1;
+
+  // Add the measured wall time of the controller to the latency
+  bool add_compute_time = false;
+
+  // A lap is aborted when the car gets further than this from the
+  // center line, or takes longer than max_lap_time
+  double max_cte = 6.0;
+  double max_lap_time = 300.0;
+};
+
+// Results of one lap
+struct LapResult {
+  bool completed = false;
+  double lap_time = 0;
+  double max_cte = 0;
+  double mean_cte = 0;
+  double rms_cte = 0;
+  double max_speed_mph = 0;
+  double mean_speed_mph = 0;
+  size_t messages = 0;
+
+  // Largest change of the steering command between two messages, in
+  // degrees per second
+  double max_steer_rate = 0;
+
+  // Messages answered by a fallback instead of a solver plan, see
+  // ActuationSource
+  size_t fallbacks = 0;
+};
+
+// Drives a plant around the track with the controller in the loop.
+//
+// The plant sends the same telemetry the Unity simulator sends (waypoints
+// ahead, pose, speed in mph, steering angle and throttle) straight into
+// Pipeline and applies the actuation it returns after the configured
+// latency. Simulated time runs as fast as the controller allows.
+class Simulator {
+ public:
+  // pipeline_ holds fixed-size Eigen matrices
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  Simulator(const Track& track, const SimConfig& config, MPC& mpc);
+
+  // Puts the car back at the first waypoint, standing still
+  void Reset();
+
+  // Drives one lap from wherever the car is
+  LapResult RunLap();
+
+  // Called with the pipeline after each message it handled, e.g. to
+  // collect the problems the controller was given
+  void SetObserver(const function<void(const Pipeline&)>& observer) {
+    observer_ = observer;
+  }
+
+  // Wall time of every Pipeline::Run so far, and of the MPC::Solve in
+  // it, in microseconds
+  const vector<double>& controller_us() const { return controller_us_; }
+  const vector<double>& solve_us() const { return solve_us_; }
+
+ private:
+  // A command waiting for its latency to pass
+  struct Command {
+    double time;
+    double steer;
+    double throttle;
+  };
+
+  // Advances the plant by dt with the applied commands
+  void Step(double dt);
+
+  // Fills telemetry from the current plant state
+  void Sense(Telemetry& telemetry) const;
+
+  const Track& track_;
+  const SimConfig config_;
+  Pipeline pipeline_;
+
+  // Plant state: pose, body frame velocities (m/s) and yaw rate
+  double x_, y_, psi_;
+  double vx_, vy_, yaw_rate_;
+
+  // Commands in effect, steer in [-1, 1] with right positive
+  double steer_;
+  double throttle_;
+  deque<Command> pending_;
+
+  // Steering of the last command sent, NaN before the first
+  double last_steer_;
+
+  // Simulated time, and where the car is along the track
+  double time_;
+  size_t segment_;
+  double s_;
+
+  Telemetry telemetry_;
+  Actuation actuation_;
+  PipelineTimes times_;
+  vector<double> controller_us_;
+  vector<double> solve_us_;
+  function<void(const Pipeline&)> observer_;
+};
+
+#endif /* SIMULATOR_H */
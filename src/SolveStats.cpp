@@ -0,0 +1,79 @@
+#include "SolveStats.h"
+#include <algorithm>
+
+double Percentile(const vector<double>& sorted, double p) {
+  if (sorted.empty()) {
+    return 0.0;
+  }
+  size_t rank = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+  return sorted[rank];
+}
+
+StatsSummary Summarize(const vector<SolveStats>& stats) {
+  StatsSummary summary;
+  summary.count = stats.size();
+  if (stats.empty()) {
+    return summary;
+  }
+
+  vector<double> total;
+  vector<double> solve;
+  total.reserve(stats.size());
+  solve.reserve(stats.size());
+  long iterations = 0;
+  for (const SolveStats& s : stats) {
+    total.push_back(s.total_us);
+    solve.push_back(s.solve_us);
+    iterations += s.iterations;
+    summary.max_iterations = max(summary.max_iterations, s.iterations);
+    if (!s.ok) {
+      summary.failures++;
+    }
+    if (s.deadline_hit) {
+      summary.deadlines++;
+    }
+    switch (s.source) {
+      case TABLE_LOOKUP:
+        summary.table_lookups++;
+        break;
+      case BEST_ITERATE:
+        summary.best_iterates++;
+        break;
+      case PURE_PURSUIT:
+        summary.pure_pursuits++;
+        break;
+      case SHIFTED_PLAN:
+        summary.shifted_plans++;
+        break;
+      case STOPPING:
+        summary.stops++;
+        break;
+      default:
+        break;
+    }
+  }
+  sort(total.begin(), total.end());
+  sort(solve.begin(), solve.end());
+
+  summary.p50_us = Percentile(total, 0.50);
+  summary.p99_us = Percentile(total, 0.99);
+  summary.max_us = total.back();
+  summary.solve_p50_us = Percentile(solve, 0.50);
+  summary.solve_p99_us = Percentile(solve, 0.99);
+  summary.mean_iterations = double(iterations) / stats.size();
+  return summary;
+}
+
+ostream& operator<<(ostream& os, const StatsSummary& summary) {
+  os << "solves " << summary.count << " failed " << summary.failures
+     << " table " << summary.table_lookups
+     << " | latency us p50 " << summary.p50_us << " p99 " << summary.p99_us
+     << " max " << summary.max_us << " | solver us p50 "
+     << summary.solve_p50_us << " p99 " << summary.solve_p99_us
+     << " | iterations mean " << summary.mean_iterations << " max "
+     << summary.max_iterations << " | deadlines " << summary.deadlines
+     << " fallbacks iterate " << summary.best_iterates << " pursuit "
+     << summary.pure_pursuits << " shifted " << summary.shifted_plans
+     << " stop " << summary.stops;
+  return os;
+}
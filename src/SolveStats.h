@@ -0,0 +1,182 @@
+#ifndef SOLVE_STATS_H
+#define SOLVE_STATS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+using namespace std;
+
+// Where the actuations of a solve came from, in the order they are
+// tried.
+//
+// A problem inside the region an explicit table covers is answered from
+// it (see MPC_Table.h). Otherwise a solver that converged gives
+// SOLVER_PLAN. One that ran out of time or
+// iterations still gives its best feasible iterate if it had one. Without
+// that a pure pursuit law steers toward the reference line. If even the
+// reference line isn't usable the last plan is followed one more step,
+// and once that is used up the car steers straight and brakes.
+enum ActuationSource {
+  TABLE_LOOKUP,
+  SOLVER_PLAN,
+  BEST_ITERATE,
+  PURE_PURSUIT,
+  SHIFTED_PLAN,
+  STOPPING
+};
+
+inline const char* ActuationSourceName(ActuationSource source) {
+  switch (source) {
+    case TABLE_LOOKUP:
+      return "table";
+    case BEST_ITERATE:
+      return "best iterate";
+    case PURE_PURSUIT:
+      return "pure pursuit";
+    case SHIFTED_PLAN:
+      return "shifted plan";
+    case STOPPING:
+      return "stopping";
+    default:
+      return "solver plan";
+  }
+}
+
+// Whether the actuations came from a fallback instead of a plan
+inline bool IsFallback(ActuationSource source) {
+  return source >= PURE_PURSUIT;
+}
+
+// What happened during one MPC::Solve.
+struct SolveStats {
+  // Wall time of each phase in microseconds. Taping and sparsity only
+  // happen when a solver is created, so they are non-zero on its first
+  // solve only.
+  double taping_us = 0;
+  double sparsity_us = 0;
+  double solve_us = 0;
+  double extraction_us = 0;
+  double total_us = 0;
+
+  // Ipopt iterations, or active set iterations for the SQP backend
+  int iterations = 0;
+
+  // Ipopt::ApplicationReturnStatus, the SQP backend reports
+  // Solve_Succeeded (0) or Maximum_Iterations_Exceeded (-1). ok when it
+  // converged, to tol or to Ipopt's acceptable level.
+  int status = 0;
+  bool ok = false;
+
+  // Whether the solver stopped at MPC_Config::deadline
+  bool deadline_hit = false;
+
+  ActuationSource source = SOLVER_PLAN;
+
+  // Largest constraint violation of the returned solution, and its cost
+  double constraint_violation = 0;
+  double objective = 0;
+};
+
+// Aggregate over a window of solves
+struct StatsSummary {
+  size_t count = 0;
+  size_t failures = 0;
+
+  // Problems answered from an explicit table
+  size_t table_lookups = 0;
+
+  // Solves that stopped at the deadline, and the ones whose actuations
+  // didn't come from a converged plan, by ActuationSource
+  size_t deadlines = 0;
+  size_t best_iterates = 0;
+  size_t pure_pursuits = 0;
+  size_t shifted_plans = 0;
+  size_t stops = 0;
+
+  // Total latency percentiles in microseconds
+  double p50_us = 0;
+  double p99_us = 0;
+  double max_us = 0;
+
+  // Latency of the solver iterations alone
+  double solve_p50_us = 0;
+  double solve_p99_us = 0;
+
+  double mean_iterations = 0;
+  int max_iterations = 0;
+};
+
+StatsSummary Summarize(const vector<SolveStats>& stats);
+
+// Nearest rank percentile, p in [0, 1], of values sorted ascending
+double Percentile(const vector<double>& sorted, double p);
+
+ostream& operator<<(ostream& os, const StatsSummary& summary);
+
+// Microseconds since `start`
+inline double ElapsedMicros(chrono::steady_clock::time_point start) {
+  return chrono::duration<double, micro>(chrono::steady_clock::now() - start)
+      .count();
+}
+
+// Fixed size ring of the most recent records.
+//
+// Push never blocks or allocates and may be called from several threads
+// at once (SolveBatch workers). Each slot carries a sequence number that
+// is odd while the slot is being written, so Snapshot can skip slots it
+// would otherwise read half written.
+template <class T, size_t Capacity>
+class StatsRing {
+ public:
+  StatsRing() : head_(0) {
+    for (size_t i = 0; i < Capacity; i++) {
+      slots_[i].seq.store(0, memory_order_relaxed);
+    }
+  }
+
+  void Push(const T& value) {
+    uint64_t i = head_.fetch_add(1, memory_order_relaxed);
+    Slot& slot = slots_[i % Capacity];
+    slot.seq.store(2 * i + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    slot.value = value;
+    slot.seq.store(2 * i + 2, memory_order_release);
+  }
+
+  // Copies up to Capacity of the most recent records into out,
+  // oldest first
+  void Snapshot(vector<T>& out) const {
+    out.clear();
+    uint64_t head = head_.load(memory_order_acquire);
+    uint64_t first = head > Capacity ? head - Capacity : 0;
+    for (uint64_t i = first; i < head; i++) {
+      const Slot& slot = slots_[i % Capacity];
+      uint64_t before = slot.seq.load(memory_order_acquire);
+      if (before != 2 * i + 2) {
+        continue;
+      }
+      T value = slot.value;
+      atomic_thread_fence(memory_order_acquire);
+      if (slot.seq.load(memory_order_relaxed) == before) {
+        out.push_back(value);
+      }
+    }
+  }
+
+  // Number of records pushed so far
+  uint64_t count() const { return head_.load(memory_order_relaxed); }
+
+ private:
+  struct Slot {
+    atomic<uint64_t> seq;
+    T value;
+  };
+
+  Slot slots_[Capacity];
+  atomic<uint64_t> head_;
+};
+
+#endif /* SOLVE_STATS_H */
@@ -0,0 +1,173 @@
+#include "SolverWorker.h"
+#include <algorithm>
+#include <sstream>
+#include "Connection.h"
+#include "Logger.h"
+#include "Protocol.h"
+
+SolverWorker::SolverWorker(uv_loop_t* loop, const MPC_Config& config,
+                           MPC::Backend backend, Recorder* recorder,
+                           shared_ptr<const MPC_Table> table)
+    : config_(config), backend_(backend), recorder_(recorder), table_(table) {
+  uv_async_init(loop, &replies_async_, OnReplies);
+  replies_async_.data = this;
+  thread_ = thread(&SolverWorker::Run, this);
+}
+
+SolverWorker::~SolverWorker() {
+  stop_ = true;
+  Wake();
+  thread_.join();
+  uv_close(reinterpret_cast<uv_handle_t*>(&replies_async_), nullptr);
+}
+
+shared_ptr<SolverSlot> SolverWorker::Open(Connection* connection) {
+  shared_ptr<SolverSlot> slot(new SolverSlot);
+  slot->connection = connection;
+  slot->id = next_id_++;
+  lock_guard<mutex> lock(slots_mutex_);
+  slots_.push_back(slot);
+  version_++;
+  return slot;
+}
+
+void SolverWorker::Close(const shared_ptr<SolverSlot>& slot) {
+  // The worker drops the slot, and its MPC, the next time it looks
+  slot->connection = nullptr;
+  slot->closed = true;
+  Wake();
+}
+
+void SolverWorker::Post(SolverSlot& slot) {
+  Frame& frame = slot.frames.back();
+  frame.number = slot.frames_posted++;
+  if (recorder_) {
+    recorder_->WriteTelemetry(slot.id, frame.number, frame.telemetry);
+  }
+  if (slot.frames.Publish()) {
+    slot.dropped++;
+  }
+  Wake();
+}
+
+void SolverWorker::SetConfig(const MPC_Config& config) {
+  lock_guard<mutex> lock(config_mutex_);
+  config_ = config;
+  config_version_++;
+}
+
+void SolverWorker::Wake() {
+  wake_ = true;
+  if (sleeping_) {
+    lock_guard<mutex> lock(wake_mutex_);
+    wake_cv_.notify_one();
+  }
+}
+
+void SolverWorker::Run() {
+  vector<shared_ptr<SolverSlot>> slots;
+  uint64_t version = ~uint64_t(0);
+  while (!stop_) {
+    wake_ = false;
+    if (version != version_) {
+      lock_guard<mutex> lock(slots_mutex_);
+      slots = slots_;
+      version = version_;
+    }
+
+    bool worked = false;
+    for (auto& slot : slots) {
+      if (slot->closed) {
+        // Free the solver here, on the thread that owns it
+        slot->pipeline.reset();
+        slot->mpc.reset();
+        lock_guard<mutex> lock(slots_mutex_);
+        slots_.erase(remove(slots_.begin(), slots_.end(), slot),
+                     slots_.end());
+        version_++;
+        continue;
+      }
+      if (Solve(*slot)) {
+        worked = true;
+      }
+    }
+    if (worked) {
+      uv_async_send(&replies_async_);
+      continue;
+    }
+
+    // Nothing new anywhere, sleep until a frame comes in
+    unique_lock<mutex> lock(wake_mutex_);
+    sleeping_ = true;
+    wake_cv_.wait(lock, [this] { return wake_ || stop_; });
+    sleeping_ = false;
+  }
+}
+
+bool SolverWorker::Solve(SolverSlot& slot) {
+  if (!slot.frames.Take()) {
+    return false;
+  }
+  const Frame& frame = slot.frames.front();
+  if (!slot.mpc || slot.config_version != config_version_) {
+    MPC_Config config;
+    {
+      lock_guard<mutex> lock(config_mutex_);
+      config = config_;
+      slot.config_version = config_version_;
+    }
+    slot.pipeline.reset();
+    slot.mpc.reset(new MPC(config));
+    slot.mpc->SetWarmStart(true);
+    slot.mpc->SetBackend(backend_);
+    if (table_ && !slot.mpc->SetTable(table_)) {
+      Log(LOG_WARN, LOG_GENERAL,
+          "The table was solved for other settings or with the other "
+          "backend, connection %u solves every frame",
+          slot.id);
+    }
+    slot.pipeline.reset(new Pipeline(*slot.mpc));
+
+    // The recording header has the settings the server started with
+    if (recorder_ && slot.config_version != 0) {
+      recorder_->WriteConfig(slot.id, frame.number, config);
+    }
+  }
+
+  slot.pipeline->Run(frame.telemetry, slot.actuation);
+  if (recorder_) {
+    recorder_->WriteActuation(slot.id, frame.number, slot.actuation);
+  }
+  Log(LOG_DEBUG, LOG_COST, "Cost %g, %s", slot.mpc->cost(),
+      ActuationSourceName(slot.actuation.source));
+  if (IsFallback(slot.actuation.source)) {
+    Log(LOG_WARN, LOG_GENERAL, "Solve of frame %llu failed, steering by %s",
+        (unsigned long long)frame.number,
+        ActuationSourceName(slot.actuation.source));
+  }
+
+  // Latency summary over the last solves every 100 messages
+  if (slot.mpc->solve_count() % 100 == 0 && LogEnabled(LOG_INFO, LOG_STATS)) {
+    ostringstream summary;
+    summary << "MPC " << slot.mpc->Summary() << " | dropped frames "
+            << slot.dropped;
+    const string& line = summary.str();
+    LogText(LOG_INFO, LOG_STATS, line.data(), line.size());
+  }
+
+  WriteSteerMessage(slot.actuation, slot.replies.back());
+  const string& reply = slot.replies.back();
+  LogText(LOG_DEBUG, LOG_STEER, reply.data(), reply.size());
+  slot.replies.Publish();
+  return true;
+}
+
+void SolverWorker::OnReplies(uv_async_t* async) {
+  SolverWorker* worker = static_cast<SolverWorker*>(async->data);
+  lock_guard<mutex> lock(worker->slots_mutex_);
+  for (auto& slot : worker->slots_) {
+    if (slot->connection && slot->replies.Take()) {
+      slot->connection->OnReply(slot->replies.front());
+    }
+  }
+}
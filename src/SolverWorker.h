@@ -0,0 +1,139 @@
+#ifndef SOLVER_WORKER_H
+#define SOLVER_WORKER_H
+
+#include <uv.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "LatestMailbox.h"
+#include "MPC.h"
+#include "MPC_Table.h"
+#include "Pipeline.h"
+#include "Recording.h"
+
+using namespace std;
+
+class Connection;
+
+// A telemetry message and its number within the connection
+struct Frame {
+  Telemetry telemetry;
+  uint64_t number = 0;
+};
+
+// One connection's side of the solver worker
+struct SolverSlot {
+  // Parsed telemetry from the event loop, and steer messages back to it.
+  // Both keep only the newest value, so the worker always controls on
+  // the freshest state and the loop always sends the freshest answer.
+  LatestMailbox<Frame> frames;
+  LatestMailbox<string> replies;
+
+  // Number of the connection in the recording
+  uint32_t id = 0;
+
+  // Telemetry replaced before the worker got to it
+  atomic<uint64_t> dropped{0};
+
+  // Set by the event loop when the connection goes away
+  atomic<bool> closed{false};
+
+  // Event loop thread only
+  Connection* connection = nullptr;
+  uint64_t frames_posted = 0;
+
+  // Worker thread only, created on the first frame and again after the
+  // settings changed
+  unique_ptr<MPC> mpc;
+  unique_ptr<Pipeline> pipeline;
+  uint64_t config_version = 0;
+  Actuation actuation;
+};
+
+// Runs the controller for every connection on one thread, off the event
+// loop.
+//
+// The event loop parses telemetry into a connection's slot and returns
+// straight away. The worker picks up the newest frame of each slot, runs
+// Pipeline on it and posts the steer message back with a uv_async, whose
+// callback runs on the loop and hands it to the connection.
+//
+// A single thread owns all MPC instances (creation, solves and
+// destruction). CppAD gives every thread number its own memory and any
+// thread outside ThreadPool counts as number 0, and the Ipopt calls are
+// serialized anyway, so more solver threads wouldn't solve any faster.
+class SolverWorker {
+ public:
+  // Must be created on the event loop thread. When a recorder is given,
+  // every posted frame and every actuation goes into it. When a table is
+  // given, every MPC answers the problems it covers from it, as long as
+  // the settings match the ones it was solved with.
+  SolverWorker(uv_loop_t* loop, const MPC_Config& config,
+               MPC::Backend backend, Recorder* recorder = nullptr,
+               shared_ptr<const MPC_Table> table = nullptr);
+
+  virtual ~SolverWorker();
+
+  // Registers a connection, event loop thread only
+  shared_ptr<SolverSlot> Open(Connection* connection);
+
+  // Unregisters a connection, event loop thread only. Its MPC is freed
+  // by the worker.
+  void Close(const shared_ptr<SolverSlot>& slot);
+
+  // Numbers and publishes slot.frames.back() and wakes the worker
+  void Post(SolverSlot& slot);
+
+  // Replaces the solver settings, any thread. Every connection switches
+  // to a new MPC with them before its next solve; a solve only pays for
+  // checking a version number.
+  void SetConfig(const MPC_Config& config);
+
+ private:
+  void Run();
+
+  // Solves the newest frame of a slot, returns false if there was none
+  bool Solve(SolverSlot& slot);
+
+  // Wakes the worker up if it is waiting
+  void Wake();
+
+  // uv_async callback, hands the replies to the connections
+  static void OnReplies(uv_async_t* async);
+
+  // Solver settings, config_version_ counts the changes
+  mutex config_mutex_;
+  MPC_Config config_;
+  atomic<uint64_t> config_version_{0};
+
+  const MPC::Backend backend_;
+  Recorder* recorder_;
+  const shared_ptr<const MPC_Table> table_;
+
+  // Open connections. The worker works on a copy that it refreshes when
+  // version_ changes.
+  mutex slots_mutex_;
+  vector<shared_ptr<SolverSlot>> slots_;
+  atomic<uint64_t> version_{0};
+
+  // Event loop thread only, ids handed out to connections
+  uint32_t next_id_ = 0;
+
+  uv_async_t replies_async_;
+
+  // Wakeup, the worker only sleeps when no slot has a new frame
+  mutex wake_mutex_;
+  condition_variable wake_cv_;
+  atomic<bool> wake_{false};
+  atomic<bool> sleeping_{false};
+  atomic<bool> stop_{false};
+
+  thread thread_;
+};
+
+#endif /* SOLVER_WORKER_H */
@@ -0,0 +1,102 @@
+#include "ThreadPool.h"
+
+static thread_local size_t thread_number = 0;
+static atomic<int> loops_running(0);
+
+ThreadPool::ThreadPool(size_t num_threads)
+    : job_(nullptr),
+      count_(0),
+      pinned_(false),
+      next_(0),
+      busy_workers_(0),
+      generation_(0),
+      stop_(false) {
+  for (size_t i = 0; i < num_threads; i++) {
+    workers_.emplace_back(&ThreadPool::WorkerLoop, this, i + 1);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    lock_guard<mutex> lock(mutex_);
+    stop_ = true;
+  }
+  work_cv_.notify_all();
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+}
+
+size_t ThreadPool::ThreadNumber() { return thread_number; }
+
+bool ThreadPool::InParallel() { return loops_running.load() > 0; }
+
+void ThreadPool::ParallelFor(size_t count, const function<void(size_t)>& f) {
+  Run(count, f, false);
+}
+
+void ThreadPool::ParallelForPinned(size_t count,
+                                   const function<void(size_t)>& f) {
+  Run(count, f, true);
+}
+
+void ThreadPool::Run(size_t count, const function<void(size_t)>& f,
+                     bool pinned) {
+  if (count == 0) {
+    return;
+  }
+  lock_guard<mutex> run_lock(run_mutex_);
+  loops_running++;
+  {
+    unique_lock<mutex> lock(mutex_);
+    job_ = &f;
+    count_ = count;
+    pinned_ = pinned;
+    next_ = 0;
+    busy_workers_ = workers_.size();
+    generation_++;
+    work_cv_.notify_all();
+    done_cv_.wait(lock, [this] { return busy_workers_ == 0; });
+    job_ = nullptr;
+  }
+  loops_running--;
+}
+
+void ThreadPool::WorkerLoop(size_t number) {
+  thread_number = number;
+  uint64_t seen_generation = 0;
+  while (true) {
+    const function<void(size_t)>* job;
+    size_t count;
+    bool pinned;
+    {
+      unique_lock<mutex> lock(mutex_);
+      work_cv_.wait(lock,
+                    [&] { return stop_ || generation_ != seen_generation; });
+      if (stop_) {
+        return;
+      }
+      seen_generation = generation_;
+      job = job_;
+      count = count_;
+      pinned = pinned_;
+    }
+
+    if (pinned) {
+      for (size_t i = number - 1; i < count; i += workers_.size()) {
+        (*job)(i);
+      }
+    } else {
+      for (size_t i = next_++; i < count; i = next_++) {
+        (*job)(i);
+      }
+    }
+
+    {
+      lock_guard<mutex> lock(mutex_);
+      if (--busy_workers_ == 0) {
+        done_cv_.notify_one();
+      }
+    }
+  }
+}
@@ -0,0 +1,66 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Fixed set of worker threads that run parallel loops.
+//
+// Each worker has a stable thread number 1..size(), threads outside the
+// pool are number 0. CppAD uses these numbers to give every thread its own
+// memory pool (see SetupParallelAD in MPC_Horizon.h).
+class ThreadPool {
+ public:
+  explicit ThreadPool(size_t num_threads);
+
+  virtual ~ThreadPool();
+
+  size_t size() const { return workers_.size(); }
+
+  // Runs f(i) for every i in [0, count) on the workers and returns once all
+  // of them are done. Indices are handed out one at a time, so uneven work
+  // balances itself. Only one loop runs at a time, concurrent callers wait.
+  void ParallelFor(size_t count, const function<void(size_t)>& f);
+
+  // Like ParallelFor, but i always runs on worker number i % size() + 1,
+  // for state that has to stay on one thread (CppAD's per-thread memory).
+  // The work doesn't balance itself.
+  void ParallelForPinned(size_t count, const function<void(size_t)>& f);
+
+  // Number of the calling thread, 0 unless it is a pool worker
+  static size_t ThreadNumber();
+
+  // Whether any pool is running a parallel loop right now
+  static bool InParallel();
+
+ private:
+  void Run(size_t count, const function<void(size_t)>& f, bool pinned);
+
+  void WorkerLoop(size_t number);
+
+  vector<thread> workers_;
+
+  // Serializes ParallelFor callers
+  mutex run_mutex_;
+
+  // Current loop, protected by mutex_
+  mutex mutex_;
+  condition_variable work_cv_;
+  condition_variable done_cv_;
+  const function<void(size_t)>* job_;
+  size_t count_;
+  bool pinned_;
+  atomic<size_t> next_;
+  size_t busy_workers_;
+  uint64_t generation_;
+  bool stop_;
+};
+
+#endif /* THREAD_POOL_H */
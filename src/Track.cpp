@@ -0,0 +1,76 @@
+#include "Track.h"
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+
+bool Track::Load(const string& path) {
+  xs_.clear();
+  ys_.clear();
+  ifstream in(path);
+  string line;
+  // Skip the x,y header
+  if (!getline(in, line)) {
+    return false;
+  }
+  while (getline(in, line)) {
+    double x, y;
+    if (sscanf(line.c_str(), "%lf,%lf", &x, &y) == 2) {
+      xs_.push_back(x);
+      ys_.push_back(y);
+    }
+  }
+  if (xs_.size() < 7) {
+    return false;
+  }
+
+  s_.assign(1, 0.0);
+  for (size_t i = 0; i < xs_.size(); i++) {
+    size_t j = (i + 1) % xs_.size();
+    s_.push_back(s_.back() + hypot(xs_[j] - xs_[i], ys_[j] - ys_[i]));
+  }
+  return true;
+}
+
+double Track::Heading(size_t i) const {
+  size_t j = (i + 1) % xs_.size();
+  return atan2(ys_[j] - ys_[i], xs_[j] - xs_[i]);
+}
+
+void Track::Project(double x, double y, size_t& segment, double& s,
+                    double& cte) const {
+  const size_t n = xs_.size();
+  double best = INFINITY;
+  size_t best_segment = segment;
+  // Look one segment back and a few ahead of the hint
+  for (size_t k = 0; k < 5; k++) {
+    size_t i = (segment + n - 1 + k) % n;
+    size_t j = (i + 1) % n;
+    double dx = xs_[j] - xs_[i];
+    double dy = ys_[j] - ys_[i];
+    double len2 = dx * dx + dy * dy;
+    double f = ((x - xs_[i]) * dx + (y - ys_[i]) * dy) / len2;
+    f = fmin(1.0, fmax(0.0, f));
+    double px = x - (xs_[i] + f * dx);
+    double py = y - (ys_[i] + f * dy);
+    double d = hypot(px, py);
+    if (d < best) {
+      best = d;
+      best_segment = i;
+      s = s_[i] + f * (s_[i + 1] - s_[i]);
+      // Left of the direction of travel is positive
+      cte = (dx * py - dy * px) >= 0 ? d : -d;
+    }
+  }
+  segment = best_segment;
+}
+
+void Track::Waypoints(size_t segment, size_t count, vector<double>& ptsx,
+                  vector<double>& ptsy) const {
+  const size_t n = xs_.size();
+  ptsx.clear();
+  ptsy.clear();
+  for (size_t k = 0; k < count; k++) {
+    ptsx.push_back(xs_[(segment + k) % n]);
+    ptsy.push_back(ys_[(segment + k) % n]);
+  }
+}
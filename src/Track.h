@@ -0,0 +1,52 @@
+#ifndef TRACK_H
+#define TRACK_H
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// A closed track given by its center line waypoints, as in
+// lake_track_waypoints.csv. The center line is the polyline through the
+// waypoints in file order, which is also the driving direction.
+class Track {
+ public:
+  // Reads the x,y columns of a waypoint file. Returns false if the file
+  // can't be read or has too few waypoints to drive on.
+  bool Load(const string& path);
+
+  size_t size() const { return xs_.size(); }
+  const vector<double>& xs() const { return xs_; }
+  const vector<double>& ys() const { return ys_; }
+
+  // Length of one lap along the center line
+  double length() const { return s_.back(); }
+
+  // Heading of the segment from waypoint i to the next one
+  double Heading(size_t i) const;
+
+  // Closest point on the center line to (x, y). Only the segments within
+  // a few waypoints of `segment` are searched, so pass the last result
+  // back in when following a car. Updates segment, and returns the
+  // distance along the track in s and the signed distance to the center
+  // line (positive to the left) in cte.
+  void Project(double x, double y, size_t& segment, double& s,
+               double& cte) const;
+
+  // `count` waypoints starting at the one behind the car on segment.
+  // That is what the Unity simulator sends with every telemetry message;
+  // with the closest waypoint behind the car the polynomial fit
+  // interpolates at the car instead of extrapolating back to it.
+  void Waypoints(size_t segment, size_t count, vector<double>& ptsx,
+                 vector<double>& ptsy) const;
+
+ private:
+  vector<double> xs_;
+  vector<double> ys_;
+
+  // Distance along the center line to each waypoint, with one extra
+  // entry for the closing segment
+  vector<double> s_;
+};
+
+#endif /* TRACK_H */
@@ -0,0 +1,534 @@
+// Offline benchmark of the controller.
+//
+// Feeds telemetry frames through the same Pipeline the websocket server
+// uses (parse, transform, polyfit, latency prediction, MPC::Solve,
+// steer message) in a tight loop and reports throughput and a latency
+// histogram per stage. Needs no simulator and no network.
+//
+// Frames come from a file with one message per line, either the raw
+// "42[\"telemetry\",{...}]" websocket message or the bare JSON object of
+// DATA.md. Without a file they are synthesized from the track waypoints.
+//
+// --recording replays a recording made with `mpc --record` instead: every
+// message the server solved goes through a Pipeline per connection, with
+// the recorded solver settings unless --sqp, --analytic, --compiled,
+// --linear-solver, --N or --cold override them, and the actuations are
+// checked bit for bit against the recorded ones. Settings the server
+// reloaded during the recording are picked up where they were reloaded.
+// Where an Ipopt solve stops at its deadline depends on how fast the
+// machine is and how busy, so the check replays without a deadline and
+// only holds if no solve of the server hit its deadline either (the
+// "deadlines" count of its stats summary).
+// --config replaces all of the recorded settings with the ones of a
+// config file (see ConfigFile.h), the reloads included.
+//
+// --table answers the problems an explicit MPC table covers from it (see
+// MPC_Table.h). A recording made with `mpc --table` only replays bit for
+// bit with the same table.
+//
+//   ./mpc_bench [--frames FILE | --recording FILE] [--waypoints FILE]
+//               [--iterations K] [--config FILE] [--table FILE] [--sqp]
+//               [--analytic | --compiled] [--linear-solver NAME]
+//               [--N 10|15|20|25] [--cold]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "ConfigFile.h"
+#include "MPC.h"
+#include "MPC_Table.h"
+#include "Pipeline.h"
+#include "SolveStats.h"
+#include "Protocol.h"
+#include "Recording.h"
+#include "Track.h"
+#include "json.hpp"
+
+using json = nlohmann::json;
+
+// Latency samples of one stage
+class StageTimes {
+ public:
+  explicit StageTimes(const string& name) : name_(name) {}
+
+  void Add(double us) { samples_.push_back(us); }
+
+  void Report(ostream& os) {
+    if (samples_.empty()) {
+      return;
+    }
+    sort(samples_.begin(), samples_.end());
+    double sum = 0;
+    for (double us : samples_) {
+      sum += us;
+    }
+    char line[160];
+    snprintf(line, sizeof(line),
+             "%-10s mean %9.2f  p50 %9.2f  p90 %9.2f  p99 %9.2f  max %9.2f us",
+             name_.c_str(), sum / samples_.size(),
+             Percentile(samples_, 0.50), Percentile(samples_, 0.90),
+             Percentile(samples_, 0.99), samples_.back());
+    os << line << endl;
+
+    // Power of two buckets, 1us, 2us, 4us, ...
+    vector<size_t> buckets;
+    for (double us : samples_) {
+      size_t b = us < 1.0 ? 0 : size_t(log2(us)) + 1;
+      if (b >= buckets.size()) {
+        buckets.resize(b + 1, 0);
+      }
+      buckets[b]++;
+    }
+    size_t largest = *max_element(buckets.begin(), buckets.end());
+    for (size_t b = 0; b < buckets.size(); b++) {
+      if (buckets[b] == 0) {
+        continue;
+      }
+      size_t width = (buckets[b] * 50 + largest - 1) / largest;
+      snprintf(line, sizeof(line), "  < %8.0f us %8zu %s", ldexp(1.0, b),
+               buckets[b], string(width, '#').c_str());
+      os << line << endl;
+    }
+  }
+
+ private:
+  string name_;
+  vector<double> samples_;
+};
+
+// Reads the recorded messages, one per line
+static vector<string> LoadFrames(const string& path) {
+  vector<string> frames;
+  ifstream in(path);
+  string line;
+  while (getline(in, line)) {
+    if (!line.empty()) {
+      frames.push_back(line);
+    }
+  }
+  return frames;
+}
+
+// Telemetry messages for a car driving along the track, wandering a bit
+// around the center line with a varying speed. The simulator sends the
+// next six waypoints with every message, so do the same.
+static vector<string> SynthesizeFrames(const Track& track, size_t count) {
+  const vector<double>& xs = track.xs();
+  const vector<double>& ys = track.ys();
+  const size_t n = xs.size();
+  vector<string> frames;
+  for (size_t k = 0; k < count; k++) {
+    // Ten frames per track segment
+    size_t i = (k / 10) % n;
+    size_t j = (i + 1) % n;
+    double f = (k % 10) / 10.0;
+    double heading = track.Heading(i);
+    double offset = 1.5 * sin(0.05 * k);
+
+    Telemetry t;
+    t.x = xs[i] + f * (xs[j] - xs[i]) - offset * sin(heading);
+    t.y = ys[i] + f * (ys[j] - ys[i]) + offset * cos(heading);
+    t.psi = heading + 0.05 * sin(0.13 * k);
+    t.speed = 60.0 + 35.0 * sin(0.01 * k);
+    t.steering_angle = 0.05 * sin(0.07 * k);
+    t.throttle = 0.5 + 0.4 * cos(0.03 * k);
+    track.Waypoints(i, 6, t.ptsx, t.ptsy);
+
+    json data;
+    data["ptsx"] = t.ptsx;
+    data["ptsy"] = t.ptsy;
+    data["x"] = t.x;
+    data["y"] = t.y;
+    data["psi"] = t.psi;
+    data["psi_unity"] = pi() / 2 - t.psi;
+    data["speed"] = t.speed;
+    data["steering_angle"] = t.steering_angle;
+    data["throttle"] = t.throttle;
+    frames.push_back("42[\"telemetry\"," + data.dump() + "]");
+  }
+  return frames;
+}
+
+static bool SameDoubles(const vector<double>& a, const vector<double>& b) {
+  return a.size() == b.size() &&
+         memcmp(a.data(), b.data(), a.size() * sizeof(double)) == 0;
+}
+
+// Whether two actuations are identical bit for bit
+static bool SameActuation(const Actuation& a, const Actuation& b) {
+  return memcmp(&a.steer_value, &b.steer_value, sizeof(double)) == 0 &&
+         memcmp(&a.throttle_value, &b.throttle_value, sizeof(double)) == 0 &&
+         SameDoubles(a.mpc_x, b.mpc_x) && SameDoubles(a.mpc_y, b.mpc_y) &&
+         SameDoubles(a.next_x, b.next_x) && SameDoubles(a.next_y, b.next_y);
+}
+
+// The controller of one recorded connection
+struct ReplayConnection {
+  MPC_Config config;
+  unique_ptr<MPC> mpc;
+  unique_ptr<Pipeline> pipeline;
+
+  // Telemetry records not answered yet, oldest first
+  deque<const RecordHeader*> frames;
+};
+
+// Solver settings given on the command line
+struct Overrides {
+  bool N = false;
+  bool backend = false;
+  bool derivatives = false;
+  bool warm_start = false;
+  bool linear_solver = false;
+  bool config = false;
+
+  bool any() const {
+    return N || backend || derivatives || warm_start || linear_solver ||
+           config;
+  }
+};
+
+// The settings of a recording with the ones given on the command line
+static MPC_Config Override(const MPC_Config& recorded,
+                           const MPC_Config& config, const Overrides& given) {
+  if (given.config) {
+    return config;
+  }
+  MPC_Config result = recorded;
+  if (given.N) {
+    result.N = config.N;
+  }
+  if (given.derivatives) {
+    result.derivatives = config.derivatives;
+  }
+  if (given.linear_solver) {
+    result.linear_solver = config.linear_solver;
+  }
+  return result;
+}
+
+static string SolverName(MPC::Backend backend, const MPC_Config& config) {
+  string name = backend == MPC::SQP
+                    ? string("SQP")
+                    : string("Ipopt, ") +
+                          DerivativeModeName(config.derivatives) +
+                          " derivatives";
+  if (config.linear_solver != DEFAULT_SOLVER) {
+    name += string(", ") + LinearSolverName(config.linear_solver);
+  }
+  return name;
+}
+
+// Replays a recording, see the top of the file. Returns the exit code.
+// The settings that weren't given come from the recording.
+static int ReplayRecording(const string& path, const MPC_Config& config,
+                           MPC::Backend backend, bool warm_start,
+                           const Overrides& given,
+                           const shared_ptr<const MPC_Table>& table) {
+  Recording recording;
+  if (!recording.Open(path)) {
+    cerr << "Failed to read recording " << path << endl;
+    return 1;
+  }
+  const RecordingHeader& header = recording.header();
+  MPC_Config replay_config = Override(header.config, config, given);
+  MPC::Backend replay_backend =
+      given.backend ? backend : MPC::Backend(header.backend);
+  bool replay_warm_start =
+      given.warm_start ? warm_start : header.warm_start != 0;
+
+  StageTimes solve("solve");
+  StageTimes total("total");
+  map<uint32_t, ReplayConnection> connections;
+  Telemetry telemetry;
+  Actuation recorded;
+  Actuation actuation;
+  PipelineTimes times;
+  size_t frames = 0;
+  size_t replayed = 0;
+  size_t matched = 0;
+  size_t unanswered = 0;
+  MPC_Config reloaded;
+  bool table_mismatch = false;
+  const RecordHeader* record;
+  auto bench_start = chrono::steady_clock::now();
+  while (recording.Next(record)) {
+    auto inserted =
+        connections.insert(make_pair(record->connection, ReplayConnection()));
+    ReplayConnection& connection = inserted.first->second;
+    if (inserted.second) {
+      connection.config = replay_config;
+    }
+    if (record->type == TELEMETRY_RECORD) {
+      connection.frames.push_back(record);
+      frames++;
+      continue;
+    }
+    if (Recording::Read(*record, reloaded)) {
+      // The server rebuilt its solver, so the replay does too
+      if (!given.config) {
+        connection.config = Override(reloaded, config, given);
+      }
+      connection.pipeline.reset();
+      connection.mpc.reset();
+      continue;
+    }
+    if (record->type != ACTUATION_RECORD ||
+        !Recording::Read(*record, recorded)) {
+      continue;
+    }
+
+    // Frames before the answered one were replaced in the mailbox before
+    // the solver got to them
+    while (!connection.frames.empty() &&
+           connection.frames.front()->frame < record->frame) {
+      connection.frames.pop_front();
+      unanswered++;
+    }
+    if (connection.frames.empty() ||
+        connection.frames.front()->frame != record->frame ||
+        !Recording::Read(*connection.frames.front(), telemetry)) {
+      cerr << "Recording has no telemetry for frame " << record->frame
+           << " of connection " << record->connection << endl;
+      return 1;
+    }
+    connection.frames.pop_front();
+
+    if (!connection.mpc) {
+      // A replay that is checked doesn't stop at the deadline, see the
+      // top of the file
+      MPC_Config solve_config = connection.config;
+      if (!given.any()) {
+        solve_config.deadline = INFINITY;
+      }
+      string error;
+      if (!MPC::Supports(solve_config, error)) {
+        cerr << error << endl;
+        return 1;
+      }
+      connection.mpc.reset(new MPC(solve_config));
+      connection.mpc->SetWarmStart(replay_warm_start);
+      connection.mpc->SetBackend(replay_backend);
+      if (table && !connection.mpc->SetTable(table) && !table_mismatch) {
+        cerr << "The table was solved for other settings or with the other "
+             << "backend than connection "
+             << record->connection << ", it solves online" << endl;
+        table_mismatch = true;
+      }
+      connection.pipeline.reset(new Pipeline(*connection.mpc));
+    }
+    auto start = chrono::steady_clock::now();
+    connection.pipeline->Run(telemetry, actuation, &times);
+    total.Add(ElapsedMicros(start));
+    solve.Add(times.solve_us);
+    replayed++;
+    if (SameActuation(actuation, recorded)) {
+      matched++;
+    }
+  }
+  for (auto& connection : connections) {
+    unanswered += connection.second.frames.size();
+  }
+  double seconds = ElapsedMicros(bench_start) * 1e-6;
+
+  cout << "Recording " << path << ": " << connections.size()
+       << " connections, " << frames << " frames, " << unanswered
+       << " not solved by the server" << endl;
+  cout << "Backend " << SolverName(replay_backend, replay_config) << ", N "
+       << replay_config.N << ", " << (replay_warm_start ? "warm" : "cold")
+       << " start" << (given.any() ? " (overridden)" : "") << endl;
+  cout << replayed << " messages in " << seconds << " s, "
+       << replayed / seconds << " messages/s, " << matched
+       << " actuations identical to the recording" << endl << endl;
+  solve.Report(cout);
+  total.Report(cout);
+
+  // With the recorded settings any difference is a reproducibility bug
+  return !given.any() && matched != replayed ? 1 : 0;
+}
+
+int main(int argc, char* argv[]) {
+  string frames_path;
+  string recording_path;
+  string waypoints_path = "../lake_track_waypoints.csv";
+  size_t iterations = 2000;
+  bool use_sqp = false;
+  bool warm_start = true;
+  MPC_Config config;
+  string table_path;
+
+  // They override the settings of a recording
+  Overrides given;
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (arg == "--frames" && i + 1 < argc) {
+      frames_path = argv[++i];
+    } else if (arg == "--recording" && i + 1 < argc) {
+      recording_path = argv[++i];
+    } else if (arg == "--waypoints" && i + 1 < argc) {
+      waypoints_path = argv[++i];
+    } else if (arg == "--iterations" && i + 1 < argc) {
+      if (!ParseCount(argv[++i], iterations)) {
+        cerr << "Bad value for " << arg << ": " << argv[i] << endl;
+        return 1;
+      }
+    } else if (arg == "--config" && i + 1 < argc) {
+      string error;
+      if (!LoadConfigFile(argv[++i], config, error)) {
+        cerr << error << endl;
+        return 1;
+      }
+      given.config = true;
+    } else if (arg == "--table" && i + 1 < argc) {
+      table_path = argv[++i];
+    } else if (arg == "--N" && i + 1 < argc) {
+      if (!ParseCount(argv[++i], config.N)) {
+        cerr << "Bad value for " << arg << ": " << argv[i] << endl;
+        return 1;
+      }
+      given.N = true;
+    } else if (arg == "--sqp") {
+      use_sqp = true;
+      given.backend = true;
+    } else if (arg == "--analytic") {
+      config.derivatives = ANALYTIC_DERIVATIVES;
+      given.derivatives = true;
+    } else if (arg == "--compiled") {
+      config.derivatives = COMPILED_DERIVATIVES;
+      given.derivatives = true;
+    } else if (arg == "--cold") {
+      warm_start = false;
+      given.warm_start = true;
+    } else if (arg == "--linear-solver" && i + 1 < argc &&
+               ParseLinearSolver(argv[i + 1], config.linear_solver)) {
+      i++;
+      given.linear_solver = true;
+    } else {
+      cerr << "Unknown argument " << arg << endl;
+      return 1;
+    }
+  }
+
+  shared_ptr<MPC_Table> table;
+  if (!table_path.empty()) {
+    table.reset(new MPC_Table);
+    string error;
+    if (!table->Open(table_path, error)) {
+      cerr << error << endl;
+      return 1;
+    }
+  }
+
+  MPC::Backend backend = use_sqp ? MPC::SQP : MPC::IPOPT;
+  if (!recording_path.empty()) {
+    return ReplayRecording(recording_path, config, backend, warm_start,
+                           given, table);
+  }
+
+  vector<string> frames;
+  if (!frames_path.empty()) {
+    frames = LoadFrames(frames_path);
+  } else {
+    Track track;
+    if (!track.Load(waypoints_path)) {
+      cerr << "Failed to read waypoints from " << waypoints_path << endl;
+      return 1;
+    }
+    frames = SynthesizeFrames(track, 10 * track.size());
+  }
+  if (frames.empty()) {
+    cerr << "No frames to replay" << endl;
+    return 1;
+  }
+
+  string error;
+  if (!MPC::Supports(config, error)) {
+    cerr << error << endl;
+    return 1;
+  }
+  MPC mpc(config);
+  mpc.SetWarmStart(warm_start);
+  mpc.SetBackend(backend);
+  if (table && !mpc.SetTable(table)) {
+    cerr << table_path << " was solved for other settings or with "
+         << "the other backend" << endl;
+    return 1;
+  }
+  Pipeline pipeline(mpc);
+
+  StageTimes parse("parse");
+  StageTimes transform("transform");
+  StageTimes fit("polyfit");
+  StageTimes predict("predict");
+  StageTimes solve("solve");
+  StageTimes output("output");
+  StageTimes serialize("serialize");
+  StageTimes total("total");
+
+  Telemetry telemetry;
+  Actuation actuation;
+  PipelineTimes times;
+  string msg;
+  size_t failures = 0;
+  size_t skipped = 0;
+  auto bench_start = chrono::steady_clock::now();
+  for (size_t k = 0; k < iterations; k++) {
+    const string& frame = frames[k % frames.size()];
+    auto start = chrono::steady_clock::now();
+
+    bool ok;
+    if (frame.size() > 2 && frame[0] == '4' && frame[1] == '2') {
+      ok = ParseMessage(frame.data(), frame.size(), telemetry) ==
+           TELEMETRY_MESSAGE;
+    } else {
+      ok = ParseTelemetryObject(frame.data(), frame.size(), telemetry);
+    }
+    if (!ok) {
+      skipped++;
+      continue;
+    }
+    parse.Add(ElapsedMicros(start));
+
+    pipeline.Run(telemetry, actuation, &times);
+    transform.Add(times.transform_us);
+    fit.Add(times.fit_us);
+    predict.Add(times.predict_us);
+    solve.Add(times.solve_us);
+    output.Add(times.output_us);
+    if (!mpc.ok()) {
+      failures++;
+    }
+
+    auto serialize_start = chrono::steady_clock::now();
+    WriteSteerMessage(actuation, msg);
+    serialize.Add(ElapsedMicros(serialize_start));
+    total.Add(ElapsedMicros(start));
+  }
+  double seconds = ElapsedMicros(bench_start) * 1e-6;
+
+  size_t done = iterations - skipped;
+  cout << "Backend " << SolverName(backend, config) << ", N "
+       << config.N << ", " << (warm_start ? "warm" : "cold") << " start, "
+       << frames.size() << " frames" << endl;
+  cout << done << " messages in " << seconds << " s, " << done / seconds
+       << " messages/s, " << failures << " solves not converged, "
+       << skipped << " skipped" << endl;
+  cout << "MPC " << mpc.Summary() << endl << endl;
+  parse.Report(cout);
+  transform.Report(cout);
+  fit.Report(cout);
+  predict.Report(cout);
+  solve.Report(cout);
+  output.Report(cout);
+  serialize.Report(cout);
+  total.Report(cout);
+  return 0;
+}
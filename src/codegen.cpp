@@ -0,0 +1,533 @@
+// Generates compiled derivative kernels for the MPC problem.
+//
+// FG_eval is traced once per horizon with a symbolic scalar that records
+// every operation into an expression graph. Identical subexpressions are
+// shared and constants are folded while recording. The graph is then
+// differentiated symbolically, which gives the sparse constraint Jacobian
+// and the lower triangle of the Hessian of the Lagrangian, and everything
+// is written out as straight-line C++ that MPC_NLP calls through the
+// table in MPC_Kernels.h. There is no taping and no sparsity analysis
+// left at run time, and the compiler sees plain double arithmetic.
+//
+// The cost weights, reference speed and timestep of MPC_Config() are
+// compiled in as constants, the polynomial coefficients stay inputs.
+//
+//   ./mpc_codegen OUTPUT.cpp
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "FG_eval.h"
+#include "MPC_Config.h"
+#include "MPC_Kernels.h"
+#include "MPC_Model.h"
+
+using namespace std;
+
+// Node of the expression graph
+struct Node {
+  enum Op { CONST, VAR, COEFF, OBJ_FACTOR, LAMBDA, ADD, SUB, MUL, DIV, NEG,
+            SIN, COS, ATAN };
+  Op op;
+  int a;
+  int b;
+  double value;
+  // Variables the node depends on, sorted
+  vector<int> deps;
+};
+
+// All nodes recorded so far. Nodes are hash-consed, so the same
+// expression always has the same id.
+class Graph {
+ public:
+  int Const(double value) {
+    return Add(Node::CONST, -1, -1, value);
+  }
+
+  int Input(Node::Op op, int index) {
+    int id = Add(op, index, -1, 0);
+    if (op == Node::VAR && nodes_[id].deps.empty()) {
+      nodes_[id].deps.push_back(index);
+    }
+    return id;
+  }
+
+  int Unary(Node::Op op, int a) {
+    const Node& x = nodes_[a];
+    if (x.op == Node::CONST) {
+      switch (op) {
+        case Node::NEG: return Const(-x.value);
+        case Node::SIN: return Const(sin(x.value));
+        case Node::COS: return Const(cos(x.value));
+        default: return Const(atan(x.value));
+      }
+    }
+    if (op == Node::NEG && x.op == Node::NEG) {
+      return x.a;
+    }
+    return Add(op, a, -1, 0);
+  }
+
+  int Binary(Node::Op op, int a, int b) {
+    const Node& x = nodes_[a];
+    const Node& y = nodes_[b];
+    bool x_const = x.op == Node::CONST;
+    bool y_const = y.op == Node::CONST;
+    if (x_const && y_const) {
+      switch (op) {
+        case Node::ADD: return Const(x.value + y.value);
+        case Node::SUB: return Const(x.value - y.value);
+        case Node::MUL: return Const(x.value * y.value);
+        default: return Const(x.value / y.value);
+      }
+    }
+    switch (op) {
+      case Node::ADD:
+        if (x_const && x.value == 0) return b;
+        if (y_const && y.value == 0) return a;
+        break;
+      case Node::SUB:
+        if (y_const && y.value == 0) return a;
+        if (x_const && x.value == 0) return Unary(Node::NEG, b);
+        if (a == b) return Const(0);
+        break;
+      case Node::MUL:
+        if ((x_const && x.value == 0) || (y_const && y.value == 0)) {
+          return Const(0);
+        }
+        if (x_const && x.value == 1) return b;
+        if (y_const && y.value == 1) return a;
+        if (x_const && x.value == -1) return Unary(Node::NEG, b);
+        if (y_const && y.value == -1) return Unary(Node::NEG, a);
+        break;
+      default:
+        if (x_const && x.value == 0) return Const(0);
+        if (y_const && y.value == 1) return a;
+        break;
+    }
+    // Canonical operand order for commutative ops, so a + b and b + a
+    // are the same node
+    if ((op == Node::ADD || op == Node::MUL) && a > b) {
+      swap(a, b);
+    }
+    return Add(op, a, b, 0);
+  }
+
+  const Node& operator[](int id) const { return nodes_[id]; }
+  bool IsZero(int id) const {
+    return nodes_[id].op == Node::CONST && nodes_[id].value == 0;
+  }
+
+  // d(id)/d(var)
+  int Diff(int id, int var) {
+    if (var != diff_var_) {
+      diff_cache_.clear();
+      diff_var_ = var;
+    }
+    const vector<int>& deps = nodes_[id].deps;
+    if (!binary_search(deps.begin(), deps.end(), var)) {
+      return Const(0);
+    }
+    auto cached = diff_cache_.find(id);
+    if (cached != diff_cache_.end()) {
+      return cached->second;
+    }
+    Node n = nodes_[id];
+    int d;
+    switch (n.op) {
+      case Node::VAR:
+        d = Const(1);
+        break;
+      case Node::ADD:
+        d = Binary(Node::ADD, Diff(n.a, var), Diff(n.b, var));
+        break;
+      case Node::SUB:
+        d = Binary(Node::SUB, Diff(n.a, var), Diff(n.b, var));
+        break;
+      case Node::MUL:
+        d = Binary(Node::ADD, Binary(Node::MUL, Diff(n.a, var), n.b),
+                   Binary(Node::MUL, n.a, Diff(n.b, var)));
+        break;
+      case Node::DIV: {
+        // (a/b)' = a'/b - a b' / b^2
+        int q = Binary(Node::DIV, Diff(n.a, var), n.b);
+        int r = Binary(Node::DIV, Binary(Node::MUL, id, Diff(n.b, var)), n.b);
+        d = Binary(Node::SUB, q, r);
+        break;
+      }
+      case Node::NEG:
+        d = Unary(Node::NEG, Diff(n.a, var));
+        break;
+      case Node::SIN:
+        d = Binary(Node::MUL, Unary(Node::COS, n.a), Diff(n.a, var));
+        break;
+      case Node::COS:
+        d = Unary(Node::NEG,
+                  Binary(Node::MUL, Unary(Node::SIN, n.a), Diff(n.a, var)));
+        break;
+      case Node::ATAN:
+        d = Binary(Node::DIV, Diff(n.a, var),
+                   Binary(Node::ADD, Const(1), Binary(Node::MUL, n.a, n.a)));
+        break;
+      default:
+        d = Const(0);
+        break;
+    }
+    diff_cache_[id] = d;
+    return d;
+  }
+
+ private:
+  int Add(Node::Op op, int a, int b, double value) {
+    auto key = make_tuple(int(op), a, b, value);
+    auto found = index_.find(key);
+    if (found != index_.end()) {
+      return found->second;
+    }
+    Node n;
+    n.op = op;
+    n.a = a;
+    n.b = b;
+    n.value = value;
+    if (op >= Node::ADD) {
+      n.deps = nodes_[a].deps;
+      if (b >= 0) {
+        const vector<int>& other = nodes_[b].deps;
+        vector<int> merged;
+        set_union(n.deps.begin(), n.deps.end(), other.begin(), other.end(),
+                  back_inserter(merged));
+        n.deps.swap(merged);
+      }
+    }
+    int id = nodes_.size();
+    nodes_.push_back(n);
+    index_[key] = id;
+    return id;
+  }
+
+  vector<Node> nodes_;
+  map<tuple<int, int, int, double>, int> index_;
+  map<int, int> diff_cache_;
+  int diff_var_ = -1;
+};
+
+static Graph graph;
+
+// The scalar FG_eval is traced with
+struct Sym {
+  int id;
+
+  Sym() : id(graph.Const(0)) {}
+  Sym(double value) : id(graph.Const(value)) {}
+  static Sym Id(int id) {
+    Sym s;
+    s.id = id;
+    return s;
+  }
+
+  Sym& operator+=(const Sym& other) {
+    id = graph.Binary(Node::ADD, id, other.id);
+    return *this;
+  }
+};
+
+static Sym operator+(const Sym& a, const Sym& b) {
+  return Sym::Id(graph.Binary(Node::ADD, a.id, b.id));
+}
+static Sym operator-(const Sym& a, const Sym& b) {
+  return Sym::Id(graph.Binary(Node::SUB, a.id, b.id));
+}
+static Sym operator*(const Sym& a, const Sym& b) {
+  return Sym::Id(graph.Binary(Node::MUL, a.id, b.id));
+}
+static Sym operator/(const Sym& a, const Sym& b) {
+  return Sym::Id(graph.Binary(Node::DIV, a.id, b.id));
+}
+static Sym sin(const Sym& a) { return Sym::Id(graph.Unary(Node::SIN, a.id)); }
+static Sym cos(const Sym& a) { return Sym::Id(graph.Unary(Node::COS, a.id)); }
+static Sym atan(const Sym& a) {
+  return Sym::Id(graph.Unary(Node::ATAN, a.id));
+}
+
+// Writes the code computing a set of nodes, each node once
+class Emitter {
+ public:
+  explicit Emitter(ostream& out) : out_(out) {}
+
+  // Name of the value of id, emitting whatever it needs first
+  string Value(int id) {
+    const Node& n = graph[id];
+    switch (n.op) {
+      case Node::CONST: return Literal(n.value);
+      case Node::VAR: return "x[" + to_string(n.a) + "]";
+      case Node::COEFF: return "c[" + to_string(n.a) + "]";
+      case Node::OBJ_FACTOR: return "obj_factor";
+      case Node::LAMBDA: return "lambda[" + to_string(n.a) + "]";
+      default: break;
+    }
+    auto found = names_.find(id);
+    if (found != names_.end()) {
+      return found->second;
+    }
+    string expr;
+    switch (n.op) {
+      case Node::ADD: expr = Value(n.a) + " + " + Value(n.b); break;
+      case Node::SUB: expr = Value(n.a) + " - " + Value(n.b); break;
+      case Node::MUL: expr = Value(n.a) + " * " + Value(n.b); break;
+      case Node::DIV: expr = Value(n.a) + " / " + Value(n.b); break;
+      case Node::NEG: expr = "-" + Value(n.a); break;
+      case Node::SIN: expr = "sin(" + Value(n.a) + ")"; break;
+      case Node::COS: expr = "cos(" + Value(n.a) + ")"; break;
+      default: expr = "atan(" + Value(n.a) + ")"; break;
+    }
+    string name = "v" + to_string(names_.size());
+    out_ << "  const double " << name << " = " << expr << ";\n";
+    names_[id] = name;
+    return name;
+  }
+
+ private:
+  static string Literal(double value) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.17g", value);
+    string s = buf;
+    if (s.find_first_of(".en") == string::npos) {
+      s += ".0";
+    }
+    return value < 0 ? "(" + s + ")" : s;
+  }
+
+  ostream& out_;
+  map<int, string> names_;
+};
+
+// Traces FG_eval<N> and writes its kernels, returns the name of the
+// function that fills in the MPC_KernelSet
+template <size_t N>
+static string Generate(ostream& out, const MPC_Config& config) {
+  typedef MPC_Layout<N> Layout;
+  typedef typename FG_eval<N, Sym>::ADvector SymVector;
+  const size_t n = Layout::n_vars;
+  const size_t m = Layout::n_constraints;
+
+  SymVector vars(n);
+  for (size_t i = 0; i < n; i++) {
+    vars[i] = Sym::Id(graph.Input(Node::VAR, i));
+  }
+  SymVector coeffs(n_coeffs);
+  for (size_t i = 0; i < n_coeffs; i++) {
+    coeffs[i] = Sym::Id(graph.Input(Node::COEFF, i));
+  }
+  SymVector fg(1 + m);
+  FG_eval<N, Sym> fg_eval(coeffs, config);
+  fg_eval(fg, vars);
+
+  // Cost gradient
+  vector<int> grad(n);
+  for (size_t j = 0; j < n; j++) {
+    grad[j] = graph.Diff(fg[0].id, j);
+  }
+
+  // Constraint Jacobian, row by row
+  vector<int> jac_rows, jac_cols, jac_values;
+  for (size_t i = 0; i < m; i++) {
+    for (int j : graph[fg[1 + i].id].deps) {
+      int d = graph.Diff(fg[1 + i].id, j);
+      if (!graph.IsZero(d)) {
+        jac_rows.push_back(i);
+        jac_cols.push_back(j);
+        jac_values.push_back(d);
+      }
+    }
+  }
+
+  // Lagrangian obj_factor * cost + sum lambda_i g_i, and the lower
+  // triangle of its Hessian
+  int lagrangian = graph.Binary(Node::MUL, graph.Input(Node::OBJ_FACTOR, 0),
+                                fg[0].id);
+  for (size_t i = 0; i < m; i++) {
+    lagrangian = graph.Binary(
+        Node::ADD, lagrangian,
+        graph.Binary(Node::MUL, graph.Input(Node::LAMBDA, i), fg[1 + i].id));
+  }
+  vector<int> lagrangian_grad(n);
+  for (size_t j = 0; j < n; j++) {
+    lagrangian_grad[j] = graph.Diff(lagrangian, j);
+  }
+  vector<int> hes_rows, hes_cols, hes_values;
+  for (size_t j = 0; j < n; j++) {
+    for (int k : graph[lagrangian_grad[j]].deps) {
+      if (size_t(k) > j) {
+        break;
+      }
+      int d = graph.Diff(lagrangian_grad[j], k);
+      if (!graph.IsZero(d)) {
+        hes_rows.push_back(j);
+        hes_cols.push_back(k);
+        hes_values.push_back(d);
+      }
+    }
+  }
+
+  const string suffix = to_string(N);
+  out << "// N = " << N << ", " << jac_values.size()
+      << " Jacobian and " << hes_values.size() << " Hessian entries\n\n";
+
+  out << "static double Cost" << suffix
+      << "(const double* x, const double* c) {\n";
+  {
+    Emitter emit(out);
+    string value = emit.Value(fg[0].id);
+    out << "  return " << value << ";\n}\n\n";
+  }
+
+  out << "static void CostGradient" << suffix
+      << "(const double* x, const double* c, double* grad) {\n";
+  {
+    Emitter emit(out);
+    for (size_t j = 0; j < n; j++) {
+      string value = emit.Value(grad[j]);
+      out << "  grad[" << j << "] = " << value << ";\n";
+    }
+    out << "}\n\n";
+  }
+
+  out << "static void Constraints" << suffix
+      << "(const double* x, const double* c, double* g) {\n";
+  {
+    Emitter emit(out);
+    for (size_t i = 0; i < m; i++) {
+      string value = emit.Value(fg[1 + i].id);
+      out << "  g[" << i << "] = " << value << ";\n";
+    }
+    out << "}\n\n";
+  }
+
+  out << "static void Jacobian" << suffix
+      << "(const double* x, const double* c, double* values) {\n";
+  {
+    Emitter emit(out);
+    for (size_t k = 0; k < jac_values.size(); k++) {
+      string value = emit.Value(jac_values[k]);
+      out << "  values[" << k << "] = " << value << ";\n";
+    }
+    out << "}\n\n";
+  }
+
+  out << "static void Hessian" << suffix
+      << "(const double* x, const double* c, double obj_factor,\n"
+      << "                     const double* lambda, double* values) {\n";
+  {
+    Emitter emit(out);
+    for (size_t k = 0; k < hes_values.size(); k++) {
+      string value = emit.Value(hes_values[k]);
+      out << "  values[" << k << "] = " << value << ";\n";
+    }
+    out << "}\n\n";
+  }
+
+  auto write_indices = [&out](const string& name, const vector<int>& v) {
+    out << "static const int " << name << "[] = {";
+    for (size_t k = 0; k < v.size(); k++) {
+      out << (k % 16 == 0 ? "\n    " : " ") << v[k] << ",";
+    }
+    out << "\n};\n\n";
+  };
+  write_indices("jac_rows" + suffix, jac_rows);
+  write_indices("jac_cols" + suffix, jac_cols);
+  write_indices("hes_rows" + suffix, hes_rows);
+  write_indices("hes_cols" + suffix, hes_cols);
+
+  const string make = "MakeKernels" + suffix;
+  out << "static MPC_KernelSet " << make << "() {\n"
+      << "  MPC_KernelSet k;\n"
+      << "  k.N = " << N << ";\n"
+      << "  k.config.N = " << N << ";\n"
+      << "  k.config.dt = " << config.dt << ";\n"
+      << "  k.config.ref_v = " << config.ref_v << ";\n"
+      << "  k.config.cte_cost_weight = " << config.cte_cost_weight << ";\n"
+      << "  k.config.epsi_cost_weight = " << config.epsi_cost_weight << ";\n"
+      << "  k.config.v_cost_weight = " << config.v_cost_weight << ";\n"
+      << "  k.config.delta_cost_weight = " << config.delta_cost_weight << ";\n"
+      << "  k.config.a_cost_weight = " << config.a_cost_weight << ";\n"
+      << "  k.config.delta_change_cost_weight = "
+      << config.delta_change_cost_weight << ";\n"
+      << "  k.config.a_change_cost_weight = " << config.a_change_cost_weight
+      << ";\n"
+      << "  k.jac_nnz = " << jac_values.size() << ";\n"
+      << "  k.jac_rows = jac_rows" << suffix << ";\n"
+      << "  k.jac_cols = jac_cols" << suffix << ";\n"
+      << "  k.hes_nnz = " << hes_values.size() << ";\n"
+      << "  k.hes_rows = hes_rows" << suffix << ";\n"
+      << "  k.hes_cols = hes_cols" << suffix << ";\n"
+      << "  k.cost = Cost" << suffix << ";\n"
+      << "  k.cost_gradient = CostGradient" << suffix << ";\n"
+      << "  k.constraints = Constraints" << suffix << ";\n"
+      << "  k.jacobian = Jacobian" << suffix << ";\n"
+      << "  k.hessian = Hessian" << suffix << ";\n"
+      << "  return k;\n"
+      << "}\n\n";
+  return make;
+}
+
+int main(int argc, char* argv[]) {
+  if (argc != 2) {
+    cerr << "Usage: " << argv[0] << " OUTPUT.cpp" << endl;
+    return 1;
+  }
+
+  MPC_Config config;
+  ostringstream out;
+  out.precision(17);
+  out << "// Generated by mpc_codegen from FG_eval.h, do not edit.\n\n"
+      << "#include <cmath>\n"
+      << "#include \"MPC_Kernels.h\"\n\n"
+      << "using std::atan;\n"
+      << "using std::cos;\n"
+      << "using std::sin;\n\n";
+  vector<string> makers;
+  makers.push_back(Generate<10>(out, config));
+  makers.push_back(Generate<15>(out, config));
+  makers.push_back(Generate<20>(out, config));
+  makers.push_back(Generate<25>(out, config));
+
+  out << "const MPC_KernelSet* FindKernels(size_t N) {\n"
+      << "  static const MPC_KernelSet kernels[] = {";
+  for (size_t i = 0; i < makers.size(); i++) {
+    out << (i ? ", " : "") << makers[i] << "()";
+  }
+  out << "};\n"
+      << "  for (const MPC_KernelSet& k : kernels) {\n"
+      << "    if (k.N == N) {\n"
+      << "      return &k;\n"
+      << "    }\n"
+      << "  }\n"
+      << "  return nullptr;\n"
+      << "}\n";
+
+  // Only touch the file when it changes, so the build doesn't redo the
+  // compile for nothing
+  string code = out.str();
+  {
+    ifstream in(argv[1]);
+    stringstream old;
+    old << in.rdbuf();
+    if (in && old.str() == code) {
+      return 0;
+    }
+  }
+  ofstream file(argv[1]);
+  file << code;
+  if (!file) {
+    cerr << "Failed to write " << argv[1] << endl;
+    return 1;
+  }
+  return 0;
+}
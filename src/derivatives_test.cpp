@@ -0,0 +1,264 @@
+// Checks of MPC_Derivatives, run by ctest.
+//
+// At random points, multipliers and reference polynomials, for every
+// horizon:
+//
+// - the cost gradient, constraint Jacobian and Lagrangian Hessian have to
+//   match central differences of Cost, Constraints and the gradient
+//   of the Lagrangian, so every hand-derived term is checked against the
+//   function it claims to differentiate;
+// - the same values have to match what CppAD gives from a tape of FG_eval,
+//   the derivatives the Ipopt backend uses by default.
+//
+// Both comparisons are dense, so a nonzero missing from the callbacks'
+// sparsity shows up as well as a wrong value. Inputs are random with a
+// fixed seed, so a failure reproduces.
+//
+//   ./mpc_derivatives_test
+
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "FG_eval.h"
+#include "MPC_Derivatives.h"
+
+using namespace std;
+
+static int failures = 0;
+
+// Reports the first few failures, counts all of them
+static void Check(bool condition, const string& what) {
+  if (!condition) {
+    if (failures < 20) {
+      cerr << "FAILED: " << what << endl;
+    }
+    failures++;
+  }
+}
+
+// Whether the largest gap between a and b is within tol, relative to the
+// size of the entries
+static bool Close(const Eigen::MatrixXd& a, const Eigen::MatrixXd& b,
+                  double tol, string& where) {
+  for (Eigen::Index i = 0; i < a.rows(); i++) {
+    for (Eigen::Index j = 0; j < a.cols(); j++) {
+      double scale = 1 + max(fabs(a(i, j)), fabs(b(i, j)));
+      if (fabs(a(i, j) - b(i, j)) > tol * scale) {
+        where = "(" + to_string(i) + ", " + to_string(j) + "): " +
+                to_string(a(i, j)) + " vs " + to_string(b(i, j));
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// A point like the solver visits: on the road ahead, at driving speeds
+template <size_t N>
+static vector<double> RandomPoint(mt19937_64& random) {
+  typedef MPC_Layout<N> Layout;
+  uniform_real_distribution<double> unit(-1.0, 1.0);
+  vector<double> x(Layout::n_vars);
+  for (size_t t = 0; t < N; t++) {
+    x[Layout::x_start + t] = 2.0 * t + 5 * unit(random);
+    x[Layout::y_start + t] = 3 * unit(random);
+    x[Layout::psi_start + t] = 0.5 * unit(random);
+    x[Layout::v_start + t] = 20 + 20 * unit(random);
+    x[Layout::cte_start + t] = 2 * unit(random);
+    x[Layout::epsi_start + t] = 0.3 * unit(random);
+  }
+  for (size_t t = 0; t < N - 1; t++) {
+    x[Layout::delta_start + t] = max_delta * unit(random);
+    x[Layout::a_start + t] = max_a * unit(random);
+  }
+  return x;
+}
+
+template <size_t N>
+static void TestHorizon(mt19937_64& random) {
+  typedef MPC_Layout<N> Layout;
+  const size_t n = Layout::n_vars;
+  const size_t m = Layout::n_constraints;
+  uniform_real_distribution<double> unit(-1.0, 1.0);
+  MPC_Config config;
+  config.N = N;
+  MPC_Derivatives<N> derivatives(config);
+
+  // FG_eval taped the way MPC_NLP does, coefficients as dynamic parameters
+  typedef typename FG_eval<N>::ADvector ADvector;
+  ADvector avars(n);
+  for (size_t i = 0; i < n; i++) {
+    avars[i] = 0.0;
+  }
+  ADvector acoeffs(n_coeffs);
+  for (size_t i = 0; i < n_coeffs; i++) {
+    acoeffs[i] = 0.0;
+  }
+  size_t abort_op_index = 0;
+  bool record_compare = false;
+  CppAD::Independent(avars, abort_op_index, record_compare, acoeffs);
+  ADvector afg(1 + m);
+  FG_eval<N> fg_eval(acoeffs, config);
+  fg_eval(afg, avars);
+  CppAD::ADFun<double> fg_fun;
+  fg_fun.Dependent(avars, afg);
+  fg_fun.optimize();
+
+  for (int trial = 0; trial < 20; trial++) {
+    string which = "N = " + to_string(N) + " trial " + to_string(trial);
+    Eigen::VectorXd coeffs(n_coeffs);
+    coeffs << 2 * unit(random), 0.2 * unit(random), 0.01 * unit(random),
+        1e-4 * unit(random);
+    derivatives.SetCoeffs(coeffs);
+    vector<double> x = RandomPoint<N>(random);
+    vector<double> lambda(m);
+    for (double& l : lambda) {
+      l = 10 * unit(random);
+    }
+    double obj_factor = 0.1 + random() % 20 * 0.1;
+
+    // Analytic values, dense
+    Eigen::VectorXd grad(n);
+    derivatives.CostGradient(x.data(), grad.data());
+    Eigen::MatrixXd jac = Eigen::MatrixXd::Zero(m, n);
+    derivatives.ConstraintJacobian(
+        x.data(), [&jac](size_t row, size_t col, double value) {
+          jac(row, col) += value;
+        });
+    Eigen::MatrixXd hes = Eigen::MatrixXd::Zero(n, n);
+    bool lower = true;
+    derivatives.LagrangianHessian(
+        x.data(), obj_factor, lambda.data(),
+        [&hes, &lower](size_t row, size_t col, double value) {
+          lower = lower && row >= col;
+          hes(row, col) += value;
+        });
+    Check(lower, which + " Hessian terms are in the lower triangle");
+    Eigen::MatrixXd hes_full = hes;
+    hes_full.triangularView<Eigen::StrictlyUpper>() = hes.transpose();
+
+    // Gradient of the Lagrangian, the function the Hessian differentiates
+    auto lagrangian_gradient = [&](const vector<double>& at) {
+      Eigen::VectorXd cost_grad(n);
+      derivatives.CostGradient(at.data(), cost_grad.data());
+      Eigen::MatrixXd at_jac = Eigen::MatrixXd::Zero(m, n);
+      derivatives.ConstraintJacobian(
+          at.data(), [&at_jac](size_t row, size_t col, double value) {
+            at_jac(row, col) += value;
+          });
+      Eigen::Map<const Eigen::VectorXd> l(lambda.data(), m);
+      Eigen::VectorXd result = obj_factor * cost_grad + at_jac.transpose() * l;
+      return result;
+    };
+
+    // Central differences, one variable at a time. The cost is quadratic,
+    // so a long step is exact and keeps rounding out of it. The others
+    // take short steps, long enough for the rounding of Lagrangian
+    // gradients in the thousands.
+    Eigen::MatrixXd grad_fd(1, n);
+    Eigen::MatrixXd jac_fd(m, n);
+    Eigen::MatrixXd hes_fd(n, n);
+    vector<double> g_plus(m), g_minus(m);
+    for (size_t j = 0; j < n; j++) {
+      double scale = max(1.0, fabs(x[j]));
+      vector<double> plus = x, minus = x;
+      double h = 1e-2 * scale;
+      plus[j] = x[j] + h;
+      minus[j] = x[j] - h;
+      grad_fd(0, j) =
+          (derivatives.Cost(plus.data()) - derivatives.Cost(minus.data())) /
+          (2 * h);
+
+      h = 1e-6 * scale;
+      plus[j] = x[j] + h;
+      minus[j] = x[j] - h;
+      derivatives.Constraints(plus.data(), g_plus.data());
+      derivatives.Constraints(minus.data(), g_minus.data());
+      for (size_t i = 0; i < m; i++) {
+        jac_fd(i, j) = (g_plus[i] - g_minus[i]) / (2 * h);
+      }
+
+      h = 1e-5 * scale;
+      plus[j] = x[j] + h;
+      minus[j] = x[j] - h;
+      hes_fd.col(j) =
+          (lagrangian_gradient(plus) - lagrangian_gradient(minus)) / (2 * h);
+    }
+
+    string where;
+    bool ok = Close(grad.transpose(), grad_fd, 1e-6, where);
+    Check(ok, which + " cost gradient matches differences at " + where);
+    ok = Close(jac, jac_fd, 1e-6, where);
+    Check(ok, which + " Jacobian matches differences at " + where);
+    ok = Close(hes_full, hes_fd, 1e-5, where);
+    Check(ok, which + " Hessian matches differences at " + where);
+
+    // The same from the tape
+    CPPAD_TESTVECTOR(double) p(n_coeffs);
+    for (size_t i = 0; i < n_coeffs; i++) {
+      p[i] = coeffs[i];
+    }
+    fg_fun.new_dynamic(p);
+    CPPAD_TESTVECTOR(double) xv(n);
+    for (size_t i = 0; i < n; i++) {
+      xv[i] = x[i];
+    }
+    CPPAD_TESTVECTOR(double) w(1 + m);
+    w[0] = obj_factor;
+    for (size_t i = 0; i < m; i++) {
+      w[1 + i] = lambda[i];
+    }
+    CPPAD_TESTVECTOR(double) fg = fg_fun.Forward(0, xv);
+    CPPAD_TESTVECTOR(double) taped_jac = fg_fun.Jacobian(xv);
+    CPPAD_TESTVECTOR(double) taped_hes = fg_fun.Hessian(xv, w);
+
+    vector<double> g(m);
+    derivatives.Constraints(x.data(), g.data());
+    Eigen::MatrixXd values(1, 1 + m), taped_values(1, 1 + m);
+    values(0, 0) = derivatives.Cost(x.data());
+    Eigen::MatrixXd taped_grad(1, n), taped_jac_g(m, n), taped_hes_l(n, n);
+    for (size_t i = 0; i <= m; i++) {
+      taped_values(0, i) = fg[i];
+      if (i > 0) {
+        values(0, i) = g[i - 1];
+      }
+      for (size_t j = 0; j < n; j++) {
+        if (i == 0) {
+          taped_grad(0, j) = taped_jac[j];
+        } else {
+          taped_jac_g(i - 1, j) = taped_jac[i * n + j];
+        }
+      }
+    }
+    for (size_t i = 0; i < n; i++) {
+      for (size_t j = 0; j < n; j++) {
+        taped_hes_l(i, j) = taped_hes[i * n + j];
+      }
+    }
+    ok = Close(values, taped_values, 1e-12, where);
+    Check(ok, which + " cost and constraints match the tape at " + where);
+    ok = Close(grad.transpose(), taped_grad, 1e-12, where);
+    Check(ok, which + " cost gradient matches the tape at " + where);
+    ok = Close(jac, taped_jac_g, 1e-12, where);
+    Check(ok, which + " Jacobian matches the tape at " + where);
+    ok = Close(hes_full, taped_hes_l, 1e-10, where);
+    Check(ok, which + " Hessian matches the tape at " + where);
+  }
+}
+
+int main() {
+  mt19937_64 random(16);
+  TestHorizon<10>(random);
+  TestHorizon<15>(random);
+  TestHorizon<20>(random);
+  TestHorizon<25>(random);
+  if (failures > 0) {
+    cerr << failures << " checks failed" << endl;
+    return 1;
+  }
+  cout << "All checks passed" << endl;
+  return 0;
+}
@@ -0,0 +1,240 @@
+// Checks of JsonReader and JsonWriter against strtod and json.hpp, run by
+// ctest.
+//
+// JsonReader::Number has to give exactly what strtod gives for the same
+// text, through its fast path and its fallback alike. ReadObject stores
+// only exact key matches. JsonWriter in its default format has to write
+// numbers, arrays and objects byte for byte like json.hpp's dump, and in
+// fixed notation within half a unit of its last digit (in the default
+// format where that doesn't fit). All inputs are random with a fixed
+// seed, so a failure reproduces.
+//
+//   ./mpc_json_stream_test
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "JsonStream.h"
+#include "json.hpp"
+
+using json = nlohmann::json;
+
+static int failures = 0;
+
+// Reports the first few failures of each check, counts all of them
+static void Check(bool condition, const string& what) {
+  if (!condition) {
+    if (failures < 20) {
+      cerr << "FAILED: " << what << endl;
+    }
+    failures++;
+  }
+}
+
+static bool SameBits(double a, double b) {
+  return memcmp(&a, &b, sizeof(double)) == 0;
+}
+
+// A JSON number: optional sign, 1 to 20 digits with the point anywhere
+// or nowhere, leading zeros after the point, and an optional exponent
+static string RandomNumberText(mt19937_64& random) {
+  uniform_int_distribution<int> digit(0, 9);
+  uniform_int_distribution<int> count(1, 20);
+  uniform_int_distribution<int> exponent(-40, 40);
+  string text;
+  if (random() % 2) {
+    text += '-';
+  }
+  int digits = count(random);
+  int point = int(random() % (digits + 1));
+  if (point == 0) {
+    text += "0.";
+    for (int zeros = int(random() % 6); zeros > 0; zeros--) {
+      text += '0';
+    }
+  }
+  for (int i = 0; i < digits; i++) {
+    // No leading zeros before the point, as JSON requires
+    int d = digit(random);
+    if (i == 0 && point != 0 && digits > 1 && d == 0) {
+      d = 1;
+    }
+    text += char('0' + d);
+    if (i + 1 == point && point < digits) {
+      text += '.';
+    }
+  }
+  if (random() % 3 == 0) {
+    text += random() % 2 ? 'e' : 'E';
+    int e = exponent(random);
+    if (e < 0) {
+      text += '-';
+    } else if (random() % 2) {
+      text += '+';
+    }
+    text += to_string(abs(e));
+  }
+  return text;
+}
+
+// Doubles of every magnitude the protocol sees and then some, with
+// whole numbers and exact zeros mixed in
+static double RandomDouble(mt19937_64& random) {
+  uniform_real_distribution<double> unit(-1.0, 1.0);
+  uniform_int_distribution<int> scale(-12, 12);
+  switch (random() % 6) {
+    case 0:
+      return double(int64_t(random() % 2000001) - 1000000);
+    case 1:
+      return random() % 2 ? 0.0 : -0.0;
+    default:
+      return unit(random) * pow(10.0, scale(random));
+  }
+}
+
+static void TestNumber(mt19937_64& random) {
+  static const char* fixed_texts[] = {
+      "0",      "-0",           "0.0",        "1e22",  "1e23",
+      "-1e-22", "123456789012345", "1234567890123456", "0.1",
+      "2.2250738585072014e-308", "1.7976931348623157e308",
+      "9007199254740993", "4.35", "-0.000001"};
+  vector<string> texts(fixed_texts, fixed_texts + sizeof(fixed_texts) /
+                                                      sizeof(fixed_texts[0]));
+  for (int i = 0; i < 200000; i++) {
+    texts.push_back(RandomNumberText(random));
+  }
+
+  // Printed doubles, the way the simulator's JSON encoder writes them
+  for (int i = 0; i < 100000; i++) {
+    char buffer[40];
+    snprintf(buffer, sizeof(buffer), "%.*g", int(1 + random() % 17),
+             RandomDouble(random));
+    texts.push_back(buffer);
+  }
+
+  for (const string& text : texts) {
+    JsonReader reader(text.data(), text.data() + text.size());
+    double value;
+    bool ok = reader.Number(value);
+    Check(ok && reader.Peek() == '\0', "Number reads all of " + text);
+    if (ok) {
+      Check(SameBits(value, strtod(text.c_str(), nullptr)),
+            "Number matches strtod on " + text);
+    }
+  }
+}
+
+struct Pair {
+  double x;
+  double xy;
+};
+
+// Keys that start like a field name or contain a NUL must not match it,
+// nor make the comparison run past the end of the name
+static void TestKeys() {
+  static const JsonField<Pair> schema[] = {{"x", &Pair::x, nullptr},
+                                           {"xy", &Pair::xy, nullptr}};
+  const char text[] =
+      "{\"x\\u0000\":1,\"x\0y\":2,\"xyz\":3,\"xy\":4,\"x\":5}";
+  vector<char> buffer(text, text + sizeof(text) - 1);
+  JsonReader reader(buffer.data(), buffer.data() + buffer.size());
+  Pair pair = {0.0, 0.0};
+  uint64_t found;
+  Check(reader.ReadObject(pair, schema, 2, found) && found == 3 &&
+            pair.x == 5 && pair.xy == 4,
+        "only exact keys are stored");
+}
+
+static void TestWriterDefault(mt19937_64& random) {
+  for (int i = 0; i < 100000; i++) {
+    double value = RandomDouble(random);
+    string out;
+    JsonWriter writer(out);
+    writer.Number(value);
+    Check(out == json(value).dump(), "Number writes " + json(value).dump() +
+                                         " like json.hpp, not " + out);
+  }
+  for (double special : {NAN, INFINITY, -INFINITY}) {
+    string out;
+    JsonWriter writer(out);
+    writer.Number(special);
+    Check(out == json(special).dump(), "non-finite numbers are null");
+  }
+
+  // The shape of the steer reply: arrays in an object in an array
+  for (int i = 0; i < 2000; i++) {
+    vector<double> first(random() % 30);
+    vector<double> second(random() % 30);
+    for (double& value : first) {
+      value = RandomDouble(random);
+    }
+    for (double& value : second) {
+      value = RandomDouble(random);
+    }
+    double scalar = RandomDouble(random);
+
+    string out;
+    JsonWriter writer(out);
+    writer.BeginArray();
+    writer.String("steer");
+    writer.BeginObject();
+    writer.Key("a");
+    writer.NumberArray(first);
+    writer.Key("b");
+    writer.NumberArray(second);
+    writer.Key("c");
+    writer.Number(scalar);
+    writer.EndObject();
+    writer.EndArray();
+
+    json object;
+    object["a"] = first;
+    object["b"] = second;
+    object["c"] = scalar;
+    json message = json::array({"steer", object});
+    Check(out == message.dump(), "message written like json.hpp: " + out);
+  }
+}
+
+static void TestWriterFixed(mt19937_64& random) {
+  for (int decimals = 1; decimals <= 9; decimals++) {
+    double unit = pow(10.0, -decimals);
+    double scale = pow(10.0, decimals);
+    for (int i = 0; i < 20000; i++) {
+      double value = RandomDouble(random);
+      string out;
+      JsonWriter writer(out, decimals);
+      writer.Number(value);
+      char exact[32];
+      snprintf(exact, sizeof(exact), "%.17g", value);
+      string which = "fixed " + to_string(decimals) + " writes " + exact +
+                     " as " + out;
+      if (fabs(value) * scale + 0.5 < 9007199254740992.0) {
+        double back = strtod(out.c_str(), nullptr);
+        Check(fabs(back - value) <= 0.5 * unit + fabs(value) * 1e-15, which);
+      } else {
+        // Too large for the integer formatter, the default format
+        Check(out == json(value).dump(), which);
+      }
+    }
+  }
+}
+
+int main() {
+  mt19937_64 random(12);
+  TestNumber(random);
+  TestKeys();
+  TestWriterDefault(random);
+  TestWriterFixed(random);
+  if (failures > 0) {
+    cerr << failures << " checks failed" << endl;
+    return 1;
+  }
+  cout << "All checks passed" << endl;
+  return 0;
+}
@@ -0,0 +1,188 @@
+// Checks of the compiled derivative kernels against MPC_Derivatives, run
+// by ctest.
+//
+// mpc_codegen differentiates FG_eval symbolically, MPC_Derivatives has
+// the same derivatives worked out by hand. For every generated horizon,
+// at random points, multipliers and reference polynomials, the kernels'
+// cost, constraints, Jacobian and Hessian have to agree with them up to
+// rounding. The kernels' sparsity patterns are scattered into dense
+// matrices, so a misplaced or missing nonzero fails as well as a wrong
+// value. Inputs are random with a fixed seed, so a failure reproduces.
+//
+//   ./mpc_kernels_test
+
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "MPC_Derivatives.h"
+#include "MPC_Kernels.h"
+
+using namespace std;
+
+static int failures = 0;
+
+// Reports the first few failures, counts all of them
+static void Check(bool condition, const string& what) {
+  if (!condition) {
+    if (failures < 20) {
+      cerr << "FAILED: " << what << endl;
+    }
+    failures++;
+  }
+}
+
+// Whether the largest gap between a and b is within tol, relative to the
+// size of the entries
+static bool Close(const Eigen::MatrixXd& a, const Eigen::MatrixXd& b,
+                  double tol, string& where) {
+  for (Eigen::Index i = 0; i < a.rows(); i++) {
+    for (Eigen::Index j = 0; j < a.cols(); j++) {
+      double scale = 1 + max(fabs(a(i, j)), fabs(b(i, j)));
+      if (fabs(a(i, j) - b(i, j)) > tol * scale) {
+        where = "(" + to_string(i) + ", " + to_string(j) + "): " +
+                to_string(a(i, j)) + " vs " + to_string(b(i, j));
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// A point like the solver visits: on the road ahead, at driving speeds
+template <size_t N>
+static vector<double> RandomPoint(mt19937_64& random) {
+  typedef MPC_Layout<N> Layout;
+  uniform_real_distribution<double> unit(-1.0, 1.0);
+  vector<double> x(Layout::n_vars);
+  for (size_t t = 0; t < N; t++) {
+    x[Layout::x_start + t] = 2.0 * t + 5 * unit(random);
+    x[Layout::y_start + t] = 3 * unit(random);
+    x[Layout::psi_start + t] = 0.5 * unit(random);
+    x[Layout::v_start + t] = 20 + 20 * unit(random);
+    x[Layout::cte_start + t] = 2 * unit(random);
+    x[Layout::epsi_start + t] = 0.3 * unit(random);
+  }
+  for (size_t t = 0; t < N - 1; t++) {
+    x[Layout::delta_start + t] = max_delta * unit(random);
+    x[Layout::a_start + t] = max_a * unit(random);
+  }
+  return x;
+}
+
+template <size_t N>
+static void TestHorizon(mt19937_64& random) {
+  typedef MPC_Layout<N> Layout;
+  const size_t n = Layout::n_vars;
+  const size_t m = Layout::n_constraints;
+  string horizon = "N = " + to_string(N);
+
+  // The kernels are generated for the default settings
+  MPC_Config config;
+  config.N = N;
+  const MPC_KernelSet* kernels = FindKernels(N);
+  Check(kernels != nullptr, horizon + " has kernels");
+  if (kernels == nullptr) {
+    return;
+  }
+  Check(kernels->N == N && SameProblem(kernels->config, config),
+        horizon + " kernels are for the default settings");
+  MPC_Derivatives<N> derivatives(kernels->config);
+
+  // The patterns have to be inside the problem, the Hessian's in its
+  // lower triangle
+  bool inside = true;
+  for (size_t k = 0; k < kernels->jac_nnz; k++) {
+    inside = inside && kernels->jac_rows[k] >= 0 &&
+             size_t(kernels->jac_rows[k]) < m && kernels->jac_cols[k] >= 0 &&
+             size_t(kernels->jac_cols[k]) < n;
+  }
+  for (size_t k = 0; k < kernels->hes_nnz; k++) {
+    inside = inside && kernels->hes_cols[k] >= 0 &&
+             kernels->hes_rows[k] >= kernels->hes_cols[k] &&
+             size_t(kernels->hes_rows[k]) < n;
+  }
+  Check(inside, horizon + " sparsity is inside the lower triangle");
+  if (!inside) {
+    return;
+  }
+
+  uniform_real_distribution<double> unit(-1.0, 1.0);
+  vector<double> jac_values(kernels->jac_nnz);
+  vector<double> hes_values(kernels->hes_nnz);
+  for (int trial = 0; trial < 100; trial++) {
+    string which = horizon + " trial " + to_string(trial);
+    Eigen::VectorXd coeffs(n_coeffs);
+    coeffs << 2 * unit(random), 0.2 * unit(random), 0.01 * unit(random),
+        1e-4 * unit(random);
+    derivatives.SetCoeffs(coeffs);
+    vector<double> x = RandomPoint<N>(random);
+    vector<double> lambda(m);
+    for (double& l : lambda) {
+      l = 10 * unit(random);
+    }
+    double obj_factor = 0.1 + random() % 20 * 0.1;
+
+    // Hand-derived values, dense
+    Eigen::MatrixXd values(1, 1 + n + m);
+    values(0, 0) = derivatives.Cost(x.data());
+    derivatives.CostGradient(x.data(), values.data() + 1);
+    derivatives.Constraints(x.data(), values.data() + 1 + n);
+    Eigen::MatrixXd jac = Eigen::MatrixXd::Zero(m, n);
+    derivatives.ConstraintJacobian(
+        x.data(), [&jac](size_t row, size_t col, double value) {
+          jac(row, col) += value;
+        });
+    Eigen::MatrixXd hes = Eigen::MatrixXd::Zero(n, n);
+    derivatives.LagrangianHessian(
+        x.data(), obj_factor, lambda.data(),
+        [&hes](size_t row, size_t col, double value) {
+          hes(row, col) += value;
+        });
+
+    // The same from the kernels
+    Eigen::MatrixXd compiled_values(1, 1 + n + m);
+    compiled_values(0, 0) = kernels->cost(x.data(), coeffs.data());
+    kernels->cost_gradient(x.data(), coeffs.data(),
+                           compiled_values.data() + 1);
+    kernels->constraints(x.data(), coeffs.data(),
+                         compiled_values.data() + 1 + n);
+    kernels->jacobian(x.data(), coeffs.data(), jac_values.data());
+    Eigen::MatrixXd compiled_jac = Eigen::MatrixXd::Zero(m, n);
+    for (size_t k = 0; k < kernels->jac_nnz; k++) {
+      compiled_jac(kernels->jac_rows[k], kernels->jac_cols[k]) +=
+          jac_values[k];
+    }
+    kernels->hessian(x.data(), coeffs.data(), obj_factor, lambda.data(),
+                     hes_values.data());
+    Eigen::MatrixXd compiled_hes = Eigen::MatrixXd::Zero(n, n);
+    for (size_t k = 0; k < kernels->hes_nnz; k++) {
+      compiled_hes(kernels->hes_rows[k], kernels->hes_cols[k]) +=
+          hes_values[k];
+    }
+
+    string where;
+    bool ok = Close(values, compiled_values, 1e-12, where);
+    Check(ok, which + " cost, gradient and constraints match at " + where);
+    ok = Close(jac, compiled_jac, 1e-12, where);
+    Check(ok, which + " Jacobian matches at " + where);
+    ok = Close(hes, compiled_hes, 1e-12, where);
+    Check(ok, which + " Hessian matches at " + where);
+  }
+}
+
+int main() {
+  mt19937_64 random(17);
+  TestHorizon<10>(random);
+  TestHorizon<15>(random);
+  TestHorizon<20>(random);
+  TestHorizon<25>(random);
+  if (failures > 0) {
+    cerr << failures << " checks failed" << endl;
+    return 1;
+  }
+  cout << "All checks passed" << endl;
+  return 0;
+}
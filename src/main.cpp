@@ -1,210 +1,201 @@
 #include <math.h>
+#include <signal.h>
+#include <stdlib.h>
 #include <uWS/uWS.h>
-#include <chrono>
 #include <iostream>
-#include <thread>
-#include <vector>
-#include "Eigen-3.3/Eigen/Core"
-#include "Eigen-3.3/Eigen/QR"
+#include <stdexcept>
+#include <string>
+#include "ConfigFile.h"
+#include "Connection.h"
+#include "Logger.h"
+#include "Recording.h"
 #include "MPC.h"
-#include "json.hpp"
-
-// for convenience
-using json = nlohmann::json;
-
-// For converting back and forth between radians and degrees.
-constexpr double pi() { return M_PI; }
-double deg2rad(double x) { return x * pi() / 180; }
-double rad2deg(double x) { return x * 180 / pi(); }
-
-// Checks if the SocketIO event has JSON data.
-// If there is data the JSON object in string format will be returned,
-// else the empty string "" will be returned.
-string hasData(string s) {
-  auto found_null = s.find("null");
-  auto b1 = s.find_first_of("[");
-  auto b2 = s.rfind("}]");
-  if (found_null != string::npos) {
-    return "";
-  } else if (b1 != string::npos && b2 != string::npos) {
-    return s.substr(b1, b2 - b1 + 2);
-  }
-  return "";
+#include "MPC_Table.h"
+#include "SolverWorker.h"
+
+// Reads "channel=N" for --log-sample and --log-rate
+static bool ParseChannelValue(const string& arg, LogChannel& channel,
+                              size_t& value) {
+  size_t eq = arg.find('=');
+  return eq != string::npos && ParseLogChannel(arg.substr(0, eq), channel) &&
+         ParseCount(arg.substr(eq + 1), value);
 }
 
-// Evaluate a polynomial.
-double polyeval(Eigen::VectorXd coeffs, double x) {
-  double result = 0.0;
-  for (int i = 0; i < coeffs.size(); i++) {
-    result += coeffs[i] * pow(x, i);
+// What SIGHUP needs to reload the config file
+struct ConfigReload {
+  string path;
+  MPC_Config config;
+  SolverWorker* worker;
+};
+
+// Runs on the event loop. An unsupported N or compiled kernels that don't
+// match keep the current settings instead of failing in the worker. They
+// are checked without building an MPC: only the solver worker may do that,
+// see SolverWorker.h.
+static void OnReloadSignal(uv_signal_t* handle, int signum) {
+  ConfigReload* reload = static_cast<ConfigReload*>(handle->data);
+  MPC_Config config = reload->config;
+  string error;
+  if (!LoadConfigFile(reload->path, config, error) ||
+      !MPC::Supports(config, error)) {
+    Log(LOG_ERROR, LOG_GENERAL, "Keeping the current settings: %s",
+        error.c_str());
+    return;
   }
-  return result;
+  reload->config = config;
+  reload->worker->SetConfig(config);
+  Log(LOG_INFO, LOG_GENERAL, "Reloaded %s", reload->path.c_str());
 }
 
-// Fit a polynomial.
-// Adapted from
-// https://github.com/JuliaMath/Polynomials.jl/blob/master/src/Polynomials.jl#L676-L716
-Eigen::VectorXd polyfit(Eigen::VectorXd xvals, Eigen::VectorXd yvals,
-                        int order) {
-  assert(xvals.size() == yvals.size());
-  assert(order >= 1 && order <= xvals.size() - 1);
-  Eigen::MatrixXd A(xvals.size(), order + 1);
+int main(int argc, char* argv[]) {
+  uWS::Hub h;
 
-  for (int i = 0; i < xvals.size(); i++) {
-    A(i, 0) = 1.0;
+  // `./mpc sqp` uses the real-time iteration SQP solver instead of Ipopt,
+  // and a number picks the horizon N (10, 15, 20 or 25), e.g. `./mpc sqp 15`.
+  // `./mpc analytic` gives Ipopt hand-derived derivatives instead of
+  // taping FG_eval with CppAD, `./mpc compiled` the kernels generated from
+  // FG_eval at build time.
+  //
+  // Logging:
+  //   --log-level L        debug, info, warn, error or off (default info).
+  //                        Telemetry, steer replies and costs are debug.
+  //   --log-file PATH      append to PATH instead of stdout
+  //   --log-sample C=N     log only every Nth line of channel C
+  //   --log-rate C=N       log at most N lines a second of channel C
+  // Channels are general, telemetry, steer, cost and stats.
+  //
+  // `--linear-solver NAME` picks the KKT solver, see LinearSolver in
+  // MPC_Config.h: mumps, ma27, ma57, ma86, ma97 or pardiso for Ipopt,
+  // riccati for the SQP backend.
+  //
+  // `--config FILE` reads solver settings from FILE, see ConfigFile.h, in
+  // order with the other arguments so later ones override it. SIGHUP
+  // reads it again and every connection switches to the new settings
+  // before its next solve; keys that were removed keep their values.
+  //
+  // `--record FILE` writes every telemetry message and actuation to a
+  // binary recording, see Recording.h, for `mpc_bench --recording FILE`.
+  //
+  // `--table FILE` answers the problems an explicit MPC table made by
+  // mpc_table covers from it, see MPC_Table.h, and solves the rest.
+  bool use_sqp = false;
+  MPC_Config config;
+  LogConfig log_config;
+  string record_path;
+  string config_path;
+  string table_path;
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    LogChannel channel;
+    size_t value;
+    if (arg == "sqp") {
+      use_sqp = true;
+    } else if (arg == "analytic") {
+      config.derivatives = ANALYTIC_DERIVATIVES;
+    } else if (arg == "compiled") {
+      config.derivatives = COMPILED_DERIVATIVES;
+    } else if (arg == "--linear-solver" && i + 1 < argc) {
+      if (!ParseLinearSolver(argv[++i], config.linear_solver)) {
+        cerr << "Unknown linear solver " << argv[i] << endl;
+        return -1;
+      }
+    } else if (arg == "--config" && i + 1 < argc) {
+      config_path = argv[++i];
+      string error;
+      if (!LoadConfigFile(config_path, config, error)) {
+        cerr << error << endl;
+        return -1;
+      }
+    } else if (arg == "--record" && i + 1 < argc) {
+      record_path = argv[++i];
+    } else if (arg == "--table" && i + 1 < argc) {
+      table_path = argv[++i];
+    } else if (arg.compare(0, 6, "--log-") == 0) {
+      if (i + 1 == argc) {
+        cerr << "Missing value for " << arg << endl;
+        return -1;
+      }
+      string option = argv[++i];
+      bool ok = true;
+      if (arg == "--log-level") {
+        ok = ParseLogLevel(option, log_config.level);
+      } else if (arg == "--log-file") {
+        log_config.path = option;
+      } else if (arg == "--log-sample") {
+        ok = ParseChannelValue(option, channel, value) && value > 0;
+        if (ok) {
+          log_config.sample_every[channel] = value;
+        }
+      } else if (arg == "--log-rate") {
+        ok = ParseChannelValue(option, channel, value);
+        if (ok) {
+          log_config.max_per_second[channel] = value;
+        }
+      } else {
+        ok = false;
+      }
+      if (!ok) {
+        cerr << "Bad logging option " << arg << " " << option << endl;
+        return -1;
+      }
+    } else if (!ParseCount(arg, config.N)) {
+      cerr << "Unknown argument " << arg << endl;
+      return -1;
+    }
   }
-
-  for (int j = 0; j < xvals.size(); j++) {
-    for (int i = 0; i < order; i++) {
-      A(j, i + 1) = A(j, i) * xvals(j);
+  ConfigureLog(log_config);
+
+  MPC::Backend backend = use_sqp ? MPC::SQP : MPC::IPOPT;
+
+  // Every connection gets its own MPC on the solver worker. Building one
+  // here, before the worker starts, fails right away on an unsupported
+  // horizon or kernels that don't match, before a simulator shows up.
+  shared_ptr<MPC_Table> table;
+  try {
+    MPC check_config(config);
+    check_config.SetBackend(backend);
+    if (!table_path.empty()) {
+      table.reset(new MPC_Table);
+      string error;
+      if (!table->Open(table_path, error)) {
+        cerr << error << endl;
+        return -1;
+      }
+      if (!check_config.SetTable(table)) {
+        cerr << table_path << " was solved for other settings or with "
+             << "the other backend" << endl;
+        return -1;
+      }
     }
+  } catch (const exception& e) {
+    cerr << e.what() << endl;
+    return -1;
   }
 
-  auto Q = A.householderQr();
-  auto result = Q.solve(yvals);
-  return result;
-}
-
-int main() {
-  uWS::Hub h;
-
-  // MPC is initialized here!
-  MPC mpc;
-
-  h.onMessage([&mpc](uWS::WebSocket<uWS::SERVER> ws, char *data, size_t length,
-                     uWS::OpCode opCode) {
-    // "42" at the start of the message means there's a websocket message event.
-    // The 4 signifies a websocket message
-    // The 2 signifies a websocket event
-    string sdata = string(data).substr(0, length);
-    cout << sdata << endl;
-    if (sdata.size() > 2 && sdata[0] == '4' && sdata[1] == '2') {
-      string s = hasData(sdata);
-      if (s != "") {
-        auto j = json::parse(s);
-        string event = j[0].get<string>();
-        if (event == "telemetry") {
-          // j[1] is the data JSON object
-          vector<double> ptsx = j[1]["ptsx"];
-          vector<double> ptsy = j[1]["ptsy"];
-          double px = j[1]["x"];
-          double py = j[1]["y"];
-          double psi = j[1]["psi"];
-          double v = j[1]["speed"];
-          double delta = j[1]["steering_angle"];
-          double a = j[1]["throttle"];
-          
-          // Need Eigen vectors for polyfit
-          Eigen::VectorXd ptsx_car(ptsx.size());
-          Eigen::VectorXd ptsy_car(ptsy.size());
-          
-          // Transform the points to the vehicle's orientation
-          for (int i = 0; i < ptsx.size(); i++) {
-            double x = ptsx[i] - px;
-            double y = ptsy[i] - py;
-            ptsx_car[i] = x * cos(-psi) - y * sin(-psi);
-            ptsy_car[i] = x * sin(-psi) + y * cos(-psi);
-          }
-          
-          /*
-          * Calculate steering angle and throttle using MPC.
-          * Both are in between [-1, 1].
-          * Simulator has 100ms latency, so will predict state at that point in time.
-          * This will help the car react to where it is actually at by the point of actuation.
-          */
-          
-          // Fits a 3rd-order polynomial to the above x and y coordinates
-          auto coeffs = polyfit(ptsx_car, ptsy_car, 3);
-          
-          // Calculates the cross track error
-          // Because points were transformed to vehicle coordinates, x & y equal 0 below.
-          // 'y' would otherwise be subtracted from the polyeval value
-          double cte = polyeval(coeffs, 0);
-          
-          // Calculate the orientation error
-          // Derivative of the polyfit goes in atan() below
-          // Because x = 0 in the vehicle coordinates, the higher orders are zero
-          // Leaves only coeffs[1]
-          double epsi = -atan(coeffs[1]);
-          
-          // Center of gravity needed related to psi and epsi
-          const double Lf = 2.67;
-          
-          // Latency for predicting time at actuation
-          const double dt = 0.1;
-          
-          // Predict state after latency
-          // x, y and psi are all zero after transformation above
-          double pred_px = 0.0 + v * dt; // Since psi is zero, cos(0) = 1, can leave out
-          const double pred_py = 0.0; // Since sin(0) = 0, y stays as 0 (y + v * 0 * dt)
-          double pred_psi = 0.0 + v * -delta / Lf * dt;
-          double pred_v = v + a * dt;
-          double pred_cte = cte + v * sin(epsi) * dt;
-          double pred_epsi = epsi + v * -delta / Lf * dt;
-          
-          // Feed in the predicted state values
-          Eigen::VectorXd state(6);
-          state << pred_px, pred_py, pred_psi, pred_v, pred_cte, pred_epsi;
-          
-          // Solve for new actuations (and to show predicted x and y in the future)
-          auto vars = mpc.Solve(state, coeffs);
-          
-          // Calculate steering and throttle
-          // Steering must be divided by deg2rad(25) to normalize within [-1, 1].
-          // Multiplying by Lf takes into account vehicle's turning ability
-          double steer_value = vars[0] / (deg2rad(25) * Lf);
-          double throttle_value = vars[1];
-          
-          // Send values to the simulator
-          json msgJson;
-          msgJson["steering_angle"] = steer_value;
-          msgJson["throttle"] = throttle_value;
-
-          // Display the MPC predicted trajectory
-          vector<double> mpc_x_vals = {state[0]};
-          vector<double> mpc_y_vals = {state[1]};
-
-          // add (x,y) points to list here, points are in reference to the vehicle's coordinate system
-          // the points in the simulator are connected by a Green line
-          
-          for (int i = 2; i < vars.size(); i+=2) {
-            mpc_x_vals.push_back(vars[i]);
-            mpc_y_vals.push_back(vars[i+1]);
-          }
-
-          msgJson["mpc_x"] = mpc_x_vals;
-          msgJson["mpc_y"] = mpc_y_vals;
-
-          // Display the waypoints/reference line
-          vector<double> next_x_vals;
-          vector<double> next_y_vals;
-
-          // add (x,y) points to list here, points are in reference to the vehicle's coordinate system
-          // the points in the simulator are connected by a Yellow line
-          double poly_inc = 2.5;
-          int num_points = 25;
-          
-          for (int i = 1; i < num_points; i++) {
-            next_x_vals.push_back(poly_inc * i);
-            next_y_vals.push_back(polyeval(coeffs, poly_inc * i));
-          }
-          
-          msgJson["next_x"] = next_x_vals;
-          msgJson["next_y"] = next_y_vals;
+  Recorder recorder;
+  if (!record_path.empty() &&
+      !recorder.Open(record_path, config, backend, true)) {
+    Log(LOG_ERROR, LOG_GENERAL, "Can't create recording %s",
+        record_path.c_str());
+    return -1;
+  }
+  SolverWorker worker(h.getLoop(), config, backend,
+                      record_path.empty() ? nullptr : &recorder, table);
+
+  ConfigReload reload = {config_path, config, &worker};
+  uv_signal_t reload_signal;
+  if (!config_path.empty()) {
+    uv_signal_init(h.getLoop(), &reload_signal);
+    reload_signal.data = &reload;
+    uv_signal_start(&reload_signal, OnReloadSignal, SIGHUP);
+  }
 
-          auto msg = "42[\"steer\"," + msgJson.dump() + "]";
-          std::cout << msg << std::endl;
-          // Latency
-          // The purpose is to mimic real driving conditions where
-          // the car doesn't actuate the commands instantly.
-          this_thread::sleep_for(chrono::milliseconds(100));
-          ws.send(msg.data(), msg.length(), uWS::OpCode::TEXT);
-        }
-      } else {
-        // Manual driving
-        std::string msg = "42[\"manual\",{}]";
-        ws.send(msg.data(), msg.length(), uWS::OpCode::TEXT);
-      }
+  h.onMessage([](uWS::WebSocket<uWS::SERVER> ws, char *data, size_t length,
+                 uWS::OpCode opCode) {
+    LogText(LOG_DEBUG, LOG_TELEMETRY, data, length);
+    Connection* connection = static_cast<Connection*>(ws.getUserData());
+    if (connection) {
+      connection->OnMessage(data, length);
     }
   });
 
@@ -222,21 +213,28 @@ int main() {
     }
   });
 
-  h.onConnection([&h](uWS::WebSocket<uWS::SERVER> ws, uWS::HttpRequest req) {
-    std::cout << "Connected!!!" << std::endl;
+  h.onConnection([&h, &worker](uWS::WebSocket<uWS::SERVER> ws,
+                               uWS::HttpRequest req) {
+    ws.setUserData(new Connection(h.getLoop(), ws, worker));
+    Log(LOG_INFO, LOG_GENERAL, "Connected!!!");
   });
 
   h.onDisconnection([&h](uWS::WebSocket<uWS::SERVER> ws, int code,
                          char *message, size_t length) {
+    Connection* connection = static_cast<Connection*>(ws.getUserData());
+    if (connection) {
+      connection->Close();
+      ws.setUserData(nullptr);
+    }
     ws.close();
-    std::cout << "Disconnected" << std::endl;
+    Log(LOG_INFO, LOG_GENERAL, "Disconnected");
   });
 
   int port = 4567;
   if (h.listen(port)) {
-    std::cout << "Listening to port " << port << std::endl;
+    Log(LOG_INFO, LOG_GENERAL, "Listening to port %d", port);
   } else {
-    std::cerr << "Failed to listen to port" << std::endl;
+    Log(LOG_ERROR, LOG_GENERAL, "Failed to listen to port %d", port);
     return -1;
   }
   h.run();
@@ -0,0 +1,213 @@
+// Checks of ParseMessage against json.hpp, run by ctest.
+//
+// Random telemetry messages, formatted the ways a JSON encoder may write
+// them, have to give exactly the values json.hpp reads from them.
+// Every truncation of a message has to be rejected, and randomly mutated
+// messages must not crash or read past their end. Each message sits in a
+// buffer of exactly its length, so building with -fsanitize=address
+// catches any read beyond it. Inputs are random with a fixed seed, so a
+// failure reproduces.
+//
+//   ./mpc_protocol_test
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "Protocol.h"
+#include "json.hpp"
+
+using json = nlohmann::json;
+
+static int failures = 0;
+
+// Reports the first few failures, counts all of them
+static void Check(bool condition, const string& what) {
+  if (!condition) {
+    if (failures < 20) {
+      cerr << "FAILED: " << what << endl;
+    }
+    failures++;
+  }
+}
+
+// Equal values. json.hpp reads "-0" as the integer 0, so the sign of a
+// zero can't be compared
+static bool Same(double a, double b) {
+  return a == b;
+}
+
+// Parses a copy of message in a buffer of exactly its size
+static MessageKind Parse(const string& message, Telemetry& telemetry) {
+  vector<char> buffer(message.begin(), message.end());
+  return ParseMessage(buffer.data(), buffer.size(), telemetry);
+}
+
+// A number as an encoder might print it: shortest, fixed or exponent
+static string Format(double value, mt19937_64& random) {
+  char buffer[40];
+  switch (random() % 4) {
+    case 0:
+      return json(value).dump();
+    case 1:
+      snprintf(buffer, sizeof(buffer), "%.*f", int(random() % 10), value);
+      break;
+    case 2:
+      snprintf(buffer, sizeof(buffer), "%.*e", int(random() % 17), value);
+      break;
+    default:
+      snprintf(buffer, sizeof(buffer), "%.17g", value);
+      break;
+  }
+  return buffer;
+}
+
+// Whitespace the encoder may put between tokens
+static string Space(mt19937_64& random) {
+  static const char* spaces[] = {"", "", "", " ", "\n", " \t\r\n "};
+  return spaces[random() % 6];
+}
+
+// A telemetry message with the fields of DATA.md in random order, plus
+// one the controller doesn't read
+static string RandomMessage(mt19937_64& random) {
+  uniform_real_distribution<double> position(-200.0, 200.0);
+  uniform_real_distribution<double> unit(-1.0, 1.0);
+  vector<string> fields;
+  for (const char* name : {"ptsx", "ptsy"}) {
+    string array = "[" + Space(random);
+    size_t points = random() % 12;
+    for (size_t i = 0; i < points; i++) {
+      array += (i ? "," + Space(random) : "") + Format(position(random), random);
+    }
+    fields.push_back("\"" + string(name) + "\":" + Space(random) + array +
+                     Space(random) + "]");
+  }
+  for (const char* name : {"x", "y", "psi", "psi_unity", "speed",
+                           "steering_angle", "throttle"}) {
+    double value = string(name) == "x" || string(name) == "y"
+                       ? position(random)
+                       : unit(random) * 100;
+    fields.push_back("\"" + string(name) + "\":" + Space(random) +
+                     Format(value, random));
+  }
+  shuffle(fields.begin(), fields.end(), random);
+  string object = "{" + Space(random);
+  for (size_t i = 0; i < fields.size(); i++) {
+    object += (i ? "," + Space(random) : "") + fields[i];
+  }
+  object += Space(random) + "}";
+  return "42[" + Space(random) + "\"telemetry\"," + Space(random) + object +
+         Space(random) + "]";
+}
+
+static void TestAgainstJson(mt19937_64& random) {
+  for (int i = 0; i < 20000; i++) {
+    string message = RandomMessage(random);
+    Telemetry telemetry;
+    bool parsed = Parse(message, telemetry) == TELEMETRY_MESSAGE;
+    Check(parsed, "telemetry read from " + message);
+    if (!parsed) {
+      continue;
+    }
+
+    json data = json::parse(message.substr(2))[1];
+    vector<double> ptsx = data["ptsx"];
+    vector<double> ptsy = data["ptsy"];
+    bool same = ptsx.size() == telemetry.ptsx.size() &&
+                ptsy.size() == telemetry.ptsy.size();
+    for (size_t k = 0; same && k < ptsx.size(); k++) {
+      same = Same(ptsx[k], telemetry.ptsx[k]);
+    }
+    for (size_t k = 0; same && k < ptsy.size(); k++) {
+      same = Same(ptsy[k], telemetry.ptsy[k]);
+    }
+    same = same && Same(data["x"].get<double>(), telemetry.x) &&
+           Same(data["y"].get<double>(), telemetry.y) &&
+           Same(data["psi"].get<double>(), telemetry.psi) &&
+           Same(data["speed"].get<double>(), telemetry.speed) &&
+           Same(data["steering_angle"].get<double>(),
+                telemetry.steering_angle) &&
+           Same(data["throttle"].get<double>(), telemetry.throttle);
+    Check(same, "values read like json.hpp from " + message);
+
+    // The bare object of a recording or a --frames file. json.hpp dumps
+    // 15 digits, so compare with what it reads back
+    string object = data.dump();
+    json reread = json::parse(object);
+    Telemetry bare;
+    Check(ParseTelemetryObject(object.data(), object.size(), bare) &&
+              Same(bare.x, reread["x"].get<double>()) &&
+              Same(bare.throttle, reread["throttle"].get<double>()) &&
+              bare.ptsx.size() == telemetry.ptsx.size(),
+          "bare object read from " + object);
+  }
+}
+
+static void TestKinds() {
+  Telemetry telemetry;
+  Check(Parse("42[\"telemetry\",null]", telemetry) == MANUAL_MESSAGE,
+        "null data is manual driving");
+  Check(Parse("42[\"manual\",{}]", telemetry) == OTHER_MESSAGE,
+        "other events are other");
+  Check(Parse("2", telemetry) == OTHER_MESSAGE, "pings are other");
+  Check(Parse("", telemetry) == OTHER_MESSAGE, "empty is other");
+  Check(Parse("42[\"telemetry\",{\"x\":1}]", telemetry) == MANUAL_MESSAGE,
+        "missing fields are rejected");
+}
+
+static void TestTruncated(mt19937_64& random) {
+  for (int i = 0; i < 300; i++) {
+    string message = RandomMessage(random);
+    Telemetry telemetry;
+    for (size_t n = 0; n < message.size(); n++) {
+      Check(Parse(message.substr(0, n), telemetry) != TELEMETRY_MESSAGE,
+            "truncated to " + message.substr(0, n));
+    }
+  }
+}
+
+// Only checks that nothing crashes and nothing is read out of bounds,
+// whatever a mutated message turns out to be
+static void TestMutated(mt19937_64& random) {
+  static const char bytes[] = "0123456789-+.eE,:[]{}\" \\nul";
+  for (int i = 0; i < 100000; i++) {
+    string message = RandomMessage(random);
+    for (int edits = 1 + random() % 4; edits > 0 && !message.empty();
+         edits--) {
+      size_t at = random() % message.size();
+      char byte = random() % 2 ? bytes[random() % (sizeof(bytes) - 1)]
+                               : char(random() % 256);
+      switch (random() % 3) {
+        case 0:
+          message[at] = byte;
+          break;
+        case 1:
+          message.insert(message.begin() + at, byte);
+          break;
+        default:
+          message.erase(at, 1 + random() % 8);
+          break;
+      }
+    }
+    Telemetry telemetry;
+    Parse(message, telemetry);
+  }
+}
+
+int main() {
+  mt19937_64 random(11);
+  TestKinds();
+  TestAgainstJson(random);
+  TestTruncated(random);
+  TestMutated(random);
+  if (failures > 0) {
+    cerr << failures << " checks failed" << endl;
+    return 1;
+  }
+  cout << "All checks passed" << endl;
+  return 0;
+}
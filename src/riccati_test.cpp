@@ -0,0 +1,92 @@
+// Checks of the SQP backend's Riccati QP solve against the condensed one,
+// run by ctest.
+//
+// Both solve the same QPs, the condensed way over the actuations alone
+// with a dense factorization, the Riccati way stage by stage. On random
+// problems they have to agree on the solution, over a cold start and the
+// warm started iterations after it. They reach it by different
+// arithmetic, so the solutions differ by more than rounding. The gap
+// grows with N and has been seen up to 1.4e-6 at N = 25, so the
+// tolerance is 1e-5. Inputs are random with a fixed seed, so a failure
+// reproduces.
+//
+//   ./mpc_riccati_test
+
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+#include "Eigen-3.3/Eigen/Core"
+#include "MPC_SQP.h"
+
+using namespace std;
+
+static int failures = 0;
+
+// Reports the first few failures, counts all of them
+static void Check(bool condition, const string& what) {
+  if (!condition) {
+    if (failures < 20) {
+      cerr << "FAILED: " << what << endl;
+    }
+    failures++;
+  }
+}
+
+// Largest allowed difference between the two solutions
+static const double tolerance = 1e-5;
+
+// Solves of each problem, the first one cold
+static const int solves = 3;
+
+template <size_t N>
+static void TestHorizon(mt19937_64& random, int problems) {
+  uniform_real_distribution<double> unit(-1.0, 1.0);
+  MPC_Config config;
+  config.N = N;
+  MPC_SQP<N> condensed(config);
+  config.linear_solver = RICCATI_SOLVER;
+  MPC_SQP<N> riccati(config);
+
+  double max_gap = 0;
+  for (int problem = 0; problem < problems; problem++) {
+    // A reference line ahead of the car, curving up to a tight bend
+    Eigen::VectorXd coeffs(n_coeffs);
+    coeffs << 3 * unit(random), 0.5 * unit(random), 0.02 * unit(random),
+        2e-4 * unit(random);
+    Eigen::VectorXd state(6);
+    state << 0.0, 0.0, 0.0, 40 + 40 * unit(random), coeffs[0],
+        -atan(coeffs[1]);
+
+    condensed.Reset();
+    riccati.Reset();
+    for (int solve = 0; solve < solves; solve++) {
+      condensed.Solve(state, coeffs);
+      riccati.Solve(state, coeffs);
+      double gap =
+          (condensed.solution() - riccati.solution()).cwiseAbs().maxCoeff();
+      max_gap = max(max_gap, gap);
+      string which = "N = " + to_string(N) + " problem " +
+                     to_string(problem) + " solve " + to_string(solve);
+      Check(condensed.converged() == riccati.converged(),
+            which + " converges with both or neither");
+      Check(gap <= tolerance, which + " solutions differ by " +
+                                  to_string(gap));
+    }
+  }
+  cout << "N = " << N << ": largest difference " << max_gap << endl;
+}
+
+int main() {
+  mt19937_64 random(21);
+  TestHorizon<10>(random, 2000);
+  TestHorizon<15>(random, 2000);
+  TestHorizon<20>(random, 2000);
+  TestHorizon<25>(random, 2000);
+  if (failures > 0) {
+    cerr << failures << " checks failed" << endl;
+    return 1;
+  }
+  cout << "All checks passed" << endl;
+  return 0;
+}
@@ -0,0 +1,180 @@
+// Headless closed-loop simulation on the lake track.
+//
+// Drives the kinematic (or dynamic) bicycle model in Simulator around
+// lake_track_waypoints.csv with the controller in the loop, faster than
+// real time, and reports lap time, cross track error and controller
+// latency. Exits with 1 if a lap isn't completed, so it can be used as a
+// regression test.
+//
+// --config reads solver settings from a config file (see ConfigFile.h);
+// arguments after it override them. --table answers the problems it
+// covers from an explicit MPC table (see MPC_Table.h).
+//
+//   ./mpc_sim [--waypoints FILE] [--laps K] [--config FILE] [--table FILE]
+//             [--sqp] [--analytic | --compiled]
+//             [--linear-solver NAME] [--N 10|15|20|25]
+//             [--ref-v MPH] [--dynamic] [--latency S] [--period S] [--add-compute-time]
+//             [--max-cte M]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "ConfigFile.h"
+#include "MPC.h"
+#include "MPC_Table.h"
+#include "Simulator.h"
+#include "SolveStats.h"
+#include "Track.h"
+
+int main(int argc, char* argv[]) {
+  string waypoints_path = "../lake_track_waypoints.csv";
+  size_t laps = 3;
+  bool use_sqp = false;
+  MPC_Config config;
+  SimConfig sim_config;
+  string table_path;
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (arg == "--waypoints" && i + 1 < argc) {
+      waypoints_path = argv[++i];
+    } else if (arg == "--laps" && i + 1 < argc) {
+      if (!ParseCount(argv[++i], laps)) {
+        cerr << "Bad value for " << arg << ": " << argv[i] << endl;
+        return 1;
+      }
+    } else if (arg == "--config" && i + 1 < argc) {
+      string error;
+      if (!LoadConfigFile(argv[++i], config, error)) {
+        cerr << error << endl;
+        return 1;
+      }
+    } else if (arg == "--table" && i + 1 < argc) {
+      table_path = argv[++i];
+    } else if (arg == "--N" && i + 1 < argc) {
+      if (!ParseCount(argv[++i], config.N)) {
+        cerr << "Bad value for " << arg << ": " << argv[i] << endl;
+        return 1;
+      }
+    } else if (arg == "--ref-v" && i + 1 < argc) {
+      if (!ParseNumber(argv[++i], config.ref_v)) {
+        cerr << "Bad value for " << arg << ": " << argv[i] << endl;
+        return 1;
+      }
+    } else if (arg == "--latency" && i + 1 < argc) {
+      if (!ParseNumber(argv[++i], sim_config.latency)) {
+        cerr << "Bad value for " << arg << ": " << argv[i] << endl;
+        return 1;
+      }
+    } else if (arg == "--period" && i + 1 < argc) {
+      if (!ParseNumber(argv[++i], sim_config.control_period)) {
+        cerr << "Bad value for " << arg << ": " << argv[i] << endl;
+        return 1;
+      }
+    } else if (arg == "--max-cte" && i + 1 < argc) {
+      if (!ParseNumber(argv[++i], sim_config.max_cte)) {
+        cerr << "Bad value for " << arg << ": " << argv[i] << endl;
+        return 1;
+      }
+    } else if (arg == "--sqp") {
+      use_sqp = true;
+    } else if (arg == "--analytic") {
+      config.derivatives = ANALYTIC_DERIVATIVES;
+    } else if (arg == "--compiled") {
+      config.derivatives = COMPILED_DERIVATIVES;
+    } else if (arg == "--linear-solver" && i + 1 < argc &&
+               ParseLinearSolver(argv[i + 1], config.linear_solver)) {
+      i++;
+    } else if (arg == "--dynamic") {
+      sim_config.dynamic = true;
+    } else if (arg == "--add-compute-time") {
+      sim_config.add_compute_time = true;
+    } else {
+      cerr << "Unknown argument " << arg << endl;
+      return 1;
+    }
+  }
+
+  Track track;
+  if (!track.Load(waypoints_path)) {
+    cerr << "Failed to read waypoints from " << waypoints_path << endl;
+    return 1;
+  }
+
+  string error;
+  if (!MPC::Supports(config, error)) {
+    cerr << error << endl;
+    return 1;
+  }
+  MPC mpc(config);
+  mpc.SetWarmStart(true);
+  if (use_sqp) {
+    mpc.SetBackend(MPC::SQP);
+  }
+  if (!table_path.empty()) {
+    shared_ptr<MPC_Table> table(new MPC_Table);
+    if (!table->Open(table_path, error)) {
+      cerr << error << endl;
+      return 1;
+    }
+    if (!mpc.SetTable(table)) {
+      cerr << table_path << " was solved for other settings or with "
+           << "the other backend" << endl;
+      return 1;
+    }
+  }
+  Simulator sim(track, sim_config, mpc);
+
+  cout << "Backend "
+       << (use_sqp ? string("SQP")
+                   : string("Ipopt, ") +
+                         DerivativeModeName(config.derivatives) +
+                         " derivatives")
+       << ", " << LinearSolverName(config.linear_solver) << " linear solver"
+       << ", N " << config.N
+       << ", " << (sim_config.dynamic ? "dynamic" : "kinematic")
+       << " model, track " << track.length() << " m" << endl;
+
+  // The first lap starts from standstill, so report it but keep the
+  // best lap separately
+  auto wall_start = chrono::steady_clock::now();
+  size_t completed = 0;
+  double best_lap = 0;
+  double max_cte = 0;
+  for (size_t k = 0; k < laps; k++) {
+    LapResult lap = sim.RunLap();
+    char line[200];
+    snprintf(line, sizeof(line),
+             "lap %3zu %s  time %7.2f s  max cte %5.2f m  mean cte %5.2f m"
+             "  max speed %6.2f mph  mean speed %6.2f mph",
+             k + 1, lap.completed ? "ok    " : "FAILED", lap.lap_time,
+             lap.max_cte, lap.mean_cte, lap.max_speed_mph,
+             lap.mean_speed_mph);
+    cout << line << endl;
+    max_cte = max(max_cte, lap.max_cte);
+    if (!lap.completed) {
+      break;
+    }
+    completed++;
+    if (best_lap == 0 || lap.lap_time < best_lap) {
+      best_lap = lap.lap_time;
+    }
+  }
+  double wall = ElapsedMicros(wall_start) * 1e-6;
+
+  vector<double> latency = sim.controller_us();
+  sort(latency.begin(), latency.end());
+  cout << completed << "/" << laps << " laps, best " << best_lap
+       << " s, max cte " << max_cte << " m, " << wall << " s wall time ("
+       << completed * 60.0 / wall << " laps/min)" << endl;
+  if (!latency.empty()) {
+    cout << "Controller latency us p50 " << Percentile(latency, 0.50)
+         << " p99 " << Percentile(latency, 0.99) << " max " << latency.back()
+         << endl;
+  }
+  cout << "MPC " << mpc.Summary() << endl;
+  return completed == laps ? 0 : 1;
+}
@@ -0,0 +1,135 @@
+// Checks of MPC::Solve and MPC::SolveBatch with the default Ipopt
+// backend and taped derivatives, run by ctest.
+//
+// A tol too tight to ever be met makes Ipopt stop at its acceptable
+// level instead (15 iterations in a row within acceptable_tol). That
+// solution converged, so it has to be used as the plan and counted as
+// ok, the same as one that met tol.
+//
+// SolveBatch runs more slots than there are workers, twice so the second
+// round warm starts, and has to give what Solve gives for each problem.
+// Every Ipopt iteration reallocates CppAD's sweep buffers, which fails
+// if a slot's tape moves between threads.
+//
+//   ./mpc_solve_test
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <coin/IpIpoptApplication.hpp>
+#include "MPC.h"
+
+static int failures = 0;
+
+static void Check(bool condition, const string& what) {
+  if (!condition) {
+    cerr << "FAILED: " << what << endl;
+    failures++;
+  }
+}
+
+// A straight reference line 1 m to the side, at 30 mph
+static void Problem(Eigen::VectorXd& state, Eigen::VectorXd& coeffs) {
+  coeffs = Eigen::VectorXd(4);
+  coeffs << 1.0, 0.0, 0.0, 0.0;
+  state = Eigen::VectorXd(6);
+  state << 0.0, 0.0, 0.0, 30.0, coeffs[0], -atan(coeffs[1]);
+}
+
+static void TestAcceptableLevel(bool warm_start) {
+  MPC_Config config;
+  config.tol = 1e-30;
+  config.deadline = INFINITY;
+  config.max_cpu_time = 10;
+  MPC mpc(config);
+  mpc.SetWarmStart(warm_start);
+  Eigen::VectorXd state, coeffs;
+  Problem(state, coeffs);
+
+  // The second solve warm starts from the first when enabled
+  string name = warm_start ? "warm" : "cold";
+  for (int solve = 1; solve <= 2; solve++) {
+    vector<double> solved = mpc.Solve(state, coeffs);
+    string which = name + " solve " + to_string(solve);
+    Check(mpc.stats().status == Ipopt::Solved_To_Acceptable_Level,
+          which + " stops at the acceptable level, status " +
+              to_string(mpc.stats().status));
+    Check(mpc.ok(), which + " is ok");
+    Check(mpc.stats().source == SOLVER_PLAN,
+          which + " is the solver plan, not " +
+              ActuationSourceName(mpc.stats().source));
+    Check(!mpc.stats().deadline_hit, which + " has no deadline");
+    Check(solved.size() == 2 + 2 * config.N && std::isfinite(solved[0]) &&
+              std::isfinite(solved[1]),
+          which + " returns the actuations and path");
+  }
+}
+
+// Reference lines up to 2 m to the side at 20 to 50 mph
+static void BatchProblem(size_t k, Eigen::VectorXd& state,
+                         Eigen::VectorXd& coeffs) {
+  coeffs = Eigen::VectorXd(4);
+  coeffs << 0.25 * (k % 9), 0.01, 0.0, 0.0;
+  state = Eigen::VectorXd(6);
+  state << 0.0, 0.0, 0.0, 20.0 + 2.0 * (k % 16), coeffs[0],
+      -atan(coeffs[1]);
+}
+
+static void TestSolveBatch() {
+  MPC_Config config;
+  config.deadline = INFINITY;
+  const size_t K = 2 * max(1u, thread::hardware_concurrency()) + 1;
+  vector<Eigen::VectorXd> states(K);
+  vector<Eigen::VectorXd> coeffs(K);
+  for (size_t k = 0; k < K; k++) {
+    BatchProblem(k, states[k], coeffs[k]);
+  }
+
+  // Each problem on its own, cold
+  MPC single(config);
+  vector<vector<double>> expected(K);
+  for (size_t k = 0; k < K; k++) {
+    expected[k] = single.Solve(states[k], coeffs[k]);
+  }
+
+  MPC batch(config);
+  batch.SetWarmStart(true);
+  for (int round = 1; round <= 2; round++) {
+    vector<vector<double>> solved = batch.SolveBatch(states, coeffs);
+    vector<SolveStats> recent;
+    batch.RecentStats(recent);
+    string which = "batch round " + to_string(round);
+    Check(solved.size() == K && recent.size() >= K * round,
+          which + " solves every slot");
+    for (size_t k = 0; k < K && k < solved.size(); k++) {
+      string slot = which + " slot " + to_string(k);
+      Check(solved[k].size() == expected[k].size(), slot + " has a plan");
+      if (solved[k].size() == expected[k].size()) {
+        Check(fabs(solved[k][0] - expected[k][0]) < 1e-4 &&
+                  fabs(solved[k][1] - expected[k][1]) < 1e-4,
+              slot + " matches Solve");
+      }
+    }
+    for (size_t i = recent.size() - min(recent.size(), K); i < recent.size();
+         i++) {
+      Check(recent[i].ok && recent[i].source == SOLVER_PLAN,
+            which + " converges, not " +
+                ActuationSourceName(recent[i].source));
+    }
+  }
+}
+
+int main() {
+  TestAcceptableLevel(false);
+  TestAcceptableLevel(true);
+  TestSolveBatch();
+  if (failures > 0) {
+    cerr << failures << " checks failed" << endl;
+    return 1;
+  }
+  cout << "All checks passed" << endl;
+  return 0;
+}
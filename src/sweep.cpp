@@ -0,0 +1,383 @@
+// Parallel parameter sweep of the controller in closed loop.
+//
+// Runs the laps of mpc_sim for many solver settings at once, one setting
+// per job on a ThreadPool with a worker per core, and writes a CSV row per
+// setting: laps completed, best and mean lap time, RMS and largest cross
+// track error, largest steering rate, solve time percentiles and the
+// number of messages a fallback answered (see ActuationSource).
+//
+// --vary KEY=V1,V2,... gives the values of one setting, and every
+// combination of them is run. --samples K instead (or as well) runs K
+// random settings per combination, each --range KEY=LO:HI drawn
+// uniformly and each --log-range KEY=LO:HI log-uniformly, which suits
+// the cost weights. Keys are those of ConfigFile.h; everything not swept
+// comes from --config or the defaults. The rows are in job order, the
+// first --vary changing slowest.
+//
+// Jobs take very different times (a setting that leaves the track ends
+// early, N = 25 solves slower than N = 10), so they are handed out one
+// at a time and a slow one never holds up the rest. The simulated clock
+// doesn't depend on wall time, so the results don't depend on the number
+// of threads, unless --add-compute-time is given or Ipopt runs into its
+// deadline. Ipopt with MUMPS or MA27 takes turns across threads, see
+// MPC_Horizon.cpp; the SQP backend and the other linear solvers don't.
+//
+//   ./mpc_sweep [--vary KEY=V1,V2,...]... [--range KEY=LO:HI]...
+//               [--log-range KEY=LO:HI]... [--samples K] [--seed S]
+//               [--config FILE] [--sqp] [--laps K] [--threads T]
+//               [--waypoints FILE] [--dynamic] [--output FILE]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ConfigFile.h"
+#include "MPC.h"
+#include "MPC_Horizon.h"
+#include "Simulator.h"
+#include "SolveStats.h"
+#include "ThreadPool.h"
+#include "Track.h"
+
+// One swept setting: the values of a grid axis, or the interval of a
+// random one
+struct SweepAxis {
+  string key;
+  vector<string> values;
+  double low = 0;
+  double high = 0;
+  bool log_scale = false;
+};
+
+// The settings of one job, and the swept values as they go in the CSV
+struct SweepJob {
+  MPC_Config config;
+  vector<string> values;
+};
+
+// What came out of one job
+struct SweepResult {
+  size_t completed = 0;
+  double best_lap = 0;
+  double mean_lap = 0;
+  double rms_cte = 0;
+  double max_cte = 0;
+  double max_steer_rate = 0;
+  double solve_p50_us = 0;
+  double solve_p99_us = 0;
+  double solve_max_us = 0;
+  size_t fallbacks = 0;
+
+  // Why the settings couldn't be run, empty if they could
+  string error;
+};
+
+// Splits KEY=REST, false without a key
+static bool SplitKey(const string& arg, string& key, string& rest) {
+  size_t equals = arg.find('=');
+  if (equals == string::npos || equals == 0) {
+    return false;
+  }
+  key = arg.substr(0, equals);
+  rest = arg.substr(equals + 1);
+  return true;
+}
+
+static bool ParseValues(const string& arg, SweepAxis& axis) {
+  string rest;
+  if (!SplitKey(arg, axis.key, rest)) {
+    return false;
+  }
+  stringstream values(rest);
+  string value;
+  while (getline(values, value, ',')) {
+    axis.values.push_back(value);
+  }
+  return !axis.values.empty();
+}
+
+static bool ParseRange(const string& arg, bool log_scale, SweepAxis& axis) {
+  string rest;
+  if (!SplitKey(arg, axis.key, rest)) {
+    return false;
+  }
+  axis.log_scale = log_scale;
+  char colon;
+  stringstream range(rest);
+  return (range >> axis.low >> colon >> axis.high) && colon == ':' &&
+         range.peek() == EOF && axis.low <= axis.high &&
+         (!log_scale || axis.low > 0);
+}
+
+// Every combination of the grid values, times samples random draws of
+// the ranges (once if there are none). Returns false with error set if
+// a value can't be applied.
+static bool BuildJobs(const MPC_Config& base, const vector<SweepAxis>& grid,
+                      const vector<SweepAxis>& ranges, size_t samples,
+                      uint64_t seed, vector<SweepJob>& jobs, string& error) {
+  size_t combinations = 1;
+  for (const SweepAxis& axis : grid) {
+    combinations *= axis.values.size();
+  }
+  size_t draws = ranges.empty() ? 1 : samples;
+
+  mt19937_64 random(seed);
+  uniform_real_distribution<double> unit(0.0, 1.0);
+  for (size_t c = 0; c < combinations; c++) {
+    SweepJob point;
+    point.config = base;
+
+    // Mixed radix digits of c, the last axis changing fastest
+    size_t rest = c;
+    point.values.resize(grid.size());
+    for (size_t i = grid.size(); i-- > 0;) {
+      point.values[i] = grid[i].values[rest % grid[i].values.size()];
+      rest /= grid[i].values.size();
+    }
+    for (size_t i = 0; i < grid.size(); i++) {
+      if (!ApplySetting(grid[i].key, point.values[i], point.config, error)) {
+        return false;
+      }
+    }
+
+    for (size_t d = 0; d < draws; d++) {
+      SweepJob job = point;
+      for (const SweepAxis& axis : ranges) {
+        double u = unit(random);
+        double value =
+            axis.log_scale
+                ? exp(log(axis.low) + u * (log(axis.high) - log(axis.low)))
+                : axis.low + u * (axis.high - axis.low);
+        char text[32];
+        snprintf(text, sizeof(text), "%.6g", value);
+        job.values.push_back(text);
+        if (!ApplySetting(axis.key, text, job.config, error)) {
+          return false;
+        }
+      }
+      if (!CheckConfig(job.config, error)) {
+        return false;
+      }
+      jobs.push_back(job);
+    }
+  }
+  return true;
+}
+
+// Drives laps with one setting. Runs on a pool worker; the MPC is
+// created, used and destroyed there, so CppAD only ever sees memory of
+// the worker's own thread.
+static void RunJob(const Track& track, const SimConfig& sim_config,
+                   bool use_sqp, size_t laps, const SweepJob& job,
+                   SweepResult& result) {
+  try {
+    MPC mpc(job.config);
+    mpc.SetWarmStart(true);
+    if (use_sqp) {
+      mpc.SetBackend(MPC::SQP);
+    }
+    Simulator sim(track, sim_config, mpc);
+
+    double lap_sum = 0;
+    double time_sum = 0;
+    double cte_squares = 0;
+    for (size_t k = 0; k < laps; k++) {
+      LapResult lap = sim.RunLap();
+
+      // Laps are sampled at the physics rate, so time weights them
+      time_sum += lap.lap_time;
+      cte_squares += lap.rms_cte * lap.rms_cte * lap.lap_time;
+      result.max_cte = max(result.max_cte, lap.max_cte);
+      result.max_steer_rate = max(result.max_steer_rate, lap.max_steer_rate);
+      result.fallbacks += lap.fallbacks;
+      if (!lap.completed) {
+        break;
+      }
+      result.completed++;
+      lap_sum += lap.lap_time;
+      if (result.best_lap == 0 || lap.lap_time < result.best_lap) {
+        result.best_lap = lap.lap_time;
+      }
+    }
+    result.mean_lap = result.completed ? lap_sum / result.completed : 0.0;
+    result.rms_cte = time_sum > 0 ? sqrt(cte_squares / time_sum) : 0.0;
+
+    vector<double> solve = sim.solve_us();
+    sort(solve.begin(), solve.end());
+    if (!solve.empty()) {
+      result.solve_p50_us = Percentile(solve, 0.50);
+      result.solve_p99_us = Percentile(solve, 0.99);
+      result.solve_max_us = solve.back();
+    }
+  } catch (const exception& e) {
+    result.error = e.what();
+  }
+}
+
+// Quotes a CSV field if it needs it
+static string CsvField(const string& text) {
+  if (text.find_first_of(",\"\n") == string::npos) {
+    return text;
+  }
+  string quoted = "\"";
+  for (char c : text) {
+    quoted += c;
+    if (c == '"') {
+      quoted += c;
+    }
+  }
+  return quoted + "\"";
+}
+
+static void WriteCsv(ostream& out, const vector<SweepAxis>& axes,
+                     const vector<SweepJob>& jobs,
+                     const vector<SweepResult>& results) {
+  for (const SweepAxis& axis : axes) {
+    out << CsvField(axis.key) << ",";
+  }
+  out << "completed_laps,best_lap_s,mean_lap_s,rms_cte_m,max_cte_m,"
+         "max_steer_rate_deg_s,solve_p50_us,solve_p99_us,solve_max_us,"
+         "fallbacks,error\n";
+  for (size_t j = 0; j < jobs.size(); j++) {
+    for (const string& value : jobs[j].values) {
+      out << CsvField(value) << ",";
+    }
+    const SweepResult& r = results[j];
+    out << r.completed << "," << r.best_lap << "," << r.mean_lap << ","
+        << r.rms_cte << "," << r.max_cte << "," << r.max_steer_rate << ","
+        << r.solve_p50_us << "," << r.solve_p99_us << "," << r.solve_max_us
+        << "," << r.fallbacks << "," << CsvField(r.error) << "\n";
+  }
+}
+
+int main(int argc, char* argv[]) {
+  string waypoints_path = "../lake_track_waypoints.csv";
+  string output_path;
+  size_t laps = 3;
+  size_t samples = 0;
+  uint64_t seed = 1;
+  bool use_sqp = false;
+  MPC_Config config;
+  SimConfig sim_config;
+  vector<SweepAxis> grid;
+  vector<SweepAxis> ranges;
+
+  // CppAD has a memory pool for a worker per core, see SetupParallelAD
+  const size_t max_threads = max(1u, thread::hardware_concurrency());
+  size_t threads = max_threads;
+
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    SweepAxis axis;
+    if (arg == "--vary" && i + 1 < argc && ParseValues(argv[i + 1], axis)) {
+      grid.push_back(axis);
+      i++;
+    } else if ((arg == "--range" || arg == "--log-range") && i + 1 < argc &&
+               ParseRange(argv[i + 1], arg == "--log-range", axis)) {
+      ranges.push_back(axis);
+      i++;
+    } else if (arg == "--samples" && i + 1 < argc) {
+      if (!ParseCount(argv[++i], samples)) {
+        cerr << "Bad value for " << arg << ": " << argv[i] << endl;
+        return 1;
+      }
+    } else if (arg == "--seed" && i + 1 < argc) {
+      size_t seed_value;
+      if (!ParseCount(argv[++i], seed_value)) {
+        cerr << "Bad value for " << arg << ": " << argv[i] << endl;
+        return 1;
+      }
+      seed = seed_value;
+    } else if (arg == "--config" && i + 1 < argc) {
+      string error;
+      if (!LoadConfigFile(argv[++i], config, error)) {
+        cerr << error << endl;
+        return 1;
+      }
+    } else if (arg == "--sqp") {
+      use_sqp = true;
+    } else if (arg == "--laps" && i + 1 < argc) {
+      if (!ParseCount(argv[++i], laps)) {
+        cerr << "Bad value for " << arg << ": " << argv[i] << endl;
+        return 1;
+      }
+    } else if (arg == "--threads" && i + 1 < argc) {
+      if (!ParseCount(argv[++i], threads)) {
+        cerr << "Bad value for " << arg << ": " << argv[i] << endl;
+        return 1;
+      }
+      threads = min(max_threads, max<size_t>(1, threads));
+    } else if (arg == "--waypoints" && i + 1 < argc) {
+      waypoints_path = argv[++i];
+    } else if (arg == "--dynamic") {
+      sim_config.dynamic = true;
+    } else if (arg == "--add-compute-time") {
+      sim_config.add_compute_time = true;
+    } else if (arg == "--output" && i + 1 < argc) {
+      output_path = argv[++i];
+    } else {
+      cerr << "Unknown argument " << arg << endl;
+      return 1;
+    }
+  }
+  if (!ranges.empty() && samples == 0) {
+    cerr << "--range and --log-range need --samples" << endl;
+    return 1;
+  }
+
+  vector<SweepJob> jobs;
+  string error;
+  if (!BuildJobs(config, grid, ranges, samples, seed, jobs, error)) {
+    cerr << error << endl;
+    return 1;
+  }
+
+  Track track;
+  if (!track.Load(waypoints_path)) {
+    cerr << "Failed to read waypoints from " << waypoints_path << endl;
+    return 1;
+  }
+
+  // Has to happen before the first MPC is created on a worker
+  SetupParallelAD(max_threads);
+
+  vector<SweepResult> results(jobs.size());
+  auto wall_start = chrono::steady_clock::now();
+  {
+    ThreadPool pool(threads);
+    pool.ParallelFor(jobs.size(), [&](size_t j) {
+      RunJob(track, sim_config, use_sqp, laps, jobs[j], results[j]);
+    });
+  }
+  double wall = ElapsedMicros(wall_start) * 1e-6;
+
+  vector<SweepAxis> axes = grid;
+  axes.insert(axes.end(), ranges.begin(), ranges.end());
+  if (output_path.empty()) {
+    WriteCsv(cout, axes, jobs, results);
+  } else {
+    ofstream out(output_path);
+    WriteCsv(out, axes, jobs, results);
+    if (!out) {
+      cerr << "Failed to write " << output_path << endl;
+      return 1;
+    }
+  }
+
+  size_t finished = 0;
+  for (const SweepResult& result : results) {
+    if (result.error.empty() && result.completed == laps) {
+      finished++;
+    }
+  }
+  cerr << jobs.size() << " settings on " << threads << " threads in " << wall
+       << " s, " << finished << " completed all " << laps << " laps" << endl;
+  return 0;
+}
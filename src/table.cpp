@@ -0,0 +1,297 @@
+// Generates an explicit MPC table, see MPC_Table.h.
+//
+// The problems come from closed-loop laps of the lake track with the
+// online solver, as in mpc_sim, so they cover the states and reference
+// lines the car actually sees with the given settings. Each of them is
+// copied --copies times with every key dimension moved by a normally
+// distributed --spread times the spread of that dimension, to fill the
+// space around the laps. All of them are then solved cold, in parallel
+// with one solver per core. The converged ones make up the table, which
+// answers within --radius (in spreads) of a record where its fit to the
+// neighbours is within --tolerance (a fraction of the actuator limits).
+//
+// The laps and the solves run without a deadline or CPU time limit, so
+// the table doesn't depend on the number of threads or on how fast or
+// busy the machine is. Before the table is written, a check lap is
+// driven with it. If that lap isn't completed, nothing is written.
+//
+// Load it with --table in mpc, mpc_sim or mpc_bench; it only answers for
+// the horizon, timestep, reference speed and weights it was solved with,
+// and with the same backend (--sqp or not).
+//
+//   ./mpc_table [--config FILE] [--sqp] [--laps K] [--copies C]
+//               [--spread S] [--radius R] [--tolerance T] [--seed S]
+//               [--threads T] [--waypoints FILE] [--dynamic]
+//               [--output FILE]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ConfigFile.h"
+#include "MPC.h"
+#include "MPC_Horizon.h"
+#include "MPC_Table.h"
+#include "Simulator.h"
+#include "SolveStats.h"
+#include "ThreadPool.h"
+#include "Track.h"
+
+// A problem MPC::Solve was given, as a table key
+struct Problem {
+  double key[table_key_size];
+};
+
+int main(int argc, char* argv[]) {
+  string waypoints_path = "../lake_track_waypoints.csv";
+  string output_path = "mpc_table.bin";
+  size_t laps = 3;
+  size_t copies = 20;
+  double spread = 0.1;
+  double radius = 0.5;
+  double tolerance = 0.1;
+  uint64_t seed = 1;
+  bool use_sqp = false;
+  MPC_Config config;
+  SimConfig sim_config;
+
+  // CppAD has a memory pool for a worker per core, see SetupParallelAD
+  const size_t max_threads = max(1u, thread::hardware_concurrency());
+  size_t threads = max_threads;
+
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (arg == "--config" && i + 1 < argc) {
+      string error;
+      if (!LoadConfigFile(argv[++i], config, error)) {
+        cerr << error << endl;
+        return 1;
+      }
+    } else if (arg == "--sqp") {
+      use_sqp = true;
+    } else if (arg == "--laps" && i + 1 < argc) {
+      if (!ParseCount(argv[++i], laps)) {
+        cerr << "Bad value for " << arg << ": " << argv[i] << endl;
+        return 1;
+      }
+    } else if (arg == "--copies" && i + 1 < argc) {
+      if (!ParseCount(argv[++i], copies)) {
+        cerr << "Bad value for " << arg << ": " << argv[i] << endl;
+        return 1;
+      }
+    } else if (arg == "--spread" && i + 1 < argc) {
+      if (!ParseNumber(argv[++i], spread) || spread <= 0) {
+        cerr << "Bad value for " << arg << ": " << argv[i] << endl;
+        return 1;
+      }
+    } else if (arg == "--radius" && i + 1 < argc) {
+      if (!ParseNumber(argv[++i], radius) || radius < 0) {
+        cerr << "Bad value for " << arg << ": " << argv[i] << endl;
+        return 1;
+      }
+    } else if (arg == "--tolerance" && i + 1 < argc) {
+      if (!ParseNumber(argv[++i], tolerance) || tolerance <= 0) {
+        cerr << "Bad value for " << arg << ": " << argv[i] << endl;
+        return 1;
+      }
+    } else if (arg == "--seed" && i + 1 < argc) {
+      size_t seed_value;
+      if (!ParseCount(argv[++i], seed_value)) {
+        cerr << "Bad value for " << arg << ": " << argv[i] << endl;
+        return 1;
+      }
+      seed = seed_value;
+    } else if (arg == "--threads" && i + 1 < argc) {
+      if (!ParseCount(argv[++i], threads)) {
+        cerr << "Bad value for " << arg << ": " << argv[i] << endl;
+        return 1;
+      }
+      threads = min(max_threads, max<size_t>(1, threads));
+    } else if (arg == "--waypoints" && i + 1 < argc) {
+      waypoints_path = argv[++i];
+    } else if (arg == "--dynamic") {
+      sim_config.dynamic = true;
+    } else if (arg == "--output" && i + 1 < argc) {
+      output_path = argv[++i];
+    } else {
+      cerr << "Unknown argument " << arg << endl;
+      return 1;
+    }
+  }
+
+  Track track;
+  if (!track.Load(waypoints_path)) {
+    cerr << "Failed to read waypoints from " << waypoints_path << endl;
+    return 1;
+  }
+
+  // Has to happen before the first MPC, which records its tape on this
+  // thread like the ones of MPC::SolveBatch
+  SetupParallelAD(max_threads);
+  const MPC::Backend backend = use_sqp ? MPC::SQP : MPC::IPOPT;
+  auto wall_start = chrono::steady_clock::now();
+
+  // Without time limits, so which problems come up and which converge
+  // doesn't depend on the number of threads or the load of the machine
+  MPC_Config solve_config = config;
+  solve_config.deadline = INFINITY;
+  solve_config.max_cpu_time = INFINITY;
+
+  // Drive the laps and keep every problem the controller was given
+  vector<Problem> problems;
+  {
+    MPC mpc(solve_config);
+    mpc.SetWarmStart(true);
+    mpc.SetBackend(backend);
+    Simulator sim(track, sim_config, mpc);
+    sim.SetObserver([&problems](const Pipeline& pipeline) {
+      Problem problem;
+      if (MPC_Table::MakeKey(pipeline.state(), pipeline.coeffs(),
+                             problem.key)) {
+        problems.push_back(problem);
+      }
+    });
+    for (size_t k = 0; k < laps; k++) {
+      if (!sim.RunLap().completed) {
+        cerr << "Lap " << k + 1 << " wasn't completed, the table only "
+             << "covers the problems up to there" << endl;
+        break;
+      }
+    }
+  }
+  if (problems.empty()) {
+    cerr << "No problems to solve" << endl;
+    return 1;
+  }
+
+  // Copies moved by a fraction of the spread of each dimension. The y
+  // of the state is always 0 and stays that way.
+  double mean[table_key_size] = {};
+  double deviation[table_key_size] = {};
+  for (const Problem& problem : problems) {
+    for (size_t d = 0; d < table_key_size; d++) {
+      mean[d] += problem.key[d] / problems.size();
+    }
+  }
+  for (const Problem& problem : problems) {
+    for (size_t d = 0; d < table_key_size; d++) {
+      double offset = problem.key[d] - mean[d];
+      deviation[d] += offset * offset / problems.size();
+    }
+  }
+  mt19937_64 random(seed);
+  normal_distribution<double> normal(0.0, spread);
+  const size_t collected = problems.size();
+  problems.reserve(collected * (1 + copies));
+  for (size_t i = 0; i < collected; i++) {
+    for (size_t c = 0; c < copies; c++) {
+      Problem copy = problems[i];
+      for (size_t d = 0; d < table_key_size; d++) {
+        copy.key[d] += normal(random) * sqrt(deviation[d]);
+      }
+      problems.push_back(copy);
+    }
+  }
+
+  // One solver per worker, created on that worker the first time it
+  // gets a problem so its tape lives in the worker's CppAD pool
+  vector<unique_ptr<MPC>> solvers(threads);
+  vector<MPC_TableSample> samples(problems.size());
+  vector<char> converged(problems.size(), 0);
+  {
+    ThreadPool pool(threads);
+    pool.ParallelFor(problems.size(), [&](size_t i) {
+      unique_ptr<MPC>& solver = solvers[ThreadPool::ThreadNumber() - 1];
+      if (!solver) {
+        solver.reset(new MPC(solve_config));
+        solver->SetBackend(backend);
+      }
+      MPC& mpc = *solver;
+      const double* key = problems[i].key;
+      Eigen::VectorXd state(6);
+      Eigen::VectorXd coeffs(4);
+      state << key[0], key[1], key[2], key[3], key[4], key[5];
+      coeffs << key[6], key[7], key[8], key[9];
+
+      // Cold, so a record doesn't depend on what the worker solved before
+      mpc.Reset();
+      MPC_TableSample& sample = samples[i];
+      sample.solved = mpc.Solve(state, coeffs);
+      copy(key, key + table_key_size, sample.key);
+      sample.cost = mpc.cost();
+      converged[i] = mpc.stats().source == SOLVER_PLAN;
+    });
+
+    // Each freed on the worker that made it
+    pool.ParallelForPinned(threads, [&](size_t t) { solvers[t].reset(); });
+  }
+
+  size_t kept = 0;
+  for (size_t i = 0; i < samples.size(); i++) {
+    if (converged[i]) {
+      swap(samples[kept++], samples[i]);
+    }
+  }
+  samples.resize(kept);
+
+  // Drive a lap with the table before it replaces anything at
+  // output_path. Problems are looked up as the controller would, so a
+  // table that steers the car off the track is caught here.
+  string check_path = output_path + ".check";
+  string error;
+  if (!WriteTable(check_path, config, backend, radius, tolerance, samples,
+                  error)) {
+    cerr << error << endl;
+    return 1;
+  }
+  LapResult check;
+  size_t answered = 0;
+  {
+    shared_ptr<MPC_Table> table(new MPC_Table);
+    if (!table->Open(check_path, error)) {
+      cerr << error << endl;
+      remove(check_path.c_str());
+      return 1;
+    }
+    MPC mpc(solve_config);
+    mpc.SetWarmStart(true);
+    mpc.SetBackend(backend);
+    mpc.SetTable(table);
+    Simulator sim(track, sim_config, mpc);
+    sim.SetObserver([&mpc, &answered](const Pipeline&) {
+      if (mpc.stats().source == TABLE_LOOKUP) {
+        answered++;
+      }
+    });
+    check = sim.RunLap();
+  }
+  if (!check.completed) {
+    remove(check_path.c_str());
+    cerr << "The check lap with the table wasn't completed (" << answered
+         << " of " << check.messages << " problems answered from it), "
+         << "nothing written. A smaller --radius or --tolerance keeps the "
+         << "table to problems it answers well." << endl;
+    return 1;
+  }
+  if (rename(check_path.c_str(), output_path.c_str()) != 0) {
+    remove(check_path.c_str());
+    cerr << "Failed to write " << output_path << endl;
+    return 1;
+  }
+
+  double wall = ElapsedMicros(wall_start) * 1e-6;
+  cout << collected << " problems from " << laps << " laps, "
+       << problems.size() << " with copies, " << kept
+       << " converged and written to " << output_path << " on " << threads
+       << " threads in " << wall << " s" << endl;
+  cout << "Check lap " << check.lap_time << " s, max cte " << check.max_cte
+       << " m, " << answered << " of " << check.messages
+       << " problems answered from the table" << endl;
+  return 0;
+}